@@ -17,6 +17,9 @@ ColorSpace colorSpaceFromFFmpeg(AVColorSpace space)
         case AVCOL_SPC_BT470BG:
         case AVCOL_SPC_SMPTE170M:
             return ColorSpace_BT601;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            return ColorSpace_BT2020;
         default:
             return ColorSpace_Unknown;
     }
@@ -35,4 +38,21 @@ ColorRange colorRangeFromFFmpeg(AVColorRange range)
     }
 }
 
+ColorTransfer colorTransferFromFFmpeg(AVColorTransferCharacteristic trc)
+{
+    switch (trc)
+    {
+        case AVCOL_TRC_UNSPECIFIED:
+        case AVCOL_TRC_RESERVED:
+        case AVCOL_TRC_RESERVED0:
+            return ColorTransfer_Unknown;
+        case AVCOL_TRC_SMPTE2084:
+            return ColorTransfer_PQ;
+        case AVCOL_TRC_ARIB_STD_B67:
+            return ColorTransfer_HLG;
+        default:
+            return ColorTransfer_SDR;
+    }
+}
+
 NAMESPACE_END
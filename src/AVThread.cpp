@@ -98,6 +98,11 @@ void AVThread::setSeeking(bool s)
     d_func()->seeking = s;
 }
 
+void AVThread::setSeekFinishedCallback(std::function<void()> f)
+{
+    d_func()->seekFinished = f;
+}
+
 void AVThread::waitAndCheck(int ms)
 {
 //    AVDebug("wait and check: %d\n", ms);
@@ -37,6 +37,10 @@ public:
 
     bool isSeeking() const;
     void setSeeking(bool s);
+    /**
+     * @brief called when the first frame after seek is shown
+     */
+    void setSeekFinishedCallback(std::function<void()> f);
 
     void waitAndCheck(int ms);
 
@@ -9,7 +9,10 @@
 #include "innermath.h"
 #include "framequeue.h"
 #include "resample/AudioResample.h"
+#include <mutex>
+#include <atomic>
 extern "C" {
+#include "libavformat/avformat.h"
 #include "libavutil/samplefmt.h"
 }
 
@@ -27,7 +30,8 @@ public:
         abort(false),
         pkts(nullptr),
         serial(-1),
-        eof(false)
+        eof(false),
+        pending_stream(nullptr)
     {
 
     }
@@ -72,6 +76,7 @@ public:
                 }
                 if (pkt.isFlush()) {
                     AVDebug("Seek is required, flush video decoder.\n");
+                    reopenIfSwitched();
                     decoder->flush();
                     /* must clear the frames buffer for seek*/
                     frames.clear();
@@ -91,6 +96,10 @@ public:
             if (!frame.isValid()) {
                 continue;
             }
+            /* a new seek is required while decoding, don't wait for the frames queue */
+            if (serial != pkts->serial()) {
+                continue;
+            }
             eof = false;
             frame.setSerial(serial);
             frames.enqueue(frame);
@@ -98,6 +107,19 @@ public:
         CThread::run();
     }
 
+    /* the track is switched before the flush packet is queued */
+    void reopenIfSwitched()
+    {
+        AVStream *stream = nullptr;
+        {
+            DECL_LOCKGUARD(mutex);
+            stream = pending_stream;
+            pending_stream = nullptr;
+        }
+        if (stream && !decoder->reopen(stream))
+            AVWarning("Reopen audio decoder for stream %d failed.\n", stream->index);
+    }
+
     bool abort;
     PacketQueue *pkts;
     AudioFrameQueue frames;
@@ -107,6 +129,8 @@ public:
     // flush decoder when media is eof
     bool flush_dec;
     bool eof;
+    AVStream *pending_stream;
+    std::mutex mutex;
 };
 
 const int8_t AUDIO_DIFF_AVG_NB = 20;
@@ -118,7 +142,8 @@ public:
         audio_diff_cum(0),
         audio_diff_avg_coef(0),
         audio_diff_avg_count(0),
-        audio_diff_threshold(0)
+        audio_diff_threshold(0),
+        seek_finish_req(false)
     {
         decode_thread = new AudioDecoderThread;
     }
@@ -145,6 +170,8 @@ public:
     double audio_diff_avg_coef;
     int audio_diff_avg_count;
     double audio_diff_threshold;
+    /* seek_req is reset while writing, so use another flag to notify the first frame */
+    std::atomic<bool> seek_finish_req;
 };
 
 void AudioThreadPrivate::setResampleParas(AudioOutput *ao)
@@ -217,6 +244,22 @@ AudioThread::~AudioThread() {
 
 }
 
+void AudioThread::requestSeek()
+{
+    DPTR_D(AudioThread);
+    /* the decoded frames are obsolete, and wake up the decoder if it is blocked by them */
+    d->decode_thread->frames.clear();
+    d->seek_finish_req = true;
+    AVThread::requestSeek();
+}
+
+void AudioThread::switchStream(AVStream *stream)
+{
+    DPTR_D(AudioThread);
+    DECL_LOCKGUARD(d->decode_thread->mutex);
+    d->decode_thread->pending_stream = stream;
+}
+
 void AudioThread::run()
 {
     DPTR_D(AudioThread);
@@ -275,6 +318,9 @@ void AudioThread::run()
         double pts = frame.timestamp();
         int buffer_size = ao ? ao->bufferSize() : 512 * 16;
         clock->updateValue(SyncToAudio, pts, frame.serial());
+        if (d->seek_finish_req.exchange(false)) {
+            CALL_BACK(d->seekFinished);
+        }
         //AVDebug("audio frame pts: %.3f\n", frame.timestamp());
         while (decodedSize > 0) {
             if (d->stopped) {
@@ -3,6 +3,8 @@
 
 #include "AVThread.h"
 
+typedef struct AVStream AVStream;
+
 NAMESPACE_BEGIN
 
 class AudioFrame;
@@ -14,6 +16,11 @@ public:
     AudioThread();
     virtual ~AudioThread() PU_DECL_OVERRIDE;
 
+    void requestSeek() PU_DECL_OVERRIDE;
+    /**
+     * @brief the decoder is reopened for the stream at the next flush packet
+     */
+    void switchStream(AVStream *stream);
     void startDecode();
     void setDecoderThread(void* thread);
 
@@ -0,0 +1,186 @@
+#include "sdk/mediascanner.h"
+#include "demuxer/Demuxer.h"
+#include "utils/ThreadPool.h"
+#include "AVLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavutil/time.h"
+#ifdef __cplusplus
+}
+#endif
+
+NAMESPACE_BEGIN
+
+class MediaScannerPrivate
+{
+public:
+    MediaScannerPrivate():
+        threads(0),
+        probe_size(0),
+        probe_duration(0),
+        abort_req(false)
+    {
+
+    }
+    ~MediaScannerPrivate()
+    {
+
+    }
+
+    int scan(const std::string &url, MediaInfo *info);
+    void scanTask(const std::string &url);
+
+    int threads;
+    int64_t probe_size;
+    int64_t probe_duration;
+    std::atomic<bool> abort_req;
+    std::function<void(const std::string&, int, MediaInfo*)> scan_cb;
+    ScanStatistics statistics;
+    /* the demuxers loading, to abort the blocking probe */
+    std::vector<Demuxer*> demuxers;
+    mutable std::mutex mutex;
+};
+
+int MediaScannerPrivate::scan(const std::string &url, MediaInfo *info)
+{
+    Demuxer demuxer;
+    int ret;
+
+    demuxer.setMedia(url);
+    demuxer.setMediaInfo(info);
+    demuxer.setProbeLimit(probe_size, probe_duration * 1000);
+    {
+        DECL_LOCKGUARD(mutex);
+        if (abort_req)
+            return -1;
+        demuxers.push_back(&demuxer);
+    }
+    /* initMediaInfo() is called in load() */
+    ret = demuxer.load();
+    if (ret < 0)
+        AVWarning("MediaScanner: can not probe %s.\n", url.c_str());
+    else
+        CALL_BACK(scan_cb, url, ret, info);
+    {
+        DECL_LOCKGUARD(mutex);
+        demuxers.erase(std::remove(demuxers.begin(), demuxers.end(), &demuxer), demuxers.end());
+    }
+    demuxer.unload();
+    return ret;
+}
+
+void MediaScannerPrivate::scanTask(const std::string &url)
+{
+    if (abort_req)
+        return;
+    MediaInfo info;
+    info.size = 0;
+    const int64_t begin = av_gettime_relative();
+    const int ret = scan(url, &info);
+    const double elapsed = (av_gettime_relative() - begin) / 1000.0;
+    if (ret < 0)
+        CALL_BACK(scan_cb, url, ret, nullptr);
+
+    DECL_LOCKGUARD(mutex);
+    statistics.files++;
+    if (ret < 0)
+        statistics.failed++;
+    else
+        statistics.bytes += info.size;
+    statistics.average += (elapsed - statistics.average) / statistics.files;
+    statistics.max = std::max(statistics.max, elapsed);
+}
+
+MediaScanner::MediaScanner():
+    d_ptr(new MediaScannerPrivate)
+{
+}
+
+MediaScanner::~MediaScanner()
+{
+    abort();
+}
+
+void MediaScanner::setThreads(int threads)
+{
+    DPTR_D(MediaScanner);
+    d->threads = threads;
+}
+
+void MediaScanner::setProbeLimit(int64_t size, int64_t duration)
+{
+    DPTR_D(MediaScanner);
+    d->probe_size = size;
+    d->probe_duration = duration;
+}
+
+void MediaScanner::setScanCallback(std::function<void(const std::string &url, int ret, MediaInfo *info)> f)
+{
+    DPTR_D(MediaScanner);
+    d->scan_cb = f;
+}
+
+int MediaScanner::scan(const std::string &url, MediaInfo *info)
+{
+    DPTR_D(MediaScanner);
+    if (!info)
+        return -1;
+    d->abort_req = false;
+    return d->scan(url, info);
+}
+
+int MediaScanner::scan(const StringList &urls)
+{
+    DPTR_D(MediaScanner);
+    {
+        DECL_LOCKGUARD(d->mutex);
+        d->statistics = ScanStatistics();
+    }
+    d->abort_req = false;
+    if (urls.empty())
+        return 0;
+
+    const int64_t begin = av_gettime_relative();
+    {
+        ThreadPool pool(d->threads > 0 ? std::min<int>(d->threads, FORCE_INT(urls.size())) : 0);
+        for (StringList::const_iterator it = urls.begin(); it != urls.end(); ++it) {
+            const std::string url = *it;
+            pool.post([d, url] { d->scanTask(url); });
+        }
+        pool.waitForDone();
+    }
+    const double elapsed = (av_gettime_relative() - begin) / 1000.0;
+
+    DECL_LOCKGUARD(d->mutex);
+    d->statistics.elapsed = elapsed;
+    if (elapsed > 0)
+        d->statistics.files_per_second = d->statistics.files * 1000.0 / elapsed;
+    AVDebug("MediaScanner: %lld files scanned, %lld failed, %.2f files/s\n",
+        (long long)d->statistics.files, (long long)d->statistics.failed, d->statistics.files_per_second);
+    return FORCE_INT(d->statistics.files - d->statistics.failed);
+}
+
+void MediaScanner::abort()
+{
+    DPTR_D(MediaScanner);
+    DECL_LOCKGUARD(d->mutex);
+    d->abort_req = true;
+    for (size_t i = 0; i < d->demuxers.size(); ++i)
+        d->demuxers[i]->abort();
+}
+
+ScanStatistics MediaScanner::statistics() const
+{
+    DPTR_D(const MediaScanner);
+    DECL_LOCKGUARD(d->mutex);
+    return d->statistics;
+}
+
+NAMESPACE_END
@@ -33,6 +33,7 @@ Packet::Packet():
     dts(0),
     duration(0),
     pos(0),
+    arrival(0),
     serial(-1)
 {
 
@@ -53,6 +54,7 @@ Packet::Packet(const Packet &other)
     duration = other.duration;
     dts = other.dts;
     pos = other.pos;
+    arrival = other.arrival;
     //data = other.data;
     attach = other.attach;
     size = other.size;
@@ -71,6 +73,7 @@ Packet &Packet::operator =(const Packet &other)
     duration = other.duration;
     dts = other.dts;
     pos = other.pos;
+    arrival = other.arrival;
     //data = other.data;
     attach = other.attach;
     size = other.size;
@@ -124,6 +127,14 @@ Packet Packet::fromAVPacket(const AVPacket *packet, double time_base)
     return pkt;
 }
 
+Packet Packet::detached() const
+{
+    Packet pkt(*this);
+    pkt.d_ptr = std::make_shared<PacketPrivate>();
+    av_packet_ref(pkt.avPacket(), asAVPacket());
+    return pkt;
+}
+
 bool Packet::isEOF() const
 {
     //if (data.isEmpty())
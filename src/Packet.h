@@ -26,6 +26,11 @@ public:
     const AVPacket *asAVPacket() const;
 
     static Packet fromAVPacket(const AVPacket *packet, double time_base);
+    /**
+     * @brief a copy with its own AVPacket referencing the same data, so the
+     * properties of the AVPacket can be changed without touching the others
+     */
+    Packet detached() const;
 
     bool isEOF() const;
     static Packet createEOF();
@@ -36,6 +41,8 @@ public:
     bool containKeyFrame, isCorrupted;
     double pts, dts, duration; //in second
     int64_t pos;
+    /* the time it's read by the demuxer in ms of av_gettime_relative(), 0 if unknown */
+    int64_t arrival;
     //ByteArray data;
     std::string attach;
     int size;
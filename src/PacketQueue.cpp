@@ -2,6 +2,9 @@
 #include "AVLog.h"
 #include "utils/innermath.h"
 
+#include <deque>
+#include <utility>
+
 extern "C" {
 #include <libavutil/time.h>
 }
@@ -11,10 +14,28 @@ NAMESPACE_BEGIN
 typedef struct {
     int64_t v; //pts, total packes or total bytes
     int64_t bytes; //total bytes
+    int64_t count; //total packets
+    int64_t ts; //dts or pts in ms, -1 if unknown
     int64_t t;
+    int64_t seq;
 } BufferInfo;
 
+/* the transit (arrival time - timestamp) of a record and its seq */
+typedef std::pair<int64_t, int64_t> Transit;
+
 static const int kAvgSize = 16;
+/* the sliding window to measure the input */
+static const size_t kRecordMax = 512;
+static const int64_t kRecordWindow = 10000; //ms
+/* packets measured before the buffer value is adapted */
+static const size_t kEstimateMin = 8;
+static const double kJitterFactor = 1.5;
+static const int64_t kTargetMin = 100; //ms
+static const int64_t kTargetMax = 10000; //ms
+/* added to the target on each underrun, and halved after a while without underrun */
+static const int64_t kUnderrunMargin = 200; //ms
+static const int64_t kMarginDecay = 10000; //ms
+
 class PacketQueuePrivate
 {
 public:
@@ -25,15 +46,23 @@ public:
 		buffering(true), // in buffering state at the beginning
 		max(1.5),
         realtime(false),
+        adaptive(false),
 		buffer(24),
+        user_buffer(24),
 		value0(0),
-		value1(0)/*,
+		value1(0),
+        margin(0),
+        last_underrun(0),
+        next_seq(0)/*,
 		history(kAvgSize)*/
     {
 
     }
 
 	float calc_speed(bool use_bytes) const;
+    void addRecord(const Packet &pkt);
+    void clearRecord();
+    void updateEstimate();
 
     double duration;
     int serial;
@@ -41,10 +70,19 @@ public:
 	bool buffering;
 	double max;
     bool realtime;
+    bool adaptive;
 	// bytes or count
 	int64_t buffer;
+    /* set by setBufferValue(), restored when it's not adaptive */
+    int64_t user_buffer;
 	int64_t value0, value1;
-    std::vector<BufferInfo> record;
+    std::deque<BufferInfo> record;
+    BufferEstimate estimate;
+    int64_t margin;
+    int64_t last_underrun;
+    int64_t next_seq;
+    /* the min/max transit of the records, the front is of the whole window */
+    std::deque<Transit> transit_min, transit_max;
 };
 
 
@@ -111,7 +149,10 @@ BufferMode PacketQueue::bufferMode() const
 
 void PacketQueue::setBufferValue(int64_t value)
 {
-	d_func()->buffer = value;
+	DPTR_D(PacketQueue);
+	std::unique_lock<std::mutex> lock(mutex);
+	d->buffer = value;
+	d->user_buffer = value;
 }
 
 int64_t PacketQueue::bufferValue() const
@@ -155,15 +196,39 @@ float PacketQueue::bufferProgress() const
 float PacketQueue::bufferSpeed() const
 {
 	DPTR_D(const PacketQueue);
+	std::unique_lock<std::mutex> lock(mutex);
 	return d->calc_speed(false);
 }
 
 float PacketQueue::bufferSpeedInBytes() const
 {
 	DPTR_D(const PacketQueue);
+	std::unique_lock<std::mutex> lock(mutex);
 	return d->calc_speed(true);
 }
 
+void PacketQueue::setAdaptive(bool adaptive)
+{
+    DPTR_D(PacketQueue);
+    std::unique_lock<std::mutex> lock(mutex);
+    d->adaptive = adaptive;
+    d->margin = 0;
+    if (!adaptive)
+        d->buffer = d->user_buffer;
+}
+
+bool PacketQueue::isAdaptive() const
+{
+    return d_func()->adaptive;
+}
+
+BufferEstimate PacketQueue::estimate() const
+{
+    DPTR_D(const PacketQueue);
+    std::unique_lock<std::mutex> lock(mutex);
+    return d->estimate;
+}
+
 bool PacketQueue::checkEnough() const
 {
 	return buffered() >= bufferValue();
@@ -183,6 +248,8 @@ void PacketQueue::onEnqueue(const Packet & pkt)
 	if (pkt.isFlush()) {
 		d->serial++;
 		d->duration = 0;
+        /* the timeline is changed */
+        d->clearRecord();
 	}
 	else {
 		d->duration += pkt.duration;
@@ -210,20 +277,15 @@ void PacketQueue::onEnqueue(const Packet & pkt)
 	else {
 		d->value1++;
 	}
-    if (!d->buffering) {
-        d->record.clear();
-        return;
+    d->addRecord(pkt);
+    if (d->realtime) {
+        d->updateEstimate();
     }
+    if (!d->buffering)
+        return;
 	if (checkEnough()) {
 		d->buffering = false;
 	}
-	BufferInfo info;
-    info.bytes = pkt.size;
-	if (!d->record.empty())
-        info.bytes += d->record.back().bytes;
-    info.v = d->value1;
-    info.t = static_cast<int64_t>(av_gettime_relative() / 1000.0);
-	d->record.push_back(info);
 }
 
 void PacketQueue::onDequeue(const Packet & pkt)
@@ -233,6 +295,13 @@ void PacketQueue::onDequeue(const Packet & pkt)
 		d->duration -= pkt.duration;
 	}
 	if (checkEmpty()) {
+        /* clear() dequeues an empty packet */
+        if (d->realtime && !d->buffering && pkt.size > 0) {
+            d->estimate.underruns++;
+            d->last_underrun = av_gettime_relative() / 1000;
+            if (d->adaptive)
+                d->margin = std::min(d->margin + kUnderrunMargin, kTargetMax);
+        }
 		d->buffering = true;
 	}
 	if (checkEmpty()) {
@@ -253,17 +322,107 @@ void PacketQueue::onDequeue(const Packet & pkt)
 	}
 }
 
+void PacketQueuePrivate::addRecord(const Packet &pkt)
+{
+    BufferInfo info;
+    /* the queue blocks the demuxer when full, the enqueue time is not the arrival time */
+    info.t = pkt.arrival > 0 ? pkt.arrival : av_gettime_relative() / 1000;
+    info.bytes = pkt.size;
+    info.count = 1;
+    if (!record.empty()) {
+        info.bytes += record.back().bytes;
+        info.count += record.back().count;
+    }
+    /* dts is monotonic even if there are b-frames */
+    const double ts = !isnan(pkt.dts) && pkt.dts >= 0 ? pkt.dts : pkt.pts;
+    info.ts = !isnan(ts) && ts >= 0 ? FORCE_INT64(ts * 1000.0) : -1;
+    if (mode == BufferTime)
+        info.v = info.ts;
+    else if (mode == BufferBytes)
+        info.v = info.bytes;
+    else
+        info.v = info.count;
+    info.seq = next_seq++;
+    record.push_back(info);
+    if (info.ts >= 0) {
+        const Transit transit(info.seq, info.t - info.ts);
+        while (!transit_min.empty() && transit_min.back().second >= transit.second)
+            transit_min.pop_back();
+        transit_min.push_back(transit);
+        while (!transit_max.empty() && transit_max.back().second <= transit.second)
+            transit_max.pop_back();
+        transit_max.push_back(transit);
+    }
+    while (record.size() > kRecordMax || info.t - record.front().t > kRecordWindow)
+        record.pop_front();
+    const int64_t front = record.front().seq;
+    while (!transit_min.empty() && transit_min.front().first < front)
+        transit_min.pop_front();
+    while (!transit_max.empty() && transit_max.front().first < front)
+        transit_max.pop_front();
+}
+
+void PacketQueuePrivate::clearRecord()
+{
+    record.clear();
+    transit_min.clear();
+    transit_max.clear();
+}
+
+void PacketQueuePrivate::updateEstimate()
+{
+    if (record.size() < 2)
+        return;
+    const BufferInfo &first = record.front();
+    const BufferInfo &last = record.back();
+    const double dt = (last.t - first.t) / 1000.0;
+    if (dt > 0) {
+        estimate.arrival_rate = (last.count - first.count) / dt;
+        estimate.byte_rate = (last.bytes - first.bytes) / dt;
+    }
+    /* the transit of a packet is arrival time - timestamp, its spread is the jitter */
+    if (!transit_min.empty())
+        estimate.jitter = FORCE_DOUBLE(transit_max.front().second - transit_min.front().second);
+    if (margin > 0 && last.t - last_underrun > kMarginDecay) {
+        margin /= 2;
+        last_underrun = last.t;
+    }
+    estimate.target = std::min(kTargetMax, std::max(kTargetMin,
+        FORCE_INT64(std::llround(estimate.jitter * kJitterFactor)) + margin));
+
+    if (!adaptive || record.size() < kEstimateMin)
+        return;
+    int64_t value;
+    if (mode == BufferTime)
+        value = estimate.target;
+    else if (mode == BufferBytes)
+        value = FORCE_INT64(std::llround(estimate.byte_rate * estimate.target / 1000.0));
+    else
+        value = FORCE_INT64(std::llround(estimate.arrival_rate * estimate.target / 1000.0));
+    if (value > 0)
+        buffer = value;
+}
+
 float PacketQueuePrivate::calc_speed(bool use_bytes) const
 {
-    if (record.empty())
+    /* the records without timestamp are skipped in BufferTime mode */
+    std::deque<BufferInfo>::const_iterator first = record.begin();
+    std::deque<BufferInfo>::const_reverse_iterator last = record.rbegin();
+    if (!use_bytes) {
+        while (first != record.end() && first->v < 0)
+            ++first;
+        while (last != record.rend() && last->v < 0)
+            ++last;
+    }
+    if (first == record.end())
         return 0;
-    const double dt = (double)av_gettime_relative() / 1000000.0 - record.front().t / 1000.0;
+    const double dt = (double)av_gettime_relative() / 1000000.0 - first->t / 1000.0;
     // dt should be always > 0 because history stores absolute time
     if (FuzzyIsNull(dt))
         return 0;
-    const int64_t delta = use_bytes ? 
-        record.back().bytes - record.front().bytes :
-        record.back().v - record.front().v;
+    const int64_t delta = use_bytes ?
+        last->bytes - first->bytes :
+        last->v - first->v;
     if (delta < 0) {
         AVWarning("PacketBuffer internal error. delta(bytes %d): %lld\n", use_bytes, delta);
         return 0;
@@ -57,6 +57,16 @@ public:
 	 */
 	float bufferSpeed() const;
 	float bufferSpeedInBytes() const;
+	/**
+	 * @brief setAdaptive
+	 * Size the buffer value automatically by the arrival rate and jitter of
+	 * the input, for real-time stream only. The value set by setBufferValue()
+	 * is used until enough packets are measured, and restored when it's
+	 * disabled.
+	 */
+	void setAdaptive(bool adaptive);
+	bool isAdaptive() const;
+	BufferEstimate estimate() const;
 
 	bool checkEnough() const override;
 	bool checkFull() const override;
@@ -1,5 +1,8 @@
 #include "player_p.h"
+#include <algorithm>
 #include "glad/glad.h"
+#include "renderer/ShaderCache.h"
+#include "renderer/ShaderManager.h"
 
 NAMESPACE_BEGIN
 
@@ -22,6 +25,7 @@ Player::~Player()
 void Player::setMedia(const std::string& url)
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
 
     d->url = url;
     d->demuxer->setMedia(url);
@@ -30,22 +34,68 @@ void Player::setMedia(const std::string& url)
 void Player::setWantedStreamSpec(MediaType type, const char* spec)
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
 
     d->demuxer->setWantedStreamSpec(type, spec);
 }
 
 int Player::mediaStreamIndex(MediaType type)
 {
-    return d_func()->demuxer->streamIndex(type);
+    DPTR_D(Player);
+    d->applyChainedMedia();
+    return d->demuxer->streamIndex(type);
 }
 
 void Player::setMediaStreamDisable(MediaType type)
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
 
     d->demuxer->setMediaStreamDisable(type);
 }
 
+bool Player::switchTrack(MediaType type, int track)
+{
+    DPTR_D(Player);
+    d->applyChainedMedia();
+    if (!d->loaded || track < 0)
+        return false;
+    int stream = -1;
+    if (type == MediaTypeAudio && track < FORCE_INT(d->mediainfo.audios.size()))
+        stream = std::next(d->mediainfo.audios.begin(), track)->stream;
+    else if (type == MediaTypeSubtitle && track < FORCE_INT(d->mediainfo.subtitles.size()))
+        stream = std::next(d->mediainfo.subtitles.begin(), track)->stream;
+    if (stream < 0)
+        return false;
+    return d->demux_thread->switchTrack(type, stream);
+}
+
+void Player::setTrackSwitchWindow(int64_t bytes)
+{
+    DPTR_D(Player);
+    d->applyChainedMedia();
+    d->demuxer->setTrackWindow(bytes);
+}
+
+void Player::setExternalAudio(const std::string &url, double offset)
+{
+    DPTR_D(Player);
+    d->external_audio_url = url;
+    d->external_audio_offset = offset;
+}
+
+void Player::setExternalAudioOffset(double offset)
+{
+    DPTR_D(Player);
+    const double delta = offset - d->external_audio_offset;
+    d->external_audio_offset = offset;
+    if (!d->loaded || !d->external_audio || !d->external_audio->isRunning())
+        return;
+    d->external_audio->setOffset(d->external_audio->offset() + delta);
+    /* the queued packets have the old offset */
+    d->external_audio->seek(d->clock.value());
+}
+
 void Player::prepare()
 {
     DPTR_D(Player);
@@ -66,6 +116,7 @@ void Player::prepare()
     }
     d->media_status = Loaded;
     CALL_BACK(d->mediaStatusChanged, Loaded);
+    d->loadExternalAudio();
     d->initRenderVideo();
     d->clock.setMaxDuration(d->demuxer->maxDuration());
     d->applySubtitleStream();
@@ -113,6 +164,7 @@ void Player::stop()
 {
 	DPTR_D(Player);
 
+    d->applyChainedMedia();
     if (d->load_media_async) {
         d->load_media_async->stop();
         d->load_media_async->wait();
@@ -141,7 +193,11 @@ void Player::stop()
         delete d->video_thread;
         d->video_thread = nullptr;
     }
+    d->releaseVideoViews();
 	d->demuxer->unload();
+    d->deleteRetiredDemuxers();
+    if (d->external_audio)
+        d->external_audio->demuxer()->unload();
     d->loaded = false;
     d->media_status = Unloaded;
     CALL_BACK(d->mediaStatusChanged, Unloaded);
@@ -150,13 +206,43 @@ void Player::stop()
 void Player::setSpeed(float speed)
 {
     DPTR_D(Player);
-    d->clock.setSpeed(speed);
+    const bool trick = speed < 0 || speed >= TRICK_PLAY_SPEED_MIN;
+    if (trick) {
+        if (speed < 0)
+            speed = std::max(std::min(speed, -TRICK_PLAY_SPEED_MIN), -TRICK_PLAY_SPEED_MAX);
+        else
+            speed = std::min(speed, TRICK_PLAY_SPEED_MAX);
+        d->demux_thread->setTrickPlaySpeed(speed);
+        if (d->demux_thread->trickPlaySpeed() == 0)
+            return;
+    } else {
+        d->clock.setSpeed(speed);
+        if (d->demux_thread->trickPlaySpeed() == 0)
+            return;
+        d->demux_thread->setTrickPlaySpeed(0);
+    }
+    /* the audio is skipped in trick play */
+    if (d->ao)
+        d->ao->pause(trick || d->paused);
+}
+
+bool Player::setVideoSuspended(bool suspended)
+{
+    DPTR_D(Player);
+    return d->demux_thread->setVideoSuspended(suspended);
+}
+
+bool Player::isVideoSuspended() const
+{
+    DPTR_D(const Player);
+    return d->demux_thread->isVideoSuspended();
 }
 
 float Player::speed() const
 {
     DPTR_D(const Player);
-    return d->clock.speed();
+    const float trick_speed = d->demux_thread->trickPlaySpeed();
+    return trick_speed != 0 ? trick_speed : d->clock.speed();
 }
 
 bool Player::isMute() const
@@ -190,27 +276,20 @@ bool Player::isPlaying()
 void Player::seek(double t, SeekType type)
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
 
     AVDebug("seek started.\n");
     if (d->media_status != Prepared) {
         AVDebug("media is not prepared.\n");
         return;
     }
-    if (!d->demuxer->isSeekable())
+    if (!d->demuxer->isSeekable() && !d->demux_thread->isTimeShift())
         return;
-    /* if pos is nan, it indicates that the previous seek operation has not been completed */
+    /*
+     * if pos is nan, it indicates that the previous seek operation has not been completed,
+     * the demuxer will seek from the previous target, so do not drop the request.
+     */
     double pos = position();
-    if (isnan(pos)) {
-        AVDebug("pts is nan, seek isn't finished.\n");
-        return;
-    }
-    if (d->clock.type() != SyncToVideo 
-        && isnan(d->clock.value(SyncToVideo))
-        && !d->demuxer->hasAttachedPic()) /* don't care video clock when audio has attached pic*/
-    {
-        AVDebug("Video seek is not finished.\n");
-        return;
-    }
     double seek_pos = 0;
     bool forward = true;
     if (type & SeekFromStart) {
@@ -226,6 +305,12 @@ void Player::seek(double t, SeekType type)
     CALL_BACK(d->seekRequest, seek_pos, t, type);
 }
 
+SeekStatistics Player::seekStatistics() const
+{
+    DPTR_D(const Player);
+    return d->demux_thread->seekStatistics();
+}
+
 void Player::seekForward(int incr)
 {
     this->seek(incr, SeekType(SeekFromNow | SeekKeyFrame));
@@ -236,6 +321,60 @@ void Player::seekBackward(int incr)
     this->seek(incr, SeekType(SeekFromNow | SeekKeyFrame));
 }
 
+void Player::stepForward()
+{
+    DPTR_D(Player);
+    if (d->media_status != Prepared)
+        return;
+    pause(true);
+    d->demux_thread->stepForward();
+}
+
+void Player::stepBackward()
+{
+    DPTR_D(Player);
+    if (d->media_status != Prepared)
+        return;
+    pause(true);
+    d->demux_thread->stepBackward();
+}
+
+void Player::setFrameCacheSize(int64_t bytes)
+{
+    DPTR_D(Player);
+    d->frame_cache_bytes = bytes;
+    if (d->video_thread) {
+        VideoThread *thread = dynamic_cast<VideoThread*>(d->video_thread);
+        thread->setFrameCacheBytes(bytes);
+    }
+}
+
+void Player::setDeinterlace(DeinterlaceMode mode, bool fieldRate)
+{
+    DPTR_D(Player);
+    d->deinterlace = mode;
+    d->field_rate = fieldRate && mode != Deinterlace_None && mode != Deinterlace_Blend;
+    for (AVOutput* output: d->video_output_set.outputs())
+        static_cast<VideoRenderer*>(output)->setDeinterlace(mode);
+    if (d->video_thread)
+        dynamic_cast<VideoThread*>(d->video_thread)->setFieldRate(d->field_rate);
+    for (size_t i = 0; i < d->video_views.size(); ++i) {
+        d->video_views[i].renderer->setDeinterlace(mode);
+        if (d->video_views[i].thread)
+            dynamic_cast<VideoThread*>(d->video_views[i].thread)->setFieldRate(d->field_rate);
+    }
+}
+
+void Player::setScaleFilter(ScaleFilter filter)
+{
+    DPTR_D(Player);
+    d->scale_filter = filter;
+    for (AVOutput* output: d->video_output_set.outputs())
+        static_cast<VideoRenderer*>(output)->setScaleFilter(filter);
+    for (size_t i = 0; i < d->video_views.size(); ++i)
+        d->video_views[i].renderer->setScaleFilter(filter);
+}
+
 void Player::setBufferPara(BufferMode mode, int64_t value)
 {
     DPTR_D(Player);
@@ -243,21 +382,405 @@ void Player::setBufferPara(BufferMode mode, int64_t value)
     d->buffer_value = value;
 }
 
+void Player::setBufferAdaptive(bool adaptive)
+{
+    DPTR_D(Player);
+    d->buffer_adaptive = adaptive;
+    if (d->video_thread)
+        d->video_thread->packets()->setAdaptive(adaptive);
+    if (d->audio_thread)
+        d->audio_thread->packets()->setAdaptive(adaptive);
+}
+
+BufferEstimate Player::bufferEstimate() const
+{
+    DPTR_D(const Player);
+    return d->demux_thread->bufferEstimate();
+}
+
+void Player::setAdaptiveBitrate(bool enable)
+{
+    DPTR_D(Player);
+    d->applyChainedMedia();
+    d->demuxer->setThroughputMeasure(enable);
+    d->demux_thread->setAdaptiveBitrate(enable);
+}
+
+void Player::selectVariant(int index)
+{
+    DPTR_D(Player);
+    if (!d->loaded)
+        return;
+    d->demux_thread->selectVariant(index);
+}
+
+double Player::throughput() const
+{
+    DPTR_D(const Player);
+    return d->demuxer->throughput();
+}
+
+void Player::setTimeShift(double seconds, const std::string &file, int64_t file_bytes)
+{
+    DPTR_D(Player);
+    d->demux_thread->setTimeShift(seconds, file, file_bytes);
+}
+
+bool Player::timeShiftRange(double &start, double &end) const
+{
+    DPTR_D(const Player);
+    return d->demux_thread->timeShiftRange(start, end);
+}
+
+void Player::setTimeShiftCatchUpSpeed(float speed)
+{
+    DPTR_D(Player);
+    d->demux_thread->setCatchUpSpeed(speed);
+}
+
+bool Player::startRecord(const std::string &file, const std::string &format)
+{
+    DPTR_D(Player);
+    if (!d->loaded)
+        return false;
+    return d->demux_thread->startRecord(file, format);
+}
+
+void Player::stopRecord()
+{
+    DPTR_D(Player);
+    d->demux_thread->stopRecord();
+}
+
+bool Player::isRecording() const
+{
+    DPTR_D(const Player);
+    return d->demux_thread->isRecording();
+}
+
+/* the packets read ahead by preload, about one second */
+#define PRELOAD_DURATION 1.0
+#define PRELOAD_BYTES_MAX (8 * 1024 * 1024)
+
+/**
+ * Open and probe the next media, open the decoders and read ahead the first
+ * packets, the first video frame is decoded to make sure the decoder works.
+ */
+class PreloadMediaAsync : public CThread {
+public:
+    PreloadMediaAsync(PlayerPrivate *pri, const std::string &u) :
+        CThread("preload"),
+        d(pri),
+        url(u),
+        demuxer(new Demuxer()),
+        video_dec(nullptr),
+        audio_dec(nullptr),
+        ready(false),
+        handed(false),
+        chain(pri->loaded)
+    {
+        /* in the player thread, the demuxer of the player is not used by run() */
+        demuxer->copySettings(*d->demuxer);
+    }
+    ~PreloadMediaAsync()
+    {
+        stop();
+        wait();
+        if (video_dec)
+            delete video_dec;
+        if (audio_dec)
+            delete audio_dec;
+    }
+
+    void stop() PU_DECL_OVERRIDE;
+    void run() PU_DECL_OVERRIDE;
+
+    PlayerPrivate* d;
+    std::string url;
+    Demuxer *demuxer;
+    VideoDecoder *video_dec;
+    AudioDecoder *audio_dec;
+    StreamPackets packets;
+    std::atomic<bool> ready;
+    /* the demuxer is given to the demux thread to be chained */
+    bool handed;
+    bool chain;
+};
+
+void PreloadMediaAsync::stop()
+{
+    demuxer->abort();
+}
+
+void PreloadMediaAsync::run()
+{
+    int ret;
+    demuxer->setMediaInfo(&d->preload_info);
+    demuxer->setMedia(url);
+    if (demuxer->load() != 0) {
+        AVWarning("Preload %s failed.\n", url.c_str());
+        CThread::run();
+        return;
+    }
+    AVStream *vst = demuxer->stream(MediaTypeVideo);
+    AVStream *ast = demuxer->stream(MediaTypeAudio);
+    for (size_t i = 0; vst && i < d->video_dec_ids.size(); ++i) {
+        VideoDecoder *dec = VideoDecoder::create(d->video_dec_ids.at(i));
+        if (!dec)
+            continue;
+        dec->initialize(demuxer->formatCtx(), vst);
+        if (dec->open()) {
+            video_dec = dec;
+            break;
+        }
+        delete dec;
+    }
+    if (ast) {
+        audio_dec = AudioDecoder::create();
+        if (audio_dec) {
+            audio_dec->initialize(demuxer->formatCtx(), ast);
+            if (!audio_dec->open()) {
+                delete audio_dec;
+                audio_dec = nullptr;
+            }
+        }
+    }
+    /* read ahead, and decode the first video frame */
+    bool decoded = !video_dec;
+    int64_t bytes = 0;
+    double first_pts = NAN;
+    while (bytes < PRELOAD_BYTES_MAX) {
+        ret = demuxer->readFrame();
+        if (ret == -1 || ret == 999)
+            continue;
+        if (ret < 0)
+            break;
+        const Packet pkt = demuxer->packet();
+        const int stream = demuxer->stream();
+        packets.push_back(std::make_pair(pkt, stream));
+        bytes += pkt.size;
+        if (isnan(first_pts))
+            first_pts = pkt.pts;
+        if (!decoded && stream == demuxer->streamIndex(MediaTypeVideo)) {
+            if (video_dec->decode(pkt) >= 0 && video_dec->frame().isValid())
+                decoded = true;
+        }
+        if (decoded && pkt.pts - first_pts >= PRELOAD_DURATION)
+            break;
+    }
+    /* the packets are decoded again when played */
+    if (video_dec)
+        video_dec->flush();
+    AVDebug("Preload %s: %d packets, %lld bytes\n", url.c_str(), FORCE_INT(packets.size()), (long long)bytes);
+    {
+        DECL_LOCKGUARD(d->preload_mutex);
+        d->preload_url = url;
+    }
+    ready = true;
+    if (chain) {
+        handed = true;
+        d->demux_thread->setNextDemuxer(demuxer, packets);
+    }
+    CThread::run();
+}
+
+void PlayerPrivate::cancelPreload()
+{
+    applyChainedMedia();
+    if (!preload)
+        return;
+    preload->stop();
+    preload->wait();
+    if (preload->handed) {
+        /* nullptr if it's chained already */
+        StreamPackets packets;
+        delete demux_thread->takeNextDemuxer(packets);
+    } else {
+        delete preload->demuxer;
+    }
+    delete preload;
+    preload = nullptr;
+    delete preload_video_dec;
+    preload_video_dec = nullptr;
+    delete preload_audio_dec;
+    preload_audio_dec = nullptr;
+}
+
+void PlayerPrivate::onMediaChained(Demuxer *last, Demuxer *next)
+{
+    /* called in the demux thread, the player thread still uses the last one */
+    {
+        DECL_LOCKGUARD(preload_mutex);
+        chained_demuxer = next;
+    }
+    AVDebug("Media is chained without gap.\n");
+    CALL_BACK(mediaStatusChanged, Loaded);
+    CALL_BACK(mediaStatusChanged, Prepared);
+}
+
+void PlayerPrivate::applyChainedMedia()
+{
+    /* the tracks switched by the demux thread in the current media */
+    if (demuxer)
+        demuxer->applyTrackChanges();
+    Demuxer *next;
+    {
+        DECL_LOCKGUARD(preload_mutex);
+        next = chained_demuxer;
+        chained_demuxer = nullptr;
+    }
+    if (!next)
+        return;
+    /* the decoders use the context and streams of the last one until stopped */
+    retired_demuxers.push_back(demuxer);
+    demuxer = next;
+    url = preload_url;
+    copyMediaInfo(mediainfo, preload_info);
+    demuxer->setMediaInfo(&mediainfo);
+}
+
+void PlayerPrivate::deleteRetiredDemuxers()
+{
+    for (std::list<Demuxer*>::iterator it = retired_demuxers.begin(); it != retired_demuxers.end(); ++it) {
+        (*it)->unload();
+        delete *it;
+    }
+    retired_demuxers.clear();
+}
+
+void PlayerPrivate::copyMediaInfo(MediaInfo &dst, const MediaInfo &src)
+{
+    /*
+     * the elements are assigned in place if the lists have the same size, so the
+     * stream info pointed by the renderers and threads stays valid when chained
+     */
+    std::list<AudioStreamInfo> audios;
+    std::list<VideoStreamInfo> videos;
+    std::list<SubtitleStreamInfo> subtitles;
+    const bool keep = dst.audios.size() == src.audios.size() &&
+            dst.videos.size() == src.videos.size() &&
+            dst.subtitles.size() == src.subtitles.size();
+    if (keep) {
+        audios.swap(dst.audios);
+        videos.swap(dst.videos);
+        subtitles.swap(dst.subtitles);
+        std::copy(src.audios.begin(), src.audios.end(), audios.begin());
+        std::copy(src.videos.begin(), src.videos.end(), videos.begin());
+        std::copy(src.subtitles.begin(), src.subtitles.end(), subtitles.begin());
+    }
+    dst = src;
+    if (keep) {
+        dst.audios.swap(audios);
+        dst.videos.swap(videos);
+        dst.subtitles.swap(subtitles);
+    }
+    /* the pointers are to the lists of src */
+    dst.audio = nullptr;
+    dst.video = nullptr;
+    dst.subtitle = nullptr;
+    if (src.audio_track >= 0 && src.audio_track < FORCE_INT(dst.audios.size()))
+        dst.audio = &(*std::next(dst.audios.begin(), src.audio_track));
+    if (src.video_track >= 0 && src.video_track < FORCE_INT(dst.videos.size()))
+        dst.video = &(*std::next(dst.videos.begin(), src.video_track));
+    if (src.subtitle_track >= 0 && src.subtitle_track < FORCE_INT(dst.subtitles.size()))
+        dst.subtitle = &(*std::next(dst.subtitles.begin(), src.subtitle_track));
+}
+
+bool Player::preload(const std::string &url)
+{
+    DPTR_D(Player);
+    d->cancelPreload();
+    if (url.empty())
+        return true;
+    if (!d->loaded) {
+        AVWarning("Preload is only available while playing.\n");
+        return false;
+    }
+    d->preload = new PreloadMediaAsync(d, url);
+    d->preload->start();
+    return true;
+}
+
+bool Player::isPreloaded() const
+{
+    DPTR_D(const Player);
+    return d->preload && d->preload->ready;
+}
+
+bool Player::playPreloaded()
+{
+    DPTR_D(Player);
+    if (!d->preload)
+        return false;
+    d->preload->wait();
+    PreloadMediaAsync *preload = d->preload;
+    Demuxer *next = preload->demuxer;
+    StreamPackets packets = preload->packets;
+    if (preload->handed) {
+        next = d->demux_thread->takeNextDemuxer(packets);
+        if (!next) {
+            /* it's playing already */
+            d->preload = nullptr;
+            delete preload;
+            d->applyChainedMedia();
+            return true;
+        }
+    }
+    if (!next->formatCtx()) {
+        delete next;
+        d->preload = nullptr;
+        delete preload;
+        return false;
+    }
+    stop();
+    d->deleteRetiredDemuxers();
+    /* the decoders are taken by the new threads */
+    d->preload_video_dec = preload->video_dec;
+    d->preload_audio_dec = preload->audio_dec;
+    preload->video_dec = nullptr;
+    preload->audio_dec = nullptr;
+    d->preload = nullptr;
+    delete preload;
+
+    delete d->demuxer;
+    d->demuxer = next;
+    d->url = d->preload_url;
+    PlayerPrivate::copyMediaInfo(d->mediainfo, d->preload_info);
+    d->demuxer->setMediaInfo(&d->mediainfo);
+    d->demux_thread->setDemuxer(d->demuxer);
+    d->demux_thread->setPrefetchedPackets(packets);
+
+    d->loaded = true;
+    d->media_status = Loaded;
+    CALL_BACK(d->mediaStatusChanged, Loaded);
+    d->loadExternalAudio();
+    d->initRenderVideo();
+    d->clock.setMaxDuration(d->demuxer->maxDuration());
+    d->applySubtitleStream();
+    d->playInternal();
+    d->media_status = Prepared;
+    CALL_BACK(d->mediaStatusChanged, Prepared);
+    return true;
+}
+
 MediaInfo* Player::info()
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
     return &d->mediainfo;
 }
 
 double Player::position()
 {
     DPTR_D(Player);
-    return d->clock.value();
+    const double pts = d->clock.value();
+    return pts - d->demux_thread->timeOffset(pts);
 }
 
 int64_t Player::duration()
 {
     DPTR_D(Player);
+    d->applyChainedMedia();
     return d->demuxer->duration();
 }
 
@@ -280,6 +803,18 @@ void Player::renderVideo()
 		VideoRenderer* render = static_cast<VideoRenderer*>(output);
         render->renderVideo();
     }
+    for (size_t i = 0; i < d->video_views.size(); ++i)
+        d->video_views[i].renderer->renderVideo();
+}
+
+void Player::setShaderCacheDirectory(const std::string &dir)
+{
+    ShaderCache::setDirectory(dir);
+}
+
+void Player::prewarmShaders()
+{
+    ShaderManager::prewarm();
 }
 
 void Player::setRenderCallback(std::function<void (void *)> cb)
@@ -305,6 +840,8 @@ VideoRenderer* Player::setVideoRenderer(int w, int h, void* opaque)
     renderer->setOpaque(opaque);
     renderer->setMediaInfo(&d->mediainfo); // for test
     renderer->resizeWindow(w, h);
+    renderer->setDeinterlace(d->deinterlace);
+    renderer->setScaleFilter(d->scale_filter);
     d->video_output_set.addOutput((AVOutput*)renderer);
     d->renderToFilters.insert(std::make_pair(renderer, std::list<Filter*>()));
     return renderer;
@@ -314,10 +851,43 @@ void Player::addVideoRenderer(VideoRenderer *renderer)
 {
     DPTR_D(Player);
     renderer->setMediaInfo(&d->mediainfo);
+    renderer->setDeinterlace(d->deinterlace);
+    renderer->setScaleFilter(d->scale_filter);
     d->video_output_set.addOutput((AVOutput*)renderer);
     d->renderToFilters.insert(std::make_pair(renderer, std::list<Filter*>()));
 }
 
+bool Player::addVideoView(int track, VideoRenderer *renderer)
+{
+    DPTR_D(Player);
+    if (!renderer || track < 0)
+        return false;
+    PlayerPrivate::VideoView view;
+    view.track = track;
+    view.renderer = renderer;
+    view.output = new OutputSet();
+    view.output->addOutput((AVOutput*)renderer);
+    view.decoder = nullptr;
+    view.thread = nullptr;
+    renderer->setMediaInfo(&d->mediainfo);
+    renderer->setDeinterlace(d->deinterlace);
+    renderer->setScaleFilter(d->scale_filter);
+    d->video_views.push_back(view);
+    return true;
+}
+
+void Player::clearVideoViews()
+{
+    DPTR_D(Player);
+    if (d->loaded) {
+        AVWarning("The views can not be cleared when the media is loaded.\n");
+        return;
+    }
+    for (size_t i = 0; i < d->video_views.size(); ++i)
+        delete d->video_views[i].output;
+    d->video_views.clear();
+}
+
 void Player::removeRenderer(VideoRenderer * renderer)
 {
     //TODO
@@ -0,0 +1,351 @@
+#include "Recorder.h"
+#include "AVLog.h"
+#include "inner.h"
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavformat/avformat.h"
+#ifdef __cplusplus
+}
+#endif
+
+NAMESPACE_BEGIN
+
+/* 32MB, about 10 seconds of a 25Mbps stream */
+#define RECORD_QUEUE_BYTES_DEFAULT (32 * 1024 * 1024)
+
+typedef struct RecordItem {
+    Packet packet;
+    int stream;
+    bool rebase;    /* the first packet after discontinuity */
+    bool end;
+} RecordItem;
+
+class RecorderPrivate
+{
+public:
+    RecorderPrivate():
+        output(nullptr),
+        key_stream(-1),
+        max_bytes(RECORD_QUEUE_BYTES_DEFAULT),
+        queued_bytes(0),
+        wait_key(true),
+        rebase(true),
+        stop_req(false),
+        ending(false),
+        finished(false),
+        header_written(false),
+        failed(false),
+        offset(0),
+        last_end(0),
+        written(0),
+        dropped(0)
+    {
+
+    }
+    ~RecorderPrivate()
+    {
+        close();
+    }
+
+    void close()
+    {
+        if (!output)
+            return;
+        if (header_written)
+            av_write_trailer(output);
+        if (!(output->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&output->pb);
+        avformat_free_context(output);
+        output = nullptr;
+        header_written = false;
+    }
+
+    void write(const RecordItem &item);
+
+    std::string file;
+    AVFormatContext *output;
+    /* the time base of input streams, and the output stream of each input stream, -1 if not recorded */
+    std::vector<AVRational> time_bases;
+    std::vector<int> stream_map;
+    std::vector<int64_t> last_dts;
+    int key_stream;
+
+    std::deque<RecordItem> queue;
+    int64_t max_bytes;
+    int64_t queued_bytes;
+    std::atomic<bool> wait_key;
+    bool rebase;
+    std::atomic<bool> stop_req;
+    std::atomic<bool> ending;
+    std::atomic<bool> finished;
+    /* accessed by the recorder thread only */
+    bool header_written;
+    bool failed;
+    /* in AV_TIME_BASE, subtracted from the input timestamps */
+    int64_t offset;
+    int64_t last_end;
+
+    std::atomic<int64_t> written;
+    std::atomic<int64_t> dropped;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+void RecorderPrivate::write(const RecordItem &item)
+{
+    const int index = item.stream < FORCE_INT(stream_map.size()) ? stream_map[item.stream] : -1;
+    if (failed || index < 0)
+        return;
+    if (!header_written) {
+        int ret = avformat_write_header(output, nullptr);
+        if (ret < 0) {
+            AVError("Recorder: write header of %s failed: %s\n", file.c_str(), averror2str(ret));
+            failed = true;
+            return;
+        }
+        header_written = true;
+    }
+    const AVRational in_tb = time_bases[item.stream];
+    AVStream *st = output->streams[index];
+    const AVPacket *src = item.packet.asAVPacket();
+    const int64_t ts = src->dts != AV_NOPTS_VALUE ? src->dts : src->pts;
+    if (ts == AV_NOPTS_VALUE)
+        return;
+    /* continue from the last packet written */
+    if (item.rebase)
+        offset = av_rescale_q(ts, in_tb, AV_TIME_BASE_Q) - last_end;
+
+    AVPacket *pkt = av_packet_alloc();
+    /* the data is referenced, not copied */
+    if (!pkt || av_packet_ref(pkt, src) < 0) {
+        av_packet_free(&pkt);
+        return;
+    }
+    const int64_t shift = av_rescale_q(offset, AV_TIME_BASE_Q, st->time_base);
+    pkt->stream_index = index;
+    pkt->pts = pkt->pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : av_rescale_q(pkt->pts, in_tb, st->time_base) - shift;
+    pkt->dts = pkt->dts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : av_rescale_q(pkt->dts, in_tb, st->time_base) - shift;
+    pkt->duration = av_rescale_q(pkt->duration, in_tb, st->time_base);
+    pkt->pos = -1;
+    /* the muxer requires increasing dts */
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        if (last_dts[index] != AV_NOPTS_VALUE && pkt->dts <= last_dts[index]) {
+            pkt->dts = last_dts[index] + 1;
+            if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts)
+                pkt->pts = pkt->dts;
+        }
+        last_dts[index] = pkt->dts;
+        last_end = std::max(last_end, av_rescale_q(pkt->dts + pkt->duration, st->time_base, AV_TIME_BASE_Q));
+    }
+    const int size = pkt->size;
+    int ret = av_interleaved_write_frame(output, pkt);
+    av_packet_free(&pkt);
+    if (ret < 0) {
+        AVWarning("Recorder: write packet failed: %s\n", averror2str(ret));
+        return;
+    }
+    written += size;
+}
+
+Recorder::Recorder():
+    CThread("recorder"),
+    d_ptr(new RecorderPrivate)
+{
+
+}
+
+Recorder::~Recorder()
+{
+    finish();
+    wait();
+}
+
+bool Recorder::open(const std::string &file, const std::string &format, AVFormatContext *input,
+                    const std::vector<int> &streams, int key_stream)
+{
+    DPTR_D(Recorder);
+    int ret;
+
+    d->close();
+    d->file = file;
+    ret = avformat_alloc_output_context2(&d->output, nullptr, format.empty() ? nullptr : format.c_str(), file.c_str());
+    if (ret < 0 || !d->output) {
+        AVError("Recorder: can not create the output of %s: %s\n", file.c_str(), averror2str(ret));
+        return false;
+    }
+    d->time_bases.assign(input->nb_streams, AVRational{0, 1});
+    d->stream_map.assign(input->nb_streams, -1);
+    for (size_t i = 0; i < streams.size(); ++i) {
+        const int index = streams[i];
+        if (index < 0 || index >= FORCE_INT(input->nb_streams))
+            continue;
+        AVStream *in = input->streams[index];
+        if (avformat_query_codec(d->output->oformat, in->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+            AVWarning("Recorder: %s is not supported by %s, skipped.\n",
+                      avcodec_get_name(in->codecpar->codec_id), d->output->oformat->name);
+            continue;
+        }
+        AVStream *out = avformat_new_stream(d->output, nullptr);
+        if (!out || avcodec_parameters_copy(out->codecpar, in->codecpar) < 0)
+            continue;
+        /* the tag of the input container may be invalid for the output */
+        out->codecpar->codec_tag = 0;
+        out->time_base = in->time_base;
+        out->disposition = in->disposition;
+        av_dict_copy(&out->metadata, in->metadata, 0);
+        d->time_bases[index] = in->time_base;
+        d->stream_map[index] = out->index;
+    }
+    if (d->output->nb_streams == 0) {
+        AVError("Recorder: no stream to record.\n");
+        d->close();
+        return false;
+    }
+    d->last_dts.assign(d->output->nb_streams, AV_NOPTS_VALUE);
+    d->key_stream = key_stream >= 0 && key_stream < FORCE_INT(input->nb_streams) && d->stream_map[key_stream] >= 0 ? key_stream : -1;
+    if (!(d->output->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&d->output->pb, file.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            AVError("Recorder: can not open %s: %s\n", file.c_str(), averror2str(ret));
+            d->close();
+            return false;
+        }
+    }
+    d->wait_key = d->rebase = true;
+    d->stop_req = d->ending = d->finished = false;
+    d->offset = d->last_end = 0;
+    d->written = d->dropped = 0;
+    AVDebug("Recorder: record %d streams to %s\n", d->output->nb_streams, file.c_str());
+    return true;
+}
+
+void Recorder::setMaxBytes(int64_t bytes)
+{
+    DPTR_D(Recorder);
+    DECL_LOCKGUARD(d->mutex);
+    d->max_bytes = bytes;
+}
+
+void Recorder::push(const Packet &pkt, int stream)
+{
+    DPTR_D(Recorder);
+    if (d->ending || stream < 0 || stream >= FORCE_INT(d->stream_map.size()) || d->stream_map[stream] < 0)
+        return;
+    const bool key = pkt.containKeyFrame && (d->key_stream < 0 || stream == d->key_stream);
+    if (d->stop_req && key && !d->wait_key) {
+        finish();
+        return;
+    }
+    if (d->wait_key) {
+        /* the packets of all streams are dropped before the key frame */
+        if (!key)
+            return;
+        d->wait_key = false;
+    }
+    {
+        DECL_LOCKGUARD(d->mutex);
+        /* never block the playback, drop and resume at the next key frame */
+        if (d->queued_bytes + pkt.size > d->max_bytes) {
+            d->dropped++;
+            d->wait_key = true;
+            return;
+        }
+        RecordItem item;
+        item.packet = pkt;
+        item.stream = stream;
+        item.rebase = d->rebase;
+        item.end = false;
+        d->queue.push_back(item);
+        d->queued_bytes += pkt.size;
+        d->rebase = false;
+    }
+    d->cond.notify_one();
+}
+
+void Recorder::discontinuity()
+{
+    DPTR_D(Recorder);
+    DECL_LOCKGUARD(d->mutex);
+    d->wait_key = true;
+    d->rebase = true;
+}
+
+void Recorder::requestStop()
+{
+    DPTR_D(Recorder);
+    d->stop_req = true;
+    if (d->wait_key || d->key_stream < 0)
+        finish();
+}
+
+void Recorder::finish()
+{
+    DPTR_D(Recorder);
+    {
+        DECL_LOCKGUARD(d->mutex);
+        if (d->ending)
+            return;
+        d->ending = true;
+        RecordItem item;
+        item.packet.size = 0;
+        item.stream = -1;
+        item.rebase = false;
+        item.end = true;
+        d->queue.push_back(item);
+    }
+    d->cond.notify_one();
+}
+
+bool Recorder::isFinished() const
+{
+    DPTR_D(const Recorder);
+    return d->ending || d->finished;
+}
+
+const std::string &Recorder::file() const
+{
+    return d_func()->file;
+}
+
+int64_t Recorder::writtenBytes() const
+{
+    DPTR_D(const Recorder);
+    return d->written;
+}
+
+int64_t Recorder::droppedPackets() const
+{
+    DPTR_D(const Recorder);
+    return d->dropped;
+}
+
+void Recorder::run()
+{
+    DPTR_D(Recorder);
+    while (true) {
+        RecordItem item;
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            d->cond.wait(lock, [d] { return !d->queue.empty(); });
+            item = d->queue.front();
+            d->queue.pop_front();
+            d->queued_bytes -= item.packet.size;
+        }
+        if (item.end)
+            break;
+        d->write(item);
+    }
+    d->close();
+    d->finished = true;
+    AVDebug("Recorder: %s finished, %lld bytes written, %lld packets dropped\n",
+            d->file.c_str(), (long long)d->written.load(), (long long)d->dropped.load());
+    CThread::run();
+}
+
+NAMESPACE_END
@@ -0,0 +1,70 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "CThread.h"
+#include "Packet.h"
+#include <vector>
+
+typedef struct AVFormatContext AVFormatContext;
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The Recorder class
+ * Remux the packets of the playing media to a file without transcoding.
+ * Packets are pushed by the demux thread and written in the recorder thread,
+ * they share the data with the ones sent to the decoders. The recording
+ * starts and stops at the key frames of the key stream.
+ */
+class RecorderPrivate;
+class Recorder: public CThread
+{
+    DPTR_DECLARE_PRIVATE(Recorder)
+public:
+    Recorder();
+    ~Recorder() PU_DECL_OVERRIDE;
+
+    /**
+     * @brief create the output and its streams, the container is guessed
+     * from the file name if format is empty. Streams not supported by the
+     * container are skipped
+     * @param key_stream -1 if the recording can start at any packet
+     */
+    bool open(const std::string &file, const std::string &format, AVFormatContext *input,
+              const std::vector<int> &streams, int key_stream);
+    /**
+     * @brief the bytes of the packets waiting to be written
+     */
+    void setMaxBytes(int64_t bytes);
+    /**
+     * @brief never blocks. If the queue is full, the packet is dropped and
+     * the recording is resumed at the next key frame
+     */
+    void push(const Packet &pkt, int stream);
+    /**
+     * @brief the timestamps jump, e.g. after seek. The next key frame follows
+     * the last packet written
+     */
+    void discontinuity();
+    /**
+     * @brief stop at the next key frame, or at once if not started yet
+     */
+    void requestStop();
+    /**
+     * @brief stop after the queued packets are written
+     */
+    void finish();
+    bool isFinished() const;
+    const std::string &file() const;
+    int64_t writtenBytes() const;
+    int64_t droppedPackets() const;
+
+protected:
+    void run() PU_DECL_OVERRIDE;
+
+private:
+    DPTR_DECLARE(Recorder)
+};
+
+NAMESPACE_END
+#endif //RECORDER_H
@@ -0,0 +1,387 @@
+#include "sdk/thumbnailer.h"
+#include "demuxer/Demuxer.h"
+#include "decoder/video/VideoDecoder.h"
+#include "utils/ThreadPool.h"
+#include "utils/innermath.h"
+#include "AVLog.h"
+#include "inner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+#ifdef __cplusplus
+}
+#endif
+
+NAMESPACE_BEGIN
+
+#define THUMBNAIL_WIDTH_DEFAULT 160
+
+class ThumbnailerPrivate
+{
+public:
+    ThumbnailerPrivate():
+        width(THUMBNAIL_WIDTH_DEFAULT),
+        height(0),
+        out_width(0),
+        out_height(0),
+        interval(0),
+        threads(0),
+        accurate(false),
+        loaded(false),
+        start(0),
+        extracted(0),
+        abort_req(false)
+    {
+
+    }
+    ~ThumbnailerPrivate()
+    {
+
+    }
+
+    bool resolveSize(AVFormatContext *ctx, AVStream *st);
+    int extract(uint8_t *buffer, int stride, int columns);
+    void extractSegment(int begin, int end, uint8_t *buffer, int stride, int columns, bool single_thread);
+
+    uint8_t *address(uint8_t *buffer, int stride, int columns, int index) const
+    {
+        if (columns > 0)
+            return buffer + FORCE_INT64(index / columns) * out_height * stride + FORCE_INT64(index % columns) * out_width * 4;
+        return buffer + FORCE_INT64(index) * out_height * stride;
+    }
+
+    std::string url;
+    int width, height;
+    int out_width, out_height;
+    double interval;
+    int threads;
+    bool accurate;
+    bool loaded;
+    /* the start time of the media, timestamps are relative to it */
+    double start;
+    std::vector<double> requested;
+    std::vector<double> targets;
+    std::vector<double> results;
+    std::atomic<int> extracted;
+    std::atomic<bool> abort_req;
+    std::function<void(int, double)> thumbnail_cb;
+    /* the demuxers of the workers, to abort the blocking read */
+    std::vector<Demuxer*> demuxers;
+    std::mutex mutex;
+};
+
+bool ThumbnailerPrivate::resolveSize(AVFormatContext *ctx, AVStream *st)
+{
+    const int w = st->codecpar->width;
+    const int h = st->codecpar->height;
+    if (w <= 0 || h <= 0)
+        return false;
+    AVRational sar = av_guess_sample_aspect_ratio(ctx, st, nullptr);
+    double dar = FORCE_DOUBLE(w) / h;
+    if (sar.num > 0 && sar.den > 0)
+        dar *= av_q2d(sar);
+    out_width = width;
+    out_height = height;
+    if (out_width <= 0 && out_height <= 0)
+        out_width = THUMBNAIL_WIDTH_DEFAULT;
+    if (out_height <= 0)
+        out_height = FORCE_INT(std::lround(out_width / dar));
+    else if (out_width <= 0)
+        out_width = FORCE_INT(std::lround(out_height * dar));
+    out_width = std::max(out_width, 1);
+    out_height = std::max(out_height, 1);
+    return true;
+}
+
+int ThumbnailerPrivate::extract(uint8_t *buffer, int stride, int columns)
+{
+    if (!loaded || !buffer)
+        return -1;
+    const int count = FORCE_INT(targets.size());
+    results.assign(targets.size(), NAN);
+    if (count == 0)
+        return 0;
+    abort_req = false;
+    extracted = 0;
+
+    ThreadPool pool(threads > 0 ? std::min(threads, count) : 0);
+    /* each segment is a range of the sorted timestamps, so a worker only seeks forward */
+    const int segments = std::min(count, pool.threadCount());
+    for (int i = 0; i < segments; ++i) {
+        const int begin = FORCE_INT(FORCE_INT64(count) * i / segments);
+        const int end = FORCE_INT(FORCE_INT64(count) * (i + 1) / segments);
+        pool.post([=] {
+            extractSegment(begin, end, buffer, stride, columns, segments > 1);
+        });
+    }
+    pool.waitForDone();
+    AVDebug("Thumbnailer: %d of %d thumbnails extracted by %d threads\n", extracted.load(), count, segments);
+    return extracted;
+}
+
+void ThumbnailerPrivate::extractSegment(int begin, int end, uint8_t *buffer, int stride, int columns, bool single_thread)
+{
+    Demuxer demuxer;
+    demuxer.setMedia(url);
+    demuxer.setMediaStreamDisable(MediaTypeAudio);
+    demuxer.setMediaStreamDisable(MediaTypeSubtitle);
+    /* the nearest key frame before the target */
+    demuxer.setSeekType(SeekFromStart);
+    {
+        DECL_LOCKGUARD(mutex);
+        if (abort_req)
+            return;
+        demuxers.push_back(&demuxer);
+    }
+    std::unique_ptr<VideoDecoder> decoder;
+    SwsContext *sws = nullptr;
+    const int stream = demuxer.load() == 0 ? demuxer.streamIndex(MediaTypeVideo) : -1;
+    if (stream >= 0 && demuxer.stream(MediaTypeVideo))
+        decoder.reset(VideoDecoder::create(VideoDecoderId_FFmpeg));
+    if (decoder) {
+        std::map<std::string, std::string> options;
+        /* the segments run in parallel already */
+        if (single_thread)
+            options.insert(std::make_pair("threads", "1"));
+        if (!accurate)
+            options.insert(std::make_pair("skip_frame", "nokey"));
+        decoder->setCodeOptions(options);
+        decoder->initialize(demuxer.formatCtx(), demuxer.stream(MediaTypeVideo));
+        if (!decoder->open()) {
+            AVWarning("Thumbnailer: can not open the video decoder.\n");
+            decoder.reset();
+        }
+    }
+
+    for (int i = begin; decoder && i < end && !abort_req; ++i) {
+        const double target = start + targets[i];
+        if (!demuxer.seek(target, 0))
+            AVWarning("Thumbnailer: seek to %.3f failed, decode from the current position.\n", target);
+        decoder->flush();
+
+        VideoFrame frame;
+        while (!abort_req) {
+            int ret = demuxer.readFrame();
+            Packet pkt;
+            if (ret == AVERROR_EOF) {
+                pkt = Packet::createEOF();
+            }
+            else if (ret == -1 || ret == 999 || ret == AVERROR(EAGAIN)) {
+                /* packet of other streams */
+                continue;
+            }
+            else if (ret < 0) {
+                break;
+            }
+            else if (demuxer.stream() != stream) {
+                continue;
+            }
+            else {
+                pkt = demuxer.packet();
+            }
+            ret = decoder->decode(pkt);
+            if (ret >= 0) {
+                VideoFrame f = decoder->frame();
+                if (f.isValid()) {
+                    frame = f;
+                    /* the first one is the key frame if not accurate */
+                    if (!accurate || isnan(f.timestamp()) || f.timestamp() + f.duration() / 2 >= target)
+                        break;
+                }
+            }
+            /* decoder is drained, use the last frame */
+            if (pkt.isEOF())
+                break;
+        }
+        if (!frame.isValid() || abort_req)
+            continue;
+
+        sws = sws_getCachedContext(sws, frame.width(), frame.height(), static_cast<AVPixelFormat>(frame.pixelFormatFFmpeg()),
+            out_width, out_height, AV_PIX_FMT_RGBA, SWS_AREA, nullptr, nullptr, nullptr);
+        if (!sws) {
+            AVWarning("Thumbnailer: can not create the scale context.\n");
+            break;
+        }
+        uint8_t *dst[] = { address(buffer, stride, columns, i), nullptr, nullptr, nullptr };
+        int dst_stride[] = { stride, 0, 0, 0 };
+        sws_scale(sws, frame.datas(), frame.lineSize(), 0, frame.height(), dst, dst_stride);
+        results[i] = frame.timestamp() - start;
+        extracted++;
+        CALL_BACK(thumbnail_cb, i, results[i]);
+    }
+
+    sws_freeContext(sws);
+    if (decoder)
+        decoder->close();
+    {
+        DECL_LOCKGUARD(mutex);
+        demuxers.erase(std::remove(demuxers.begin(), demuxers.end(), &demuxer), demuxers.end());
+    }
+    demuxer.unload();
+}
+
+Thumbnailer::Thumbnailer():
+    d_ptr(new ThumbnailerPrivate)
+{
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    abort();
+}
+
+void Thumbnailer::setMedia(const std::string& url)
+{
+    DPTR_D(Thumbnailer);
+    d->url = url;
+    d->loaded = false;
+}
+
+void Thumbnailer::setSize(int width, int height)
+{
+    DPTR_D(Thumbnailer);
+    d->width = width;
+    d->height = height;
+    d->loaded = false;
+}
+
+void Thumbnailer::setTimestamps(const std::vector<double> &timestamps)
+{
+    DPTR_D(Thumbnailer);
+    d->requested = timestamps;
+    d->loaded = false;
+}
+
+void Thumbnailer::setInterval(double seconds)
+{
+    DPTR_D(Thumbnailer);
+    d->interval = seconds;
+    d->loaded = false;
+}
+
+void Thumbnailer::setThreads(int threads)
+{
+    DPTR_D(Thumbnailer);
+    d->threads = threads;
+}
+
+void Thumbnailer::setAccurate(bool accurate)
+{
+    DPTR_D(Thumbnailer);
+    d->accurate = accurate;
+}
+
+void Thumbnailer::setThumbnailCallback(std::function<void(int index, double pts)> f)
+{
+    DPTR_D(Thumbnailer);
+    d->thumbnail_cb = f;
+}
+
+int Thumbnailer::load()
+{
+    DPTR_D(Thumbnailer);
+    Demuxer demuxer;
+    int ret;
+
+    d->loaded = false;
+    d->targets.clear();
+    d->results.clear();
+    demuxer.setMedia(d->url);
+    demuxer.setMediaStreamDisable(MediaTypeAudio);
+    demuxer.setMediaStreamDisable(MediaTypeSubtitle);
+    ret = demuxer.load();
+    if (ret < 0)
+        return ret;
+    AVStream *st = demuxer.stream(MediaTypeVideo);
+    if (!st || !d->resolveSize(demuxer.formatCtx(), st)) {
+        AVWarning("Thumbnailer: no video stream in %s.\n", d->url.c_str());
+        return -1;
+    }
+    d->start = demuxer.startTimeS();
+
+    AVFormatContext *ctx = demuxer.formatCtx();
+    const double duration = ctx->duration == AV_NOPTS_VALUE ? 0 : FORCE_DOUBLE(ctx->duration) / AV_TIME_BASE;
+    d->targets = d->requested;
+    if (d->targets.empty() && d->interval > 0) {
+        for (double t = 0; t < duration; t += d->interval)
+            d->targets.push_back(t);
+    }
+    std::sort(d->targets.begin(), d->targets.end());
+    d->loaded = true;
+    return 0;
+}
+
+int Thumbnailer::count() const
+{
+    DPTR_D(const Thumbnailer);
+    return FORCE_INT(d->targets.size());
+}
+
+int Thumbnailer::width() const
+{
+    DPTR_D(const Thumbnailer);
+    return d->out_width;
+}
+
+int Thumbnailer::height() const
+{
+    DPTR_D(const Thumbnailer);
+    return d->out_height;
+}
+
+std::vector<double> Thumbnailer::timestamps() const
+{
+    DPTR_D(const Thumbnailer);
+    return d->results.empty() ? d->targets : d->results;
+}
+
+int Thumbnailer::extract(uint8_t *buffer, int stride)
+{
+    DPTR_D(Thumbnailer);
+    if (stride <= 0)
+        stride = d->out_width * 4;
+    return d->extract(buffer, stride, 0);
+}
+
+int Thumbnailer::extractSprite(uint8_t *buffer, int columns)
+{
+    DPTR_D(Thumbnailer);
+    if (columns <= 0)
+        return -1;
+    return d->extract(buffer, spriteWidth(columns) * 4, columns);
+}
+
+int Thumbnailer::spriteWidth(int columns) const
+{
+    DPTR_D(const Thumbnailer);
+    if (columns <= 0)
+        return 0;
+    return std::min(columns, count()) * d->out_width;
+}
+
+int Thumbnailer::spriteHeight(int columns) const
+{
+    DPTR_D(const Thumbnailer);
+    if (columns <= 0)
+        return 0;
+    return (count() + columns - 1) / columns * d->out_height;
+}
+
+void Thumbnailer::abort()
+{
+    DPTR_D(Thumbnailer);
+    DECL_LOCKGUARD(d->mutex);
+    d->abort_req = true;
+    for (size_t i = 0; i < d->demuxers.size(); ++i)
+        d->demuxers[i]->abort();
+}
+
+NAMESPACE_END
@@ -0,0 +1,383 @@
+#include "TimeShiftBuffer.h"
+#include "AVLog.h"
+#include "utils/innermath.h"
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavcodec/avcodec.h"
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef _WIN32
+#define FSEEK64 _fseeki64
+#else
+#define FSEEK64 fseeko
+#endif
+
+NAMESPACE_BEGIN
+
+/* 30 minutes */
+static const double kWindowDefault = 30 * 60;
+/* 64MB, the recent packets are read from memory when following the live closely */
+static const int64_t kMemoryBytesDefault = 64 * 1024 * 1024;
+
+typedef struct TimeShiftRecord {
+    Packet packet;      /* empty if the data is in the file */
+    int stream;
+    double pts, dts, duration;
+    int64_t pos;
+    int size;
+    bool key;
+    /* the fields of AVPacket to rebuild the packet from file */
+    int64_t av_pts, av_dts, av_duration;
+    int flags;
+    int64_t offset;     /* -1 if the data is in memory */
+} TimeShiftRecord;
+
+class TimeShiftBufferPrivate
+{
+public:
+    TimeShiftBufferPrivate():
+        window(kWindowDefault),
+        max_memory(kMemoryBytesDefault),
+        memory_bytes(0),
+        fp(nullptr),
+        max_file(0),
+        file_bytes(0),
+        write_pos(0),
+        key_stream(-1),
+        first(0),
+        spilled(0),
+        cursor(0)
+    {
+
+    }
+    ~TimeShiftBufferPrivate()
+    {
+        if (fp)
+            fclose(fp);
+    }
+
+    int64_t end() const
+    {
+        return first + FORCE_INT64(records.size());
+    }
+
+    void popFront()
+    {
+        const TimeShiftRecord &r = records.front();
+        if (r.offset >= 0)
+            file_bytes -= r.size;
+        else
+            memory_bytes -= r.size;
+        records.pop_front();
+        first++;
+        spilled = std::max(spilled, first);
+        while (!keys.empty() && keys.front().first < first)
+            keys.pop_front();
+    }
+
+    /* the cursor is overtaken by the eviction, continue from the next key frame */
+    void fixCursor()
+    {
+        if (cursor >= first)
+            return;
+        cursor = end();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i].first >= first) {
+                cursor = keys[i].first;
+                break;
+            }
+        }
+        AVWarning("TimeShift: the window is full, skip to %lld.\n", (long long)cursor);
+    }
+
+    bool spill(TimeShiftRecord &r);
+    void closeFile();
+    bool load(const TimeShiftRecord &r, Packet &pkt);
+
+    double window;
+    int64_t max_memory;
+    int64_t memory_bytes;
+    FILE *fp;
+    std::string path;
+    int64_t max_file;
+    int64_t file_bytes;
+    int64_t write_pos;
+    int key_stream;
+    std::deque<TimeShiftRecord> records;
+    /* the sequence number of records.front(), the records before spilled are in the file */
+    int64_t first, spilled;
+    int64_t cursor;
+    /* sequence number and timestamp of the key frames */
+    std::deque<std::pair<int64_t, double> > keys;
+    mutable std::mutex mutex;
+};
+
+bool TimeShiftBufferPrivate::spill(TimeShiftRecord &r)
+{
+    if (r.size > max_file)
+        return false;
+    if (write_pos + r.size > max_file)
+        write_pos = 0;
+    /* the file is a ring, the oldest records are overwritten */
+    while (!records.empty() && records.front().offset >= 0 &&
+           records.front().offset < write_pos + r.size &&
+           records.front().offset + records.front().size > write_pos) {
+        popFront();
+    }
+    const AVPacket *avpkt = r.packet.asAVPacket();
+    if (FSEEK64(fp, write_pos, SEEK_SET) != 0 ||
+            fwrite(avpkt->data, 1, r.size, fp) != FORCE_UINT64(r.size)) {
+        AVWarning("TimeShift: write to %s failed, only memory is used.\n", path.c_str());
+        return false;
+    }
+    r.offset = write_pos;
+    r.packet = Packet();
+    write_pos += r.size;
+    memory_bytes -= r.size;
+    file_bytes += r.size;
+    return true;
+}
+
+void TimeShiftBufferPrivate::closeFile()
+{
+    /* the packets in the file are lost */
+    while (!records.empty() && records.front().offset >= 0)
+        popFront();
+    fixCursor();
+    if (fp) {
+        fclose(fp);
+        fp = nullptr;
+    }
+    path.clear();
+    write_pos = file_bytes = 0;
+}
+
+bool TimeShiftBufferPrivate::load(const TimeShiftRecord &r, Packet &pkt)
+{
+    if (r.offset < 0) {
+        pkt = r.packet;
+        return true;
+    }
+    pkt = Packet();
+    AVPacket *avpkt = pkt.avPacket();
+    if (av_new_packet(avpkt, r.size) < 0)
+        return false;
+    if (FSEEK64(fp, r.offset, SEEK_SET) != 0 ||
+            fread(avpkt->data, 1, r.size, fp) != FORCE_UINT64(r.size)) {
+        AVWarning("TimeShift: read from %s failed.\n", path.c_str());
+        return false;
+    }
+    avpkt->pts = r.av_pts;
+    avpkt->dts = r.av_dts;
+    avpkt->duration = r.av_duration;
+    avpkt->flags = r.flags;
+    avpkt->stream_index = r.stream;
+    pkt.pts = r.pts;
+    pkt.dts = r.dts;
+    pkt.duration = r.duration;
+    pkt.pos = r.pos;
+    pkt.size = r.size;
+    pkt.containKeyFrame = r.key;
+    pkt.isCorrupted = !!(r.flags & AV_PKT_FLAG_CORRUPT);
+    return true;
+}
+
+TimeShiftBuffer::TimeShiftBuffer():
+    d_ptr(new TimeShiftBufferPrivate)
+{
+
+}
+
+TimeShiftBuffer::~TimeShiftBuffer()
+{
+
+}
+
+void TimeShiftBuffer::setWindow(double seconds)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    d->window = std::max(seconds, 1.0);
+}
+
+double TimeShiftBuffer::window() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    return d->window;
+}
+
+void TimeShiftBuffer::setMemoryBytes(int64_t bytes)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    d->max_memory = std::max<int64_t>(bytes, 0);
+}
+
+bool TimeShiftBuffer::setFile(const std::string &path, int64_t max_bytes)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    d->closeFile();
+    if (path.empty() || max_bytes <= 0)
+        return true;
+    d->fp = fopen(path.c_str(), "w+b");
+    if (!d->fp) {
+        AVWarning("TimeShift: can not open %s.\n", path.c_str());
+        return false;
+    }
+    d->path = path;
+    d->max_file = max_bytes;
+    return true;
+}
+
+void TimeShiftBuffer::setKeyStream(int stream)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    d->key_stream = stream;
+}
+
+void TimeShiftBuffer::clear()
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    d->records.clear();
+    d->keys.clear();
+    d->first = d->spilled = d->cursor = 0;
+    d->memory_bytes = d->file_bytes = d->write_pos = 0;
+}
+
+void TimeShiftBuffer::append(const Packet &pkt, int stream)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    const AVPacket *avpkt = pkt.asAVPacket();
+    if (!avpkt || avpkt->size <= 0)
+        return;
+    TimeShiftRecord r;
+    r.packet = pkt;
+    r.stream = stream;
+    r.pts = pkt.pts;
+    r.dts = pkt.dts;
+    r.duration = pkt.duration;
+    r.pos = pkt.pos;
+    r.size = avpkt->size;
+    r.key = pkt.containKeyFrame;
+    r.av_pts = avpkt->pts;
+    r.av_dts = avpkt->dts;
+    r.av_duration = avpkt->duration;
+    r.flags = avpkt->flags;
+    r.offset = -1;
+    d->records.push_back(r);
+    d->memory_bytes += r.size;
+    /* the first packet of the stream can be a seek point if it's the only stream */
+    if (r.key && (stream == d->key_stream || d->key_stream < 0))
+        d->keys.push_back(std::make_pair(d->end() - 1, r.pts));
+
+    while (d->records.size() > 1 && r.pts - d->records.front().pts > d->window)
+        d->popFront();
+    while (d->memory_bytes > d->max_memory && d->spilled < d->end()) {
+        if (!d->fp) {
+            d->popFront();
+            continue;
+        }
+        const int64_t seq = d->spilled;
+        if (!d->spill(d->records[FORCE_UINT64(seq - d->first)])) {
+            d->closeFile();
+            continue;
+        }
+        d->spilled = std::max(d->spilled, seq + 1);
+    }
+    d->fixCursor();
+}
+
+bool TimeShiftBuffer::read(Packet &pkt, int &stream)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    while (d->cursor < d->end()) {
+        const TimeShiftRecord &r = d->records[FORCE_UINT64(d->cursor - d->first)];
+        d->cursor++;
+        if (!d->load(r, pkt))
+            continue;
+        stream = r.stream;
+        return true;
+    }
+    return false;
+}
+
+bool TimeShiftBuffer::seek(double pts)
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    if (d->keys.empty() || isnan(pts))
+        return false;
+    /* the timestamps are increasing except discontinuity, so search from the latest */
+    std::deque<std::pair<int64_t, double> >::const_reverse_iterator it = d->keys.rbegin();
+    for (; it != d->keys.rend(); ++it) {
+        if (it->second <= pts)
+            break;
+    }
+    d->cursor = it == d->keys.rend() ? d->keys.front().first : it->first;
+    return true;
+}
+
+void TimeShiftBuffer::seekToLive()
+{
+    DPTR_D(TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    /* start from the latest key frame, the packets after it are needed to decode */
+    d->cursor = d->keys.empty() ? d->end() : d->keys.back().first;
+}
+
+bool TimeShiftBuffer::isLive() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    return d->cursor >= d->end();
+}
+
+double TimeShiftBuffer::startTime() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    return d->keys.empty() ? NAN : d->keys.front().second;
+}
+
+double TimeShiftBuffer::endTime() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    return d->records.empty() ? NAN : d->records.back().pts;
+}
+
+double TimeShiftBuffer::position() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    if (d->cursor >= d->end())
+        return d->records.empty() ? NAN : d->records.back().pts;
+    return d->records[FORCE_UINT64(d->cursor - d->first)].pts;
+}
+
+int64_t TimeShiftBuffer::memoryBytes() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    return d->memory_bytes;
+}
+
+int64_t TimeShiftBuffer::fileBytes() const
+{
+    DPTR_D(const TimeShiftBuffer);
+    DECL_LOCKGUARD(d->mutex);
+    return d->file_bytes;
+}
+
+NAMESPACE_END
@@ -0,0 +1,73 @@
+#ifndef TIMESHIFTBUFFER_H
+#define TIMESHIFTBUFFER_H
+
+#include "Packet.h"
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The TimeShiftBuffer class
+ * Ring of the demuxed packets of a real-time stream, the latest packets are
+ * kept in memory and the older ones are written to a file which is used as a
+ * ring too. Playback reads from a cursor, so the input is recorded while
+ * paused, and the cursor can be moved to any key frame inside the window.
+ * Packets written to the file lose their side data.
+ */
+class TimeShiftBufferPrivate;
+class TimeShiftBuffer
+{
+    DPTR_DECLARE_PRIVATE(TimeShiftBuffer)
+public:
+    TimeShiftBuffer();
+    ~TimeShiftBuffer();
+
+    /**
+     * @brief the duration of the window in seconds
+     */
+    void setWindow(double seconds);
+    double window() const;
+    /**
+     * @brief packets beyond the bytes are moved to the file,
+     * or dropped if the file is not opened
+     */
+    void setMemoryBytes(int64_t bytes);
+    /**
+     * @brief open the file for the older packets, an empty path closes it
+     */
+    bool setFile(const std::string &path, int64_t max_bytes);
+    /**
+     * @brief the key frames of the stream are the seek points, usually video
+     */
+    void setKeyStream(int stream);
+    void clear();
+
+    void append(const Packet &pkt, int stream);
+    /**
+     * @brief the packet at the cursor, false if the cursor is at the live edge
+     */
+    bool read(Packet &pkt, int &stream);
+    /**
+     * @brief move the cursor to the key frame not later than pts
+     */
+    bool seek(double pts);
+    void seekToLive();
+    bool isLive() const;
+
+    /**
+     * @brief the range which can be seeked to, nan if empty
+     */
+    double startTime() const;
+    double endTime() const;
+    /**
+     * @brief the timestamp of the packet at the cursor
+     */
+    double position() const;
+    int64_t memoryBytes() const;
+    int64_t fileBytes() const;
+
+private:
+    DPTR_DECLARE(TimeShiftBuffer)
+};
+
+NAMESPACE_END
+#endif //TIMESHIFTBUFFER_H
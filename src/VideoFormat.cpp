@@ -217,6 +217,14 @@ static const struct {
     { VideoFormat::Format_XYZ12, AV_PIX_FMT_XYZ12 },
     { VideoFormat::Format_XYZ12LE, AV_PIX_FMT_XYZ12LE },
     { VideoFormat::Format_XYZ12BE, AV_PIX_FMT_XYZ12BE },
+#endif
+#ifdef AV_PIX_FMT_P010
+    { VideoFormat::Format_P010LE, AV_PIX_FMT_P010LE },
+    { VideoFormat::Format_P010BE, AV_PIX_FMT_P010BE },
+#endif
+#ifdef AV_PIX_FMT_P016
+    { VideoFormat::Format_P016LE, AV_PIX_FMT_P016LE },
+    { VideoFormat::Format_P016BE, AV_PIX_FMT_P016BE },
 #endif
     { VideoFormat::Format_Invalid, AV_PIX_FMT_NONE },
 };
@@ -325,6 +333,9 @@ private:
         }
         bitsPerPixel >>= log2_pixels;
         bitsPerPixel_pad >>= log2_pixels;
+        // the low bits are 0, so the samples are used as 16 bits and no range scaling is required
+        if (pixfmt == VideoFormat::Format_P010LE || pixfmt == VideoFormat::Format_P010BE)
+            bitsPerComponent = 16;
     }
 };
 
@@ -472,6 +483,7 @@ bool VideoFormat::hasAlpha() const {
 
 bool VideoFormat::isPlanar(PixelFormat pixfmt) {
     return pixfmt == Format_YUV420P || pixfmt == Format_NV12 || pixfmt == Format_NV21 ||
+           pixfmt == Format_P010LE || pixfmt == Format_P010BE || pixfmt == Format_P016LE || pixfmt == Format_P016BE ||
            pixfmt == Format_YV12 || pixfmt == Format_YUV410P || pixfmt == Format_YUV411P ||
            pixfmt == Format_YUV422P || pixfmt == Format_YUV444P || pixfmt == Format_AYUV444 ||
            pixfmt == Format_IMC1 || pixfmt == Format_IMC2 || pixfmt == Format_IMC3 ||
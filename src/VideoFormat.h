@@ -113,6 +113,10 @@ public:
         Format_XYZ12,
         Format_XYZ12LE,
         Format_XYZ12BE,
+        Format_P010LE, // like NV12, 10 bits in the high bits of 16
+        Format_P010BE,
+        Format_P016LE,
+        Format_P016BE,
         Format_User
     };
 
@@ -10,6 +10,9 @@ public:
         height(0),
         color_space(ColorSpace_Unknown),
         color_range(ColorRange_Unknown),
+        color_trc(ColorTransfer_Unknown),
+        interlaced(false),
+        top_field_first(true),
         displayAspectRatio(1.0),
         duration(0)
     {
@@ -29,6 +32,9 @@ public:
 
     ColorSpace color_space;
     ColorRange color_range;
+    ColorTransfer color_trc;
+    bool interlaced;
+    bool top_field_first;
 
     float displayAspectRatio;
     double duration;
@@ -174,6 +180,36 @@ void VideoFrame::setColorRange(ColorRange range) {
     d->color_range = range;
 }
 
+ColorTransfer VideoFrame::colorTransfer() const {
+    DPTR_D(const VideoFrame);
+    return d->color_trc;
+}
+
+void VideoFrame::setColorTransfer(ColorTransfer trc) {
+    DPTR_D(VideoFrame);
+    d->color_trc = trc;
+}
+
+bool VideoFrame::isInterlaced() const {
+    DPTR_D(const VideoFrame);
+    return d->interlaced;
+}
+
+void VideoFrame::setInterlaced(bool value) {
+    DPTR_D(VideoFrame);
+    d->interlaced = value;
+}
+
+bool VideoFrame::isTopFieldFirst() const {
+    DPTR_D(const VideoFrame);
+    return d->top_field_first;
+}
+
+void VideoFrame::setTopFieldFirst(bool value) {
+    DPTR_D(VideoFrame);
+    d->top_field_first = value;
+}
+
 int VideoFrame::planeWidth(int plane) const {
     DPTR_D(const VideoFrame);
     return d->format.width(d->width, plane);
@@ -64,6 +64,14 @@ public:
     ColorRange colorRange() const;
     void setColorRange(ColorRange range);
 
+    ColorTransfer colorTransfer() const;
+    void setColorTransfer(ColorTransfer trc);
+
+    bool isInterlaced() const;
+    void setInterlaced(bool value);
+    bool isTopFieldFirst() const;
+    void setTopFieldFirst(bool value);
+
     int planeWidth(int plane) const;
     int planeHeight(int plane) const;
 
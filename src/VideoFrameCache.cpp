@@ -0,0 +1,234 @@
+#include "VideoFrameCache.h"
+#include "utils/innermath.h"
+#include <map>
+#include <list>
+#include <mutex>
+#include <utility>
+
+NAMESPACE_BEGIN
+
+/* timestamp in microseconds and position */
+typedef std::pair<int64_t, int64_t> CacheKey;
+static const CacheKey kInvalidKey(INT64_MIN, -1);
+/* 128MB, about 40 frames of 1080p yuv420p */
+static const int64_t kMaxBytesDefault = 128 * 1024 * 1024;
+
+typedef struct CacheEntry {
+    VideoFrame frame;
+    int64_t bytes;
+    CacheKey prev, next;
+    std::list<CacheKey>::iterator lru;
+} CacheEntry;
+
+class VideoFrameCachePrivate
+{
+public:
+    VideoFrameCachePrivate():
+        max_bytes(kMaxBytesDefault),
+        bytes(0)
+    {
+
+    }
+    ~VideoFrameCachePrivate()
+    {
+
+    }
+
+    static CacheKey key(double pts, int64_t pos)
+    {
+        if (isnan(pts))
+            return kInvalidKey;
+        return CacheKey(FORCE_INT64(std::llround(pts * 1000000.0)), pos);
+    }
+
+    static int64_t frameBytes(const VideoFrame &frame)
+    {
+        int64_t size = 0;
+        for (int i = 0; i < frame.planeCount(); ++i) {
+            size += FORCE_INT64(std::abs(frame.bytesPerLine(i))) * frame.planeHeight(i);
+        }
+        return size;
+    }
+
+    void touch(CacheEntry &e)
+    {
+        lru.splice(lru.begin(), lru, e.lru);
+    }
+
+    void evict()
+    {
+        /* keep the most recent one at least */
+        while (bytes > max_bytes && lru.size() > 1) {
+            std::map<CacheKey, CacheEntry>::iterator it = entries.find(lru.back());
+            lru.pop_back();
+            if (it == entries.end())
+                continue;
+            bytes -= it->second.bytes;
+            entries.erase(it);
+        }
+    }
+
+    VideoFrame linked(double pts, int64_t pos, bool forward)
+    {
+        std::map<CacheKey, CacheEntry>::iterator it = entries.find(key(pts, pos));
+        if (it == entries.end())
+            return VideoFrame();
+        const CacheKey k = forward ? it->second.next : it->second.prev;
+        if (k == kInvalidKey)
+            return VideoFrame();
+        it = entries.find(k);
+        if (it == entries.end())
+            return VideoFrame();
+        touch(it->second);
+        return it->second.frame;
+    }
+
+    int64_t max_bytes;
+    int64_t bytes;
+    std::map<CacheKey, CacheEntry> entries;
+    /* the front is the most recently used */
+    std::list<CacheKey> lru;
+    mutable std::mutex mutex;
+};
+
+VideoFrameCache::VideoFrameCache():
+    d_ptr(new VideoFrameCachePrivate)
+{
+
+}
+
+VideoFrameCache::~VideoFrameCache()
+{
+
+}
+
+void VideoFrameCache::setMaxBytes(int64_t bytes)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    d->max_bytes = std::max<int64_t>(0, bytes);
+    if (d->max_bytes == 0) {
+        d->entries.clear();
+        d->lru.clear();
+        d->bytes = 0;
+        return;
+    }
+    d->evict();
+}
+
+int64_t VideoFrameCache::maxBytes() const
+{
+    DPTR_D(const VideoFrameCache);
+    return d->max_bytes;
+}
+
+int64_t VideoFrameCache::bytes() const
+{
+    DPTR_D(const VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    return d->bytes;
+}
+
+int VideoFrameCache::size() const
+{
+    DPTR_D(const VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    return FORCE_INT(d->entries.size());
+}
+
+void VideoFrameCache::clear()
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    d->entries.clear();
+    d->lru.clear();
+    d->bytes = 0;
+}
+
+void VideoFrameCache::insert(const VideoFrame &frame, double prev_pts, int64_t prev_pos)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    const CacheKey k = d->key(frame.timestamp(), frame.pos());
+    const CacheKey p = d->key(prev_pts, prev_pos);
+    if (d->max_bytes <= 0 || k == kInvalidKey || p == k)
+        return;
+    std::map<CacheKey, CacheEntry>::iterator it = d->entries.find(k);
+    if (it == d->entries.end()) {
+        CacheEntry e;
+        e.frame = frame;
+        e.bytes = d->frameBytes(frame);
+        if (e.bytes > d->max_bytes)
+            return;
+        e.prev = e.next = kInvalidKey;
+        d->lru.push_front(k);
+        e.lru = d->lru.begin();
+        d->bytes += e.bytes;
+        it = d->entries.insert(std::make_pair(k, e)).first;
+    }
+    else {
+        d->touch(it->second);
+    }
+    /* the links are kept if the neighbor is evicted, it is checked when lookup */
+    if (p != kInvalidKey) {
+        it->second.prev = p;
+        std::map<CacheKey, CacheEntry>::iterator prev_it = d->entries.find(p);
+        if (prev_it != d->entries.end())
+            prev_it->second.next = k;
+    }
+    d->evict();
+}
+
+bool VideoFrameCache::contains(double pts, int64_t pos) const
+{
+    DPTR_D(const VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    return d->entries.find(d->key(pts, pos)) != d->entries.end();
+}
+
+VideoFrame VideoFrameCache::frame(double pts, int64_t pos)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    std::map<CacheKey, CacheEntry>::iterator it = d->entries.find(d->key(pts, pos));
+    if (it == d->entries.end())
+        return VideoFrame();
+    d->touch(it->second);
+    return it->second.frame;
+}
+
+VideoFrame VideoFrameCache::previous(double pts, int64_t pos)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    return d->linked(pts, pos, false);
+}
+
+VideoFrame VideoFrameCache::next(double pts, int64_t pos)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    return d->linked(pts, pos, true);
+}
+
+VideoFrame VideoFrameCache::at(double pts)
+{
+    DPTR_D(VideoFrameCache);
+    DECL_LOCKGUARD(d->mutex);
+    const CacheKey k = d->key(pts, INT64_MAX);
+    if (k == kInvalidKey)
+        return VideoFrame();
+    std::map<CacheKey, CacheEntry>::iterator it = d->entries.upper_bound(k);
+    if (it == d->entries.begin())
+        return VideoFrame();
+    --it;
+    const VideoFrame &f = it->second.frame;
+    /* the duration is unknown, only the exact timestamp matches */
+    const double duration = f.duration() > 0 ? f.duration() : 0.0;
+    if (it->first.first != k.first && pts >= f.timestamp() + duration)
+        return VideoFrame();
+    d->touch(it->second);
+    return f;
+}
+
+NAMESPACE_END
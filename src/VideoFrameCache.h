@@ -0,0 +1,59 @@
+#ifndef VIDEOFRAMECACHE_H
+#define VIDEOFRAMECACHE_H
+
+#include "VideoFrame.h"
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The VideoFrameCache class
+ * LRU cache of the decoded frames limited by bytes, frames are keyed by
+ * timestamp and the position in file, so that they are still valid after
+ * seek(the serial is changed), and the frames of different media with the
+ * same timestamp are not mixed. The position is -1 if it's unknown.
+ * Each frame is linked to the one decoded just before it, then the
+ * previous or next frame can be found without decoding again.
+ */
+class VideoFrameCachePrivate;
+class VideoFrameCache
+{
+    DPTR_DECLARE_PRIVATE(VideoFrameCache)
+public:
+    VideoFrameCache();
+    ~VideoFrameCache();
+
+    /**
+     * @brief 0 means that the cache is disabled
+     */
+    void setMaxBytes(int64_t bytes);
+    int64_t maxBytes() const;
+    int64_t bytes() const;
+    int size() const;
+    void clear();
+
+    /**
+     * @brief insert
+     * @param prev_pts the timestamp of the frame decoded just before, nan if
+     * the frame is the first one after flush
+     * @param prev_pos the position of the frame decoded just before
+     */
+    void insert(const VideoFrame &frame, double prev_pts, int64_t prev_pos);
+    bool contains(double pts, int64_t pos) const;
+    VideoFrame frame(double pts, int64_t pos);
+    /**
+     * @brief return an invalid frame if the previous/next one is not cached
+     */
+    VideoFrame previous(double pts, int64_t pos);
+    VideoFrame next(double pts, int64_t pos);
+    /**
+     * @brief the frame shown at pts, i.e. the latest one not after pts whose
+     * duration covers it. Return an invalid frame if it's not cached
+     */
+    VideoFrame at(double pts);
+
+private:
+    DPTR_DECLARE(VideoFrameCache)
+};
+
+NAMESPACE_END
+#endif //VIDEOFRAMECACHE_H
@@ -5,16 +5,25 @@
 #include "OutputSet.h"
 #include "innermath.h"
 #include "framequeue.h"
+#include "VideoFrameCache.h"
 #include "subtitle/SubtitleDecoder.h"
 #include "subtitle/assrender.h"
+#include <mutex>
+#include <atomic>
 
 extern "C" {
+#include "libavformat/avformat.h"
 #include "libavutil/time.h"
 #include "libavutil/bprint.h"
 #include "libavutil/log.h"
+#include "libavutil/frame.h"
 }
 
 #define REFRESH_RATE 0.01
+/* the max interval of the key frames shown in trick play */
+#define TRICK_PLAY_DELAY_MAX 1.0
+/* the decoded frames are still cached in playback for a while after seek, for scrubbing */
+#define SCRUB_CACHE_TIME 2.0
 NAMESPACE_BEGIN
 
 class SubtitleDecoderThread : public CThread
@@ -24,7 +33,8 @@ public:
         CThread("subtitle decoder"),
         abort(false),
         pkts(nullptr),
-        serial(-1)
+        serial(-1),
+        pending_stream(nullptr)
     {
 
     }
@@ -74,6 +84,7 @@ public:
                 }
                 if (pkt.isFlush()) {
                     AVDebug("Seek is required, flush subtitle decoder.\n");
+                    reopenIfSwitched();
                     decoder->flush();
                     /* must clear the frames buffer for seek*/
                     frames.clear();
@@ -98,6 +109,25 @@ public:
         CThread::run();
     }
 
+    /* the track is switched before the flush packet is queued */
+    void reopenIfSwitched()
+    {
+        AVStream *stream = nullptr;
+        {
+            DECL_LOCKGUARD(mutex);
+            stream = pending_stream;
+            pending_stream = nullptr;
+        }
+        if (!stream)
+            return;
+        if (!decoder->reopen(stream)) {
+            AVWarning("Reopen subtitle decoder for stream %d failed.\n", stream->index);
+            return;
+        }
+        /* the styles of the new track */
+        ass_render.setHeader(decoder->codecCtx());
+    }
+
     bool abort;
     PacketQueue *pkts;
     SubtitleFrameQueue frames;
@@ -106,6 +136,8 @@ public:
     int serial;
     // flush decoder when media is eof
     bool flush_dec;
+    AVStream *pending_stream;
+    std::mutex mutex;
 
     ASSAide::ASSRender ass_render;
 };
@@ -117,7 +149,8 @@ public:
         CThread("video decoder"),
         abort(false),
         pkts(nullptr),
-        serial(-1)
+        serial(-1),
+        trick_play(false)
     {
 
     }
@@ -164,16 +197,28 @@ public:
             }
             // decode
             ret = decoder->decode(pkt);
+            if (trick_play && ret == AVERROR(EAGAIN) && !pkt.isFlush() && !pkt.isEOF()) {
+                /* the key frames are not continuous in trick play, drain the decoder to get the frame */
+                ret = decoder->decode(Packet::createEOF());
+            }
             if (ret < 0) {
                 if (ret == AVERROR_EOF) {
                     flush_dec = false;
                 }
+                if (trick_play)
+                    decoder->flush();
                 continue;
             }
             frame = decoder->frame();
+            if (trick_play)
+                decoder->flush();
             if (!frame.isValid()) {
                 continue;
             }
+            /* a new seek is required while decoding, don't wait for the frames queue */
+            if (serial != pkts->serial()) {
+                continue;
+            }
             frame.setSerial(serial);
             frames.enqueue(frame);
         }
@@ -188,6 +233,8 @@ public:
     int serial;
     // flush decoder when media is eof
     bool flush_dec;
+    // every key frame is decoded separately
+    bool trick_play;
 };
 
 
@@ -201,6 +248,31 @@ public:
 		last_frame_duration(0.0),
 		frame_timer(0.0),
 		step(false),
+        display_pts(NAN),
+        display_pos(-1),
+        cache_last_pts(NAN),
+        cache_last_pos(-1),
+        cache_serial(-1),
+        peek_pts(NAN),
+        peek_pos(-1),
+        peek_serial(-1),
+        cached_display(false),
+        backward_target(NAN),
+        step_req(0),
+        cached_seek_pts(NAN),
+        cached_seek_req(false),
+        cached_seek_pending(false),
+        resume_target(NAN),
+        scrub_time(0),
+        trick_speed(0),
+        slave(false),
+        slave_pts(NAN),
+        slave_updated(0),
+        suspended(false),
+        resync(false),
+        field_rate(false),
+        second_field(false),
+        field_delay(0.0),
         subtitle_decode_thread(nullptr),
         subtitle_decoder(nullptr),
         subtitle_packets(nullptr)
@@ -237,10 +309,10 @@ public:
         double sync_threshold, diff = 0;
 
         /* update delay to follow master synchronisation source */
-        if (clock->type() != SyncToVideo) {
+        if (slave || clock->type() != SyncToVideo) {
             /* if video is slave, we try to correct big delays by
                duplicating or deleting a frame */
-            diff = clock->value(SyncToVideo) - clock->value();
+            diff = (slave ? slaveValue() : clock->value(SyncToVideo)) - clock->value();
             sync_threshold = std::max(AV_SYNC_THRESHOLD_MIN, std::min(AV_SYNC_THRESHOLD_MAX, delay));
             if (!isnan(diff) && std::abs(diff) < clock->maxDuration()) {
                 if (diff <= -sync_threshold)
@@ -255,6 +327,105 @@ public:
         return delay;
     }
 
+    /* the timestamp of the frame shown now, a view keeps it instead of the clock */
+    double slaveValue() const
+    {
+        if (isnan(slave_pts) || paused)
+            return slave_pts;
+        return slave_pts + (av_gettime_relative() / 1000000.0 - slave_updated) * clock->speed();
+    }
+
+    void updateClock(double pts, int serial)
+    {
+        if (slave) {
+            slave_pts = pts;
+            slave_updated = av_gettime_relative() / 1000000.0;
+            return;
+        }
+        clock->updateValue(SyncToVideo, pts, serial);
+        clock->updateClock(SyncToExternalClock, SyncToVideo);
+    }
+
+    /* the frame is peeked until it's shown, it's filtered and cached at the first time */
+    bool firstPeek(const VideoFrame *frame)
+    {
+        const double pts = frame->timestamp();
+        if (frame->serial() == peek_serial && frame->pos() == peek_pos &&
+                (pts == peek_pts || (isnan(pts) && isnan(peek_pts))))
+            return false;
+        peek_serial = frame->serial();
+        peek_pos = frame->pos();
+        peek_pts = pts;
+        return true;
+    }
+
+    void cacheFrame(VideoFrame *frame)
+    {
+        /* filled while paused, stepping or scrubbing, the memory is released in normal playback */
+        const bool scrubbing = av_gettime_relative() - scrub_time < SCRUB_CACHE_TIME * 1000000.0;
+        if (!step && isnan(backward_target) && !paused && !scrubbing) {
+            if (cache.size() > 0)
+                cache.clear();
+            return;
+        }
+        /* the key frames in trick play are not continuous */
+        if (cache.maxBytes() <= 0 || isnan(frame->timestamp()) || trick_speed != 0)
+            return;
+        /* do not hold the surfaces of hardware decoder */
+        if (frame->frame() && frame->frame()->hw_frames_ctx)
+            return;
+        /* the frames are not continuous after seek */
+        if (cache_serial != frame->serial()) {
+            cache_serial = frame->serial();
+            cache_last_pts = NAN;
+            cache_last_pos = -1;
+        }
+        cache.insert(*frame, cache_last_pts, cache_last_pos);
+        cache_last_pts = frame->timestamp();
+        cache_last_pos = frame->pos();
+    }
+
+    void showFrame(const VideoFrame &frame)
+    {
+        output->lock();
+        output->sendVideoFrame(frame);
+        output->unlock();
+        display_pts = frame.timestamp();
+        display_pos = frame.pos();
+    }
+
+    /* in the video thread, the frame is decoded by the step missed callback if not cached */
+    void stepCached(bool forward)
+    {
+        VideoFrame frame;
+        /* the next frame is in the decoded queue if the current one is not from cache */
+        if (!isnan(display_pts) && isnan(backward_target) && (!forward || cached_display))
+            frame = forward ? cache.next(display_pts, display_pos) : cache.previous(display_pts, display_pos);
+        if (!frame.isValid()) {
+            CALL_BACK(stepMissed, forward, display_pts);
+            return;
+        }
+        showFrame(frame);
+        cached_display = true;
+        updateClock(frame.timestamp(), packets.serial());
+    }
+
+    /* in the video thread, show the frame found by seekCached() */
+    void showCachedSeek()
+    {
+        VideoFrame frame;
+        {
+            DECL_LOCKGUARD(cached_seek_mutex);
+            frame = cached_seek;
+            cached_seek = VideoFrame();
+        }
+        if (!frame.isValid())
+            return;
+        showFrame(frame);
+        cached_display = true;
+        updateClock(frame.timestamp(), packets.serial());
+    }
+
     /* Frames which have been decoded*/
     VideoFrameQueue frames;
 
@@ -266,6 +437,47 @@ public:
 	bool step;
 	std::function<void()> stepCallback;
 
+    /* cache of the decoded frames for stepping */
+    VideoFrameCache cache;
+    double display_pts;
+    int64_t display_pos;
+    double cache_last_pts;
+    int64_t cache_last_pos;
+    int cache_serial;
+    double peek_pts;
+    int64_t peek_pos;
+    int peek_serial;
+    /* the frame shown is from cache, the decoded frames before it are useless */
+    std::atomic<bool> cached_display;
+    /* decode the gop until this pts, then show the frame before it */
+    double backward_target;
+    /* 1 to step forward, -1 backward, handled in the video thread */
+    std::atomic<int> step_req;
+    std::function<void(bool forward, double pts)> stepMissed;
+    /* a seek target found in cache, shown without seeking the demuxer */
+    VideoFrame cached_seek;
+    double cached_seek_pts;
+    mutable std::mutex cached_seek_mutex;
+    std::atomic<bool> cached_seek_req;
+    /* the frame shown is from a cached seek, the decoded frames are of the old position */
+    std::atomic<bool> cached_seek_pending;
+    /* the frames until this pts are decoded for cache only after the resync seek */
+    std::atomic<double> resume_target;
+    /* the time of the latest seek, in microseconds */
+    std::atomic<int64_t> scrub_time;
+    /* only key frames are decoded if it's not 0 */
+    float trick_speed;
+    /* a view besides the main video */
+    bool slave;
+    double slave_pts, slave_updated;
+    /* no renderer is visible, and catch up with the clock after resume */
+    volatile bool suspended;
+    std::atomic<bool> resync;
+    /* the second field of the frame shown is pending, field_delay after the first one */
+    std::atomic<bool> field_rate;
+    bool second_field;
+    double field_delay;
+
     /* for subtitle */
     SubtitleDecoderThread *subtitle_decode_thread;
     SubtitleDecoder *subtitle_decoder;
@@ -296,6 +508,15 @@ void VideoThread::setSubtitleDecoder(AVDecoder * decoder)
         d->decoder->codecCtx()->height);
 }
 
+void VideoThread::switchSubtitleStream(AVStream *stream)
+{
+    DPTR_D(VideoThread);
+    if (!d->subtitle_decode_thread)
+        return;
+    DECL_LOCKGUARD(d->subtitle_decode_thread->mutex);
+    d->subtitle_decode_thread->pending_stream = stream;
+}
+
 PacketQueue * VideoThread::subtitlePackets()
 {
     return d_func()->subtitle_packets;
@@ -311,6 +532,20 @@ void VideoThread::setSubtitlePackets(PacketQueue * packets)
 void VideoThread::pause(bool p)
 {
     DPTR_D(VideoThread);
+    if (d->slave) {
+        if (p != d->paused) {
+            const double now = av_gettime_relative() / 1000000.0;
+            /* continue from the frame shown when paused */
+            if (p)
+                d->slave_pts = d->slaveValue();
+            else
+                d->frame_timer += now - d->slave_updated;
+            d->slave_updated = now;
+            d->paused = p;
+        }
+        d->continue_refresh_cond.notify_all();
+        return;
+    }
     d->paused = p;
     if (d->paused) {
         d->frame_timer += av_gettime_relative() / 1000000.0 - d->clock->clock(SyncToVideo)->last_updated;
@@ -320,6 +555,111 @@ void VideoThread::pause(bool p)
 	d->continue_refresh_cond.notify_all();
 }
 
+void VideoThread::requestSeek()
+{
+	DPTR_D(VideoThread);
+	/* the decoded frames are obsolete, and wake up the decoder if it is blocked by them */
+	d->decode_thread->frames.clear();
+	d->cached_display = false;
+	d->cached_seek_pending = false;
+	d->slave_pts = NAN;
+	d->scrub_time = av_gettime_relative();
+	AVThread::requestSeek();
+}
+
+void VideoThread::setFrameCacheBytes(int64_t bytes)
+{
+	d_func()->cache.setMaxBytes(bytes);
+}
+
+bool VideoThread::seekCached(double pts)
+{
+	DPTR_D(VideoThread);
+	if (isnan(pts) || d->trick_speed != 0 || !isnan(d->backward_target))
+		return false;
+	VideoFrame frame = d->cache.at(pts);
+	if (!frame.isValid())
+		return false;
+	{
+		DECL_LOCKGUARD(d->cached_seek_mutex);
+		d->cached_seek = frame;
+		d->cached_seek_pts = frame.timestamp();
+	}
+	d->cached_seek_pending = true;
+	d->cached_seek_req = true;
+	d->scrub_time = av_gettime_relative();
+	d->continue_refresh_cond.notify_all();
+	return true;
+}
+
+double VideoThread::cachedSeekPosition() const
+{
+	DPTR_D(const VideoThread);
+	if (!d->cached_seek_pending)
+		return NAN;
+	DECL_LOCKGUARD(d->cached_seek_mutex);
+	return d->cached_seek_pts;
+}
+
+void VideoThread::setResumeTarget(double pts)
+{
+	d_func()->resume_target = pts;
+}
+
+void VideoThread::cancelCachedSeek()
+{
+	DPTR_D(VideoThread);
+	d->resume_target = NAN;
+	d->cached_seek_pending = false;
+}
+
+void VideoThread::requestStep(bool forward)
+{
+	DPTR_D(VideoThread);
+	d->step_req = forward ? 1 : -1;
+	d->continue_refresh_cond.notify_all();
+}
+
+void VideoThread::setStepMissedCallback(std::function<void(bool forward, double pts)> cb)
+{
+	d_func()->stepMissed = cb;
+}
+
+void VideoThread::setTrickPlaySpeed(float speed)
+{
+	DPTR_D(VideoThread);
+	d->trick_speed = speed;
+	d->decode_thread->trick_play = speed != 0;
+}
+
+void VideoThread::setSlave(bool slave)
+{
+	d_func()->slave = slave;
+}
+
+void VideoThread::setSuspended(bool suspended)
+{
+	DPTR_D(VideoThread);
+	d->resync = !suspended && d->suspended;
+	d->suspended = suspended;
+	d->continue_refresh_cond.notify_all();
+}
+
+void VideoThread::setFieldRate(bool enabled)
+{
+	d_func()->field_rate = enabled;
+}
+
+bool VideoThread::isResyncing() const
+{
+	return d_func()->resync;
+}
+
+void VideoThread::setBackwardTarget(double pts)
+{
+	d_func()->backward_target = pts;
+}
+
 void VideoThread::stepToNextFrame(std::function<void()> cb)
 {
 	DPTR_D(VideoThread);
@@ -361,14 +701,37 @@ void VideoThread::run()
     while (true) {
         if (d->stopped)
             break;
+        if (d->cached_seek_req.exchange(false))
+            d->showCachedSeek();
+        const int step = d->step_req.exchange(0);
+        if (step != 0)
+            d->stepCached(step > 0);
         if (remaining_time > 0) {
             d->waitForRefreshMs(FORCE_INT(remaining_time * 1000));
         }
         remaining_time = REFRESH_RATE;
-		if (d->paused) {
+        /* wait for the resync seek after a cached one, the decoded frames are of the old position */
+		if (d->paused || d->suspended || d->cached_seek_pending) {
 			d->waitForRefreshMs(10);
 			continue;
 		}
+        if (d->second_field) {
+            /* the frame is dequeued already, show it again for the second field */
+            if (frame->serial() != d->packets.serial()) {
+                d->second_field = false;
+                d->field_delay = 0;
+                continue;
+            }
+            time = av_gettime_relative() / 1000000.0;
+            if (time < d->frame_timer + d->field_delay) {
+                remaining_time = std::min(d->frame_timer + d->field_delay - time, remaining_time);
+                continue;
+            }
+            d->frame_timer += d->field_delay;
+            d->second_field = false;
+            d->showFrame(*frame);
+            continue;
+        }
 
         *frame = frames->front(&valid, 1);
         if (!valid) {
@@ -386,15 +749,77 @@ void VideoThread::run()
 			continue;
 		}
 
+        if (d->resync) {
+            /* decoded from the key frame before the clock, the late frames are not shown */
+            const double master = clock->value(SyncToExternalClock);
+            if (!isnan(master) && frame->timestamp() + frame->duration() < master) {
+                frames->dequeue(&valid, 10);
+                continue;
+            }
+            d->resync = false;
+            d->frame_timer = av_gettime_relative() / 1000000.0;
+        }
+        /* the cached frames are filtered, they are shown again without filters */
+        if (d->firstPeek(frame)) {
+            applyFilters(frame);
+            d->cacheFrame(frame);
+        }
+        if (!isnan(d->backward_target)) {
+            /* the frames before the target are decoded only for cache */
+            if (frame->timestamp() < d->backward_target) {
+                frames->dequeue(&valid, 10);
+                continue;
+            }
+            VideoFrame prev = d->cache.previous(frame->timestamp(), frame->pos());
+            d->backward_target = NAN;
+            /* keep the target frame in queue, it's the next one for stepping */
+            if (prev.isValid()) {
+                d->showFrame(prev);
+                d->cached_display = true;
+                d->updateClock(prev.timestamp(), frame->serial());
+                if (d->seek_req) {
+                    d->seek_req = false;
+                    CALL_BACK(d->seekFinished);
+                }
+                if (d->step && d->stepCallback) {
+                    d->step = false;
+                    d->stepCallback();
+                }
+                continue;
+            }
+        }
+        const double resume_target = d->resume_target;
+        if (!isnan(resume_target)) {
+            /* the frame at the target is shown already by the cached seek */
+            if (frame->timestamp() <= resume_target) {
+                frames->dequeue(&valid, 10);
+                continue;
+            }
+            d->resume_target = NAN;
+        }
+        if (d->cached_display && frame->timestamp() <= d->display_pts) {
+            frames->dequeue(&valid, 10);
+            continue;
+        }
+
 		if (d->last_frame_serial != frame->serial())
 			d->frame_timer = av_gettime_relative() / 1000000.0;
 
-        /* compute nominal last_duration equals the pts of next frame minus the pts of current frame */
-        last_duration = d->duration(&d->last_display_frame, clock->maxDuration());
-        /*set speed, default is 1.0*/
-        last_duration /= clock->speed();
-        /* compute the time of current frame to display*/
-        delay = d->compute_target_delay(last_duration);
+        if (d->trick_speed != 0) {
+            /* the key frames are shown at the interval of the pts distance divided by speed */
+            delay = std::abs(frame->timestamp() - d->display_pts) / std::abs(d->trick_speed);
+            if (isnan(delay) || delay > TRICK_PLAY_DELAY_MAX)
+                delay = TRICK_PLAY_DELAY_MAX;
+        } else {
+            /* compute nominal last_duration equals the pts of next frame minus the pts of current frame */
+            last_duration = d->duration(&d->last_display_frame, clock->maxDuration());
+            /*set speed, default is 1.0*/
+            last_duration /= clock->speed();
+            /* compute the time of current frame to display*/
+            delay = d->compute_target_delay(last_duration);
+            /* a part of it is waited by the second field of the last frame */
+            delay = std::max(0.0, delay - d->field_delay);
+        }
 
         time = av_gettime_relative() / 1000000.0;
         if (time < d->frame_timer + delay) {
@@ -404,15 +829,12 @@ void VideoThread::run()
 
         /* Set frame_time as the start time of current frame, also is the end time of last frame */
         d->frame_timer += delay;
+        d->field_delay = 0;
         if (delay > 0 && time - d->frame_timer > AV_SYNC_THRESHOLD_MAX)
             d->frame_timer = time;
 
-        if (!isnan(frame->timestamp())) {
-            clock->updateValue(SyncToVideo, frame->timestamp(),
-//                               frame->pos(),
-                               frame->serial());
-			clock->updateClock(SyncToExternalClock, SyncToVideo);
-        }
+        if (!isnan(frame->timestamp()))
+            d->updateClock(frame->timestamp(), frame->serial());
         // process subtitle
         if (d->subtitle_decode_thread && subtitle_frames) {
             while (true) {
@@ -439,12 +861,17 @@ void VideoThread::run()
                 }
             }
         }
-        applyFilters(frame);
-		d->output->lock();
-		d->output->sendVideoFrame(*frame);
-		d->output->unlock();
+		d->showFrame(*frame);
+		d->cached_display = false;
+        if (d->field_rate && frame->isInterlaced() && d->trick_speed == 0 && frame->duration() > 0) {
+            d->second_field = true;
+            d->field_delay = frame->duration() / clock->speed() / 2;
+        }
         dequeue_req = true;
-		d->seek_req = false;
+		if (d->seek_req) {
+			d->seek_req = false;
+			CALL_BACK(d->seekFinished);
+		}
 		if (d->step && !d->paused && !isnan(clock->value()) && d->stepCallback) {
 			d->step = false;
 			d->stepCallback();
@@ -4,6 +4,8 @@
 #include "AVThread.h"
 #include "VideoFrame.h"
 
+typedef struct AVStream AVStream;
+
 NAMESPACE_BEGIN
 
 class VideoThreadPrivate;
@@ -15,13 +17,81 @@ public:
     ~VideoThread();
 
     void setSubtitleDecoder(AVDecoder* decoder);
+    /**
+     * @brief the subtitle decoder is reopened for the stream at the next flush packet
+     */
+    void switchSubtitleStream(AVStream *stream);
     PacketQueue *subtitlePackets();
     void setSubtitlePackets(PacketQueue *packets);
 
     void pause(bool p) override;
+    void requestSeek() override;
 
     void stepToNextFrame(std::function<void()> cb);
 
+    /**
+     * @brief the bytes limit of decoded frames cache, 0 to disable it
+     */
+    void setFrameCacheBytes(int64_t bytes);
+    /**
+     * @brief show the previous or next frame from cache in the video thread.
+     * The frames are cached while paused or stepping, i.e. after stepToNextFrame()
+     * or a backward target is set, and for a while after seek
+     */
+    void requestStep(bool forward);
+    /**
+     * @brief called in the video thread if the frame of the step is not cached,
+     * pts is the timestamp of the frame shown
+     */
+    void setStepMissedCallback(std::function<void(bool forward, double pts)> cb);
+    /**
+     * @brief show the cached frame at pts instead of seeking the demuxer, the
+     * cache is kept while paused, stepping and for a while after seek. Return
+     * false if it's not cached. The decoded frames are not shown until the
+     * next seek, which resyncs the decoder with the frame shown
+     */
+    bool seekCached(double pts);
+    /**
+     * @brief the timestamp of the frame shown by seekCached(), nan if the
+     * decoder is resynced already
+     */
+    double cachedSeekPosition() const;
+    /**
+     * @brief the frames until pts are decoded for cache only after the next
+     * seek, they are shown already. nan to disable it
+     */
+    void setResumeTarget(double pts);
+    /**
+     * @brief show the decoded frames again if the resync seek failed
+     */
+    void cancelCachedSeek();
+    /**
+     * @brief the frames before pts will be decoded for cache only after seeking
+     * to the key frame, then the one just before pts is shown. Called in the
+     * step missed callback
+     */
+    void setBackwardTarget(double pts);
+    /**
+     * @brief decode every key frame separately and show them at the speed
+     */
+    void setTrickPlaySpeed(float speed);
+    /**
+     * @brief the frames are shown by the clock, but the clock is never updated
+     * by this thread. It's used by the views besides the main video
+     */
+    void setSlave(bool slave);
+    /**
+     * @brief nothing is shown when suspended. After resume, the frames earlier
+     * than the clock are dropped until the video catches up
+     */
+    void setSuspended(bool suspended);
+    bool isResyncing() const;
+    /**
+     * @brief an interlaced frame is sent again in the middle of its duration, and
+     * the renderer shows its second field
+     */
+    void setFieldRate(bool enabled);
+
     void applyFilters(VideoFrame * frame);
 
 protected:
@@ -0,0 +1,536 @@
+#include "sdk/waveform.h"
+#include "demuxer/Demuxer.h"
+#include "decoder/audio/AudioDecoder.h"
+#include "utils/ThreadPool.h"
+#include "utils/innermath.h"
+#include "AVLog.h"
+#include "inner.h"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libswresample/swresample.h"
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define WAVEFORM_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WAVEFORM_SIMD_NEON 1
+#endif
+
+NAMESPACE_BEGIN
+
+#define WAVEFORM_SAMPLES_PER_PEAK 256
+#define WAVEFORM_FILE_MAGIC 0x57494d53 /* "SMIW" */
+#define WAVEFORM_FILE_VERSION 1
+
+typedef struct PeakAccumulator {
+    float min, max;
+    double sumsq;
+    int64_t samples;
+    PeakAccumulator() {
+        min = std::numeric_limits<float>::max();
+        max = -std::numeric_limits<float>::max();
+        sumsq = 0;
+        samples = 0;
+    }
+    void merge(const PeakAccumulator &other) {
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sumsq += other.sumsq;
+        samples += other.samples;
+    }
+    WaveformPeak peak() const {
+        WaveformPeak p;
+        if (samples > 0) {
+            p.min = min;
+            p.max = max;
+            p.rms = FORCE_FLOAT(std::sqrt(sumsq / samples));
+        }
+        return p;
+    }
+} PeakAccumulator;
+
+/* min, max and sum of squares of n samples */
+static void reducePeak(const float *s, int n, PeakAccumulator &acc)
+{
+    int i = 0;
+    float mn = acc.min, mx = acc.max, sum = 0;
+#if defined(WAVEFORM_SIMD_SSE) || defined(WAVEFORM_SIMD_NEON)
+    if (n >= 4) {
+        float vmn[4], vmx[4], vsum[4];
+#if defined(WAVEFORM_SIMD_SSE)
+        __m128 min4 = _mm_set1_ps(mn), max4 = _mm_set1_ps(mx), sum4 = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4) {
+            const __m128 v = _mm_loadu_ps(s + i);
+            min4 = _mm_min_ps(min4, v);
+            max4 = _mm_max_ps(max4, v);
+            sum4 = _mm_add_ps(sum4, _mm_mul_ps(v, v));
+        }
+        _mm_storeu_ps(vmn, min4);
+        _mm_storeu_ps(vmx, max4);
+        _mm_storeu_ps(vsum, sum4);
+#else
+        float32x4_t min4 = vdupq_n_f32(mn), max4 = vdupq_n_f32(mx), sum4 = vdupq_n_f32(0);
+        for (; i + 4 <= n; i += 4) {
+            const float32x4_t v = vld1q_f32(s + i);
+            min4 = vminq_f32(min4, v);
+            max4 = vmaxq_f32(max4, v);
+            sum4 = vmlaq_f32(sum4, v, v);
+        }
+        vst1q_f32(vmn, min4);
+        vst1q_f32(vmx, max4);
+        vst1q_f32(vsum, sum4);
+#endif
+        for (int j = 0; j < 4; ++j) {
+            mn = std::min(mn, vmn[j]);
+            mx = std::max(mx, vmx[j]);
+            sum += vsum[j];
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        mn = std::min(mn, s[i]);
+        mx = std::max(mx, s[i]);
+        sum += s[i] * s[i];
+    }
+    acc.min = mn;
+    acc.max = mx;
+    acc.sumsq += sum;
+    acc.samples += n;
+}
+
+static int16_t quantize(float v)
+{
+    return static_cast<int16_t>(std::max(-32768L, std::min(32767L, std::lround(v * 32767.0f))));
+}
+
+class WaveformPrivate
+{
+public:
+    WaveformPrivate():
+        threads(0),
+        samples_per_peak(WAVEFORM_SAMPLES_PER_PEAK),
+        sample_rate(0),
+        start(0),
+        total_samples(0),
+        decoded(0),
+        percent(-1),
+        error(0),
+        abort_req(false)
+    {
+
+    }
+    ~WaveformPrivate()
+    {
+
+    }
+
+    /* decode the samples in [first, last), last < 0 means to the end */
+    void decodeSegment(int64_t first, int64_t last);
+    void accumulate(const float *samples, int n, int64_t pos, int64_t first, int64_t last,
+                    std::vector<PeakAccumulator> &blocks);
+    void buildPyramid();
+    void updateProgress(int64_t samples);
+
+    std::string url;
+    int threads;
+    int samples_per_peak;
+    int sample_rate;
+    double start;
+    int64_t total_samples;
+    std::atomic<int64_t> decoded;
+    std::atomic<int> percent;
+    std::atomic<int> error;
+    std::atomic<bool> abort_req;
+    std::function<void(double)> progress_cb;
+    /* level 0 of all the segments */
+    std::vector<PeakAccumulator> blocks;
+    std::vector<std::vector<WaveformPeak> > levels;
+    /* the demuxers of the workers, to abort the blocking read */
+    std::vector<Demuxer*> demuxers;
+    std::mutex mutex;
+};
+
+void WaveformPrivate::decodeSegment(int64_t first, int64_t last)
+{
+    Demuxer demuxer;
+    demuxer.setMedia(url);
+    demuxer.setMediaStreamDisable(MediaTypeVideo);
+    demuxer.setMediaStreamDisable(MediaTypeSubtitle);
+    demuxer.setSeekType(SeekFromStart);
+    {
+        DECL_LOCKGUARD(mutex);
+        if (abort_req)
+            return;
+        demuxers.push_back(&demuxer);
+    }
+    std::unique_ptr<AudioDecoder> decoder;
+    const int stream = demuxer.load() == 0 ? demuxer.streamIndex(MediaTypeAudio) : -1;
+    if (stream >= 0 && demuxer.stream(MediaTypeAudio))
+        decoder.reset(AudioDecoder::create(AudioDecoderId_FFmpeg));
+    if (decoder) {
+        decoder->initialize(demuxer.formatCtx(), demuxer.stream(MediaTypeAudio));
+        if (!decoder->open()) {
+            AVWarning("Waveform: can not open the audio decoder.\n");
+            decoder.reset();
+        }
+    }
+    if (decoder && first > 0 && !demuxer.seek(start + FORCE_DOUBLE(first) / sample_rate, 0)) {
+        AVWarning("Waveform: seek to sample %lld failed.\n", (long long)first);
+        decoder.reset();
+    }
+    if (!decoder)
+        error = -1;
+
+    /* only the blocks of this segment, the segments are aligned to the blocks */
+    std::vector<PeakAccumulator> local;
+    std::vector<float> mono;
+    SwrContext *swr = nullptr;
+    int64_t in_layout = 0;
+    int in_format = -1, in_rate = 0;
+    int64_t pos = -1;
+
+    while (decoder && !abort_req && (last < 0 || pos < last)) {
+        int ret = demuxer.readFrame();
+        Packet pkt;
+        if (ret == AVERROR_EOF) {
+            pkt = Packet::createEOF();
+        }
+        else if (ret == -1 || ret == 999 || ret == AVERROR(EAGAIN)) {
+            continue;
+        }
+        else if (ret < 0) {
+            break;
+        }
+        else if (demuxer.stream() != stream) {
+            continue;
+        }
+        else {
+            pkt = demuxer.packet();
+        }
+        ret = decoder->decode(pkt);
+        if (ret >= 0) {
+            AudioFrame frame = decoder->frame();
+            AVFrame *f = frame.frame();
+            if (f && f->nb_samples > 0) {
+                const int64_t layout = f->channel_layout ? f->channel_layout : av_get_default_channel_layout(f->channels);
+                if (!swr || layout != in_layout || f->format != in_format || f->sample_rate != in_rate) {
+                    in_layout = layout;
+                    in_format = f->format;
+                    in_rate = f->sample_rate;
+                    swr_free(&swr);
+                    /* downmix to mono float at the rate of the stream */
+                    swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, sample_rate,
+                                             in_layout, static_cast<AVSampleFormat>(in_format), in_rate, 0, nullptr);
+                    if (!swr || swr_init(swr) < 0) {
+                        AVWarning("Waveform: swr init failed.\n");
+                        error = -1;
+                        break;
+                    }
+                }
+                mono.resize(std::max(0, swr_get_out_samples(swr, f->nb_samples)));
+                uint8_t *out = reinterpret_cast<uint8_t*>(mono.data());
+                const int n = swr_convert(swr, &out, FORCE_INT(mono.size()),
+                                          const_cast<const uint8_t**>(f->extended_data), f->nb_samples);
+                if (pos < 0) {
+                    /* the first frame after seek, the following ones are continuous */
+                    pos = isnan(frame.timestamp()) ? first : FORCE_INT64(std::llround((frame.timestamp() - start) * sample_rate));
+                }
+                if (n > 0) {
+                    accumulate(mono.data(), n, pos, first, last, local);
+                    pos += n;
+                    updateProgress(n);
+                }
+            }
+        }
+        if (pkt.isEOF())
+            break;
+    }
+    swr_free(&swr);
+    if (decoder)
+        decoder->close();
+    {
+        DECL_LOCKGUARD(mutex);
+        demuxers.erase(std::remove(demuxers.begin(), demuxers.end(), &demuxer), demuxers.end());
+        const size_t base = FORCE_UINT64(first / samples_per_peak);
+        if (blocks.size() < base + local.size())
+            blocks.resize(base + local.size());
+        for (size_t i = 0; i < local.size(); ++i)
+            blocks[base + i].merge(local[i]);
+    }
+    demuxer.unload();
+}
+
+void WaveformPrivate::accumulate(const float *samples, int n, int64_t pos, int64_t first, int64_t last,
+                                 std::vector<PeakAccumulator> &local)
+{
+    const int64_t base = first / samples_per_peak;
+    int off = 0;
+    /* decoded from the key frame before the segment */
+    if (pos < first)
+        off = FORCE_INT(std::min<int64_t>(n, first - pos));
+    while (off < n) {
+        const int64_t p = pos + off;
+        if (last >= 0 && p >= last)
+            break;
+        const int64_t block = p / samples_per_peak;
+        int64_t k = std::min<int64_t>(n - off, (block + 1) * samples_per_peak - p);
+        if (last >= 0)
+            k = std::min<int64_t>(k, last - p);
+        const size_t index = FORCE_UINT64(block - base);
+        if (local.size() <= index)
+            local.resize(index + 1);
+        reducePeak(samples + off, FORCE_INT(k), local[index]);
+        off += FORCE_INT(k);
+    }
+}
+
+void WaveformPrivate::buildPyramid()
+{
+    levels.clear();
+    std::vector<PeakAccumulator> level(blocks);
+    while (!level.empty()) {
+        std::vector<WaveformPeak> peaks(level.size());
+        for (size_t i = 0; i < level.size(); ++i)
+            peaks[i] = level[i].peak();
+        levels.push_back(peaks);
+        if (level.size() == 1)
+            break;
+        std::vector<PeakAccumulator> upper((level.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); ++i)
+            upper[i / 2].merge(level[i]);
+        level.swap(upper);
+    }
+}
+
+void WaveformPrivate::updateProgress(int64_t samples)
+{
+    const int64_t value = decoded += samples;
+    if (!progress_cb || total_samples <= 0)
+        return;
+    const int p = FORCE_INT(std::min<int64_t>(100, value * 100 / total_samples));
+    int old = percent;
+    /* only once for each percent */
+    if (p > old && percent.compare_exchange_strong(old, p))
+        progress_cb(p / 100.0);
+}
+
+Waveform::Waveform():
+    d_ptr(new WaveformPrivate)
+{
+}
+
+Waveform::~Waveform()
+{
+    abort();
+}
+
+void Waveform::setMedia(const std::string& url)
+{
+    DPTR_D(Waveform);
+    d->url = url;
+}
+
+void Waveform::setThreads(int threads)
+{
+    DPTR_D(Waveform);
+    d->threads = threads;
+}
+
+void Waveform::setSamplesPerPeak(int samples)
+{
+    DPTR_D(Waveform);
+    d->samples_per_peak = samples > 0 ? samples : WAVEFORM_SAMPLES_PER_PEAK;
+}
+
+void Waveform::setProgressCallback(std::function<void(double progress)> f)
+{
+    DPTR_D(Waveform);
+    d->progress_cb = f;
+}
+
+int Waveform::generate()
+{
+    DPTR_D(Waveform);
+    int ret;
+    int segments = 1;
+    bool seekable = false;
+
+    d->abort_req = false;
+    d->error = 0;
+    d->decoded = 0;
+    d->percent = -1;
+    d->blocks.clear();
+    d->levels.clear();
+    {
+        Demuxer demuxer;
+        demuxer.setMedia(d->url);
+        demuxer.setMediaStreamDisable(MediaTypeVideo);
+        demuxer.setMediaStreamDisable(MediaTypeSubtitle);
+        ret = demuxer.load();
+        if (ret < 0)
+            return ret;
+        AVStream *st = demuxer.stream(MediaTypeAudio);
+        if (!st || st->codecpar->sample_rate <= 0) {
+            AVWarning("Waveform: no audio stream in %s.\n", d->url.c_str());
+            return -1;
+        }
+        d->sample_rate = st->codecpar->sample_rate;
+        d->start = demuxer.startTimeS();
+        AVFormatContext *ctx = demuxer.formatCtx();
+        d->total_samples = ctx->duration == AV_NOPTS_VALUE ? 0 : av_rescale(ctx->duration, d->sample_rate, AV_TIME_BASE);
+        seekable = demuxer.isSeekable() && !demuxer.isRealTime();
+    }
+
+    const int64_t begin = av_gettime_relative();
+    {
+        ThreadPool pool(d->threads);
+        if (seekable && d->total_samples > 0)
+            segments = pool.threadCount();
+        /* the segments are aligned to the peaks, so that a peak is decoded by one worker only */
+        const int64_t peaks = (d->total_samples + d->samples_per_peak - 1) / d->samples_per_peak;
+        const int64_t length = std::max<int64_t>(1, (peaks + segments - 1) / segments) * d->samples_per_peak;
+        for (int i = 0; i < segments; ++i) {
+            const int64_t first = length * i;
+            const int64_t last = i == segments - 1 ? -1 : length * (i + 1);
+            pool.post([d, first, last] { d->decodeSegment(first, last); });
+        }
+        pool.waitForDone();
+    }
+    if (d->abort_req || d->error < 0) {
+        d->blocks.clear();
+        return -1;
+    }
+    d->buildPyramid();
+    d->blocks.clear();
+    AVDebug("Waveform: %lld samples decoded in %d segments, %.1f ms\n",
+            (long long)d->decoded.load(), segments, (av_gettime_relative() - begin) / 1000.0);
+    return 0;
+}
+
+void Waveform::abort()
+{
+    DPTR_D(Waveform);
+    DECL_LOCKGUARD(d->mutex);
+    d->abort_req = true;
+    for (size_t i = 0; i < d->demuxers.size(); ++i)
+        d->demuxers[i]->abort();
+}
+
+int Waveform::sampleRate() const
+{
+    DPTR_D(const Waveform);
+    return d->sample_rate;
+}
+
+int Waveform::samplesPerPeak(int level) const
+{
+    DPTR_D(const Waveform);
+    return d->samples_per_peak << std::max(0, std::min(level, 30));
+}
+
+int Waveform::levels() const
+{
+    DPTR_D(const Waveform);
+    return FORCE_INT(d->levels.size());
+}
+
+int Waveform::levelFor(int64_t samples) const
+{
+    DPTR_D(const Waveform);
+    int level = 0;
+    while (level + 1 < levels() && FORCE_INT64(d->samples_per_peak) << level < samples)
+        level++;
+    return level;
+}
+
+const std::vector<WaveformPeak>& Waveform::peaks(int level) const
+{
+    DPTR_D(const Waveform);
+    static const std::vector<WaveformPeak> empty;
+    if (level < 0 || level >= levels())
+        return empty;
+    return d->levels[level];
+}
+
+int Waveform::save(const std::string& file) const
+{
+    DPTR_D(const Waveform);
+    if (d->levels.empty())
+        return -1;
+    FILE *fp = fopen(file.c_str(), "wb");
+    if (!fp) {
+        AVWarning("Waveform: can not open %s.\n", file.c_str());
+        return -1;
+    }
+    const int32_t header[] = { WAVEFORM_FILE_MAGIC, WAVEFORM_FILE_VERSION,
+                               d->sample_rate, d->samples_per_peak, levels() };
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1;
+    std::vector<int16_t> values;
+    for (size_t l = 0; ok && l < d->levels.size(); ++l) {
+        const std::vector<WaveformPeak> &peaks = d->levels[l];
+        const int64_t count = FORCE_INT64(peaks.size());
+        values.resize(peaks.size() * 3);
+        for (size_t i = 0; i < peaks.size(); ++i) {
+            values[i * 3] = quantize(peaks[i].min);
+            values[i * 3 + 1] = quantize(peaks[i].max);
+            values[i * 3 + 2] = quantize(peaks[i].rms);
+        }
+        ok = fwrite(&count, sizeof(count), 1, fp) == 1
+                && (values.empty() || fwrite(values.data(), sizeof(int16_t), values.size(), fp) == values.size());
+    }
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+int Waveform::load(const std::string& file)
+{
+    DPTR_D(Waveform);
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+        return -1;
+    int32_t header[5];
+    bool ok = fread(header, sizeof(header), 1, fp) == 1
+            && header[0] == WAVEFORM_FILE_MAGIC && header[1] == WAVEFORM_FILE_VERSION
+            && header[2] > 0 && header[3] > 0 && header[4] >= 0;
+    std::vector<std::vector<WaveformPeak> > levels;
+    std::vector<int16_t> values;
+    for (int l = 0; ok && l < header[4]; ++l) {
+        int64_t count = 0;
+        ok = fread(&count, sizeof(count), 1, fp) == 1 && count >= 0 && count <= INT32_MAX;
+        if (!ok)
+            break;
+        values.resize(FORCE_UINT64(count) * 3);
+        ok = values.empty() || fread(values.data(), sizeof(int16_t), values.size(), fp) == values.size();
+        std::vector<WaveformPeak> peaks(FORCE_UINT64(count));
+        for (size_t i = 0; ok && i < peaks.size(); ++i) {
+            peaks[i].min = values[i * 3] / 32767.0f;
+            peaks[i].max = values[i * 3 + 1] / 32767.0f;
+            peaks[i].rms = values[i * 3 + 2] / 32767.0f;
+        }
+        levels.push_back(peaks);
+    }
+    fclose(fp);
+    if (!ok) {
+        AVWarning("Waveform: invalid peak file %s.\n", file.c_str());
+        return -1;
+    }
+    d->sample_rate = header[2];
+    d->samples_per_peak = header[3];
+    d->levels.swap(levels);
+    return 0;
+}
+
+NAMESPACE_END
@@ -46,6 +46,10 @@ bool AVDecoder::open(const string &extra)
     AVCodec *codec;
     PU_UNUSED(extra)
 
+    /* the context of previous open */
+    if (d->codec_ctx)
+        avcodec_free_context(&d->codec_ctx);
+    d->hardware_supports.clear();
     d->codec_ctx = avcodec_alloc_context3(nullptr);
     if (!d->codec_ctx)
         return false;
@@ -100,6 +104,15 @@ bool AVDecoder::close()
     return true;
 }
 
+bool AVDecoder::reopen(AVStream *stream)
+{
+    DPTR_D(AVDecoder);
+    close();
+    d->opened = false;
+    d->current_stream = stream;
+    return open();
+}
+
 bool AVDecoder::isOpen()
 {
     DPTR_D(const AVDecoder);
@@ -30,6 +30,11 @@ public:
     virtual bool open(const string &extra = string());
     virtual void onOpen() {}
     virtual bool close();
+    /**
+     * @brief close and open for another stream of the same media, e.g. the
+     * audio track is switched. The options and codec name are kept
+     */
+    bool reopen(AVStream *stream);
 
     bool isOpen();
     void flush();
@@ -7,6 +7,7 @@ NAMESPACE_BEGIN
 
 extern ColorSpace colorSpaceFromFFmpeg(AVColorSpace space);
 extern ColorRange colorRangeFromFFmpeg(AVColorRange range);
+extern ColorTransfer colorTransferFromFFmpeg(AVColorTransferCharacteristic trc);
 
 class VideoDecoderFFmpegBasePrivate: public VideoDecoderPrivate
 {
@@ -76,6 +77,19 @@ public:
             }
         }
         f.setColorRange(range);
+
+        ColorTransfer trc = colorTransferFromFFmpeg(frame->color_trc);
+        if (trc == ColorTransfer_Unknown)
+            trc = colorTransferFromFFmpeg(codec_ctx->color_trc);
+        f.setColorTransfer(trc);
+
+#ifdef AV_FRAME_FLAG_INTERLACED
+        f.setInterlaced(!!(frame->flags & AV_FRAME_FLAG_INTERLACED));
+        f.setTopFieldFirst(!!(frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST));
+#else
+        f.setInterlaced(!!frame->interlaced_frame);
+        f.setTopFieldFirst(!!frame->top_field_first);
+#endif
     }
 
     float getDisplayAspectRatio(AVFrame *f)
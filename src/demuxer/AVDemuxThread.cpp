@@ -1,17 +1,36 @@
 #include "AVDemuxThread.h"
 #include "Demuxer.h"
+#include "AdaptiveBitrate.h"
+#include "ExternalAudioThread.h"
 #include "AudioThread.h"
 #include "VideoThread.h"
 #include "PacketQueue.h"
+#include "TimeShiftBuffer.h"
+#include "Recorder.h"
 #include "AVLog.h"
 #include "AVClock.h"
+#include "utils/innermath.h"
 #include <mutex>
+#include <algorithm>
+#include <cstring>
 extern "C" {
 #include "libavformat/avformat.h"
+#include "libavutil/time.h"
 }
 
 #define MAX_QUEUE_SIZE (15 * 1024 * 1024)
 #define MIN_FRAMES 25
+/* the key frames are picked at least speed * interval seconds apart in trick play */
+#define TRICK_PLAY_INTERVAL 0.1
+/* catch up if the playback is behind the live edge more than the delay, and stop near it */
+#define TIMESHIFT_CATCH_UP_DELAY 5.0
+#define TIMESHIFT_LIVE_DELAY 2.0
+/* the packets kept when the video is suspended, it's sought at resume if the gop is larger */
+#define VIDEO_SUSPEND_GOP_BYTES (16 * 1024 * 1024)
+/* read ahead of the clock if the video is suspended and there is no audio */
+#define VIDEO_SUSPEND_AHEAD 1.0
+/* a view without packets for the buffered duration of the main video, at least this, is not waited */
+#define VIEW_IDLE_MIN 1.0
 
 NAMESPACE_BEGIN
 
@@ -22,6 +41,7 @@ public:
         demuxer(nullptr),
         audio_thread(nullptr),
         video_thread(nullptr),
+        external_audio(nullptr),
         stopped(true),
         paused(false),
         last_paused(false),
@@ -29,14 +49,333 @@ public:
         buffering(false),
         lastProgress(0),
         seek_req(false),
+        seek_time(0),
+        trick_req(false),
+        trick_speed_req(0),
+        trick_speed(0),
+        trick_clock_type(SyncToAudio),
+        trick_last_pts(NAN),
+        trick_back(0),
+        trick_jump(false),
+        trick_begin(false),
+        trick_stall(false),
+        abr(false),
+        variant_req(-1),
+        timeshift_window(0),
+        timeshift_file_bytes(0),
+        timeshift_active(false),
+        catch_up_speed(0),
+        catching_up(false),
+        recorder(nullptr),
+        next_demuxer(nullptr),
+        time_offset(0),
+        prev_offset(0),
+        chain_pts(0),
+        last_end(NAN),
+        end_notified(false),
+        suspend_req(false),
+        suspend_value(false),
+        video_suspended(false),
+        suspend_clock_type(SyncToAudio),
+        suspend_clock_restore(false),
+        suspend_gop_bytes(0),
+        suspend_gop_valid(false),
+        suspend_pts(NAN),
         clock(nullptr),
         eof(false)
     {
-
+        std::fill(track_req, track_req + MediaTypeNb, -1);
     }
     ~AVDemuxThreadPrivate()
     {
+        delete recorder;
+    }
+
+    void seekFinished()
+    {
+        DECL_LOCKGUARD(seek_mutex);
+        /* the seek is obsolete if another one is pending */
+        if (seek_req || seek_time == 0)
+            return;
+        SeekStatistics &s = seek_statistics;
+        s.last = (av_gettime_relative() - seek_time) / 1000.0;
+        s.max = std::max(s.max, s.last);
+        s.average = (s.average * s.finished + s.last) / (s.finished + 1);
+        s.finished++;
+        seek_time = 0;
+        AVDebug("Seek finished, it takes %.3f ms to show the first frame.\n", s.last);
+    }
+
+    void resetTrickPlay()
+    {
+        trick_last_pts = NAN;
+        trick_back = std::abs(trick_speed) * TRICK_PLAY_INTERVAL;
+        trick_jump = trick_begin = trick_stall = false;
+    }
+
+    /**
+     * Only the key frames which are far enough from the last one are forwarded.
+     * For rewind, the demuxer jumps back after a key frame is forwarded.
+     */
+    bool acceptTrickPacket(const Packet &pkt)
+    {
+        if (!pkt.containKeyFrame)
+            return false;
+        const double step = std::abs(trick_speed) * TRICK_PLAY_INTERVAL;
+        if (!isnan(trick_last_pts)) {
+            if (trick_speed > 0 && pkt.pts - trick_last_pts < step)
+                return false;
+            if (trick_speed < 0 && pkt.pts >= trick_last_pts) {
+                /* the gop is longer than the step, jump further, or stay at the first key frame */
+                if (trick_begin) {
+                    trick_stall = true;
+                } else {
+                    trick_back += step;
+                    trick_jump = true;
+                }
+                return false;
+            }
+        }
+        trick_last_pts = pkt.pts;
+        trick_back = step;
+        trick_jump = trick_speed < 0;
+        trick_begin = false;
+        return true;
+    }
 
+    /* the variant is selected by the policy of AdaptiveBitrate, it's not switched in trick play */
+    void updateVariant()
+    {
+        if (trick_speed != 0)
+            return;
+        const bool enough = !buffering && main_buffer && main_buffer->checkEnough();
+        abr_policy.update(demuxer, enough, av_gettime_relative());
+    }
+
+    /**
+     * Play faster if the cursor of timeshift is far behind the live edge,
+     * the speed set by user is not changed.
+     */
+    void updateCatchUp()
+    {
+        if (catch_up_speed <= 1.0f || trick_speed != 0)
+            return;
+        const double delay = timeshift.endTime() - clock->value();
+        if (isnan(delay))
+            return;
+        if (!catching_up && !paused && delay > TIMESHIFT_CATCH_UP_DELAY && clock->speed() == 1.0f) {
+            AVDebug("TimeShift: %.3fs behind the live, catch up at %.2fx\n", delay, catch_up_speed);
+            clock->setSpeed(catch_up_speed);
+            catching_up = true;
+        } else if (catching_up && (delay < TIMESHIFT_LIVE_DELAY || clock->speed() != catch_up_speed)) {
+            if (clock->speed() == catch_up_speed)
+                clock->setSpeed(1.0f);
+            catching_up = false;
+        }
+    }
+
+    /* the tee to the recorder, it never blocks */
+    void record(const Packet &pkt, int stream)
+    {
+        DECL_LOCKGUARD(record_mutex);
+        if (recorder)
+            recorder->push(pkt, stream);
+    }
+
+    void recordDiscontinuity()
+    {
+        DECL_LOCKGUARD(record_mutex);
+        if (recorder)
+            recorder->discontinuity();
+    }
+
+    /*
+     * The timestamps of the media chained follow the previous one. The AVPacket
+     * may be shared with the recorder and the track window, so a detached one is shifted
+     */
+    void applyTimeOffset(Packet &pkt, int stream)
+    {
+        if (time_offset != 0 && demuxer->formatCtx()) {
+            AVStream *st = demuxer->formatCtx()->streams[stream];
+            const int64_t shift = FORCE_INT64(std::llround(time_offset / av_q2d(st->time_base)));
+            pkt = pkt.detached();
+            AVPacket *avpkt = pkt.avPacket();
+            if (avpkt->pts != AV_NOPTS_VALUE)
+                avpkt->pts += shift;
+            if (avpkt->dts != AV_NOPTS_VALUE)
+                avpkt->dts += shift;
+            pkt.pts += time_offset;
+            pkt.dts += time_offset;
+        }
+        if (isnan(last_end) || pkt.pts + pkt.duration > last_end)
+            last_end = pkt.pts + pkt.duration;
+    }
+
+    static bool sameStream(AVStream *a, AVStream *b)
+    {
+        if (!a || !b)
+            return a == b;
+        const AVCodecParameters *x = a->codecpar;
+        const AVCodecParameters *y = b->codecpar;
+        if (x->codec_id != y->codec_id || av_cmp_q(a->time_base, b->time_base) != 0)
+            return false;
+        if (x->extradata_size != y->extradata_size ||
+                (x->extradata_size > 0 && memcmp(x->extradata, y->extradata, x->extradata_size) != 0))
+            return false;
+        if (x->codec_type == AVMEDIA_TYPE_AUDIO)
+            return x->sample_rate == y->sample_rate && x->channels == y->channels && x->format == y->format;
+        if (x->codec_type == AVMEDIA_TYPE_VIDEO)
+            return x->width == y->width && x->height == y->height && x->format == y->format;
+        return true;
+    }
+
+    /* the decoders and output can be used by the next media without reopen */
+    static bool compatible(Demuxer *a, Demuxer *b)
+    {
+        if (a->hasAttachedPic() || b->hasAttachedPic())
+            return false;
+        AVStream *sa = a->stream(MediaTypeSubtitle);
+        AVStream *sb = b->stream(MediaTypeSubtitle);
+        if (sa && sb && sa->codecpar->codec_id != sb->codecpar->codec_id)
+            return false;
+        return sameStream(a->stream(MediaTypeVideo), b->stream(MediaTypeVideo)) &&
+                sameStream(a->stream(MediaTypeAudio), b->stream(MediaTypeAudio));
+    }
+
+    /**
+     * The packets of the new track kept by the demuxer from the current position
+     * are queued at once, the queues of other types are not touched.
+     */
+    void switchTrack(MediaType type, int stream, PacketQueue *queue)
+    {
+        if (!queue)
+            return;
+        const double pos = clock->value();
+        const double offset = pos >= chain_pts ? time_offset : prev_offset;
+        std::deque<Packet> packets;
+        if (!demuxer->switchTrack(type, stream, pos - offset, packets))
+            return;
+        AVStream *st = demuxer->formatCtx()->streams[stream];
+        queue->clear();
+        if (type == MediaTypeAudio)
+            dynamic_cast<AudioThread*>(audio_thread)->switchStream(st);
+        else
+            dynamic_cast<VideoThread*>(video_thread)->switchSubtitleStream(st);
+        queue->blockFull(false);
+        queue->enqueue(Packet::createFlush());
+        if (type == MediaTypeAudio)
+            audio_thread->requestSeek();
+        /* the packets kept are live ones, the cursor of timeshift is behind */
+        if (!timeshift_active && trick_speed == 0) {
+            for (std::deque<Packet>::iterator it = packets.begin(); it != packets.end(); ++it) {
+                applyTimeOffset(*it, stream);
+                queue->enqueue(*it);
+            }
+        }
+        CALL_BACK(streamChanged, type, stream);
+    }
+
+    /**
+     * The video queue is flushed, so the video clock is obsolete and the audio
+     * or external clock is used. At resume the packets kept from the latest
+     * key frame are queued, or seek to the clock if they are not kept.
+     */
+    void suspendVideo(bool suspend, PacketQueue *vbuffer)
+    {
+        VideoThread *thread = dynamic_cast<VideoThread*>(video_thread);
+        video_suspended = suspend;
+        vbuffer->clear();
+        vbuffer->blockFull(false);
+        vbuffer->enqueue(Packet::createFlush());
+        video_thread->requestSeek();
+        thread->setSuspended(suspend);
+        if (suspend) {
+            if (!suspend_clock_restore)
+                suspend_clock_type = clock->type();
+            suspend_clock_restore = true;
+            if (clock->type() == SyncToVideo)
+                clock->setClockType(audio_thread ? SyncToAudio : SyncToExternalClock);
+            clearSuspendedVideo();
+            AVDebug("Video is suspended.\n");
+            return;
+        }
+        AVDebug("Video is resumed with %d packets kept.\n", FORCE_INT(suspend_gop.size()));
+        if (suspend_gop_valid && !suspend_gop.empty()) {
+            for (std::deque<Packet>::const_iterator it = suspend_gop.begin(); it != suspend_gop.end(); ++it)
+                vbuffer->enqueue(*it);
+        } else if (demuxer->isSeekable() && !timeshift_active) {
+            const double pos = mediaTime(clock->value());
+            DECL_LOCKGUARD(seek_mutex);
+            if (!seek_req) {
+                seek_req = true;
+                seek_pos = pos;
+                seek_incr = 0;
+                seek_type = SeekType(SeekFromStart | SeekKeyFrame);
+            }
+        }
+        clearSuspendedVideo();
+    }
+
+    /* only the packets from the latest key frame are needed to resume */
+    void keepSuspendedVideo(const Packet &pkt)
+    {
+        suspend_pts = pkt.pts;
+        if (pkt.containKeyFrame) {
+            suspend_gop.clear();
+            suspend_gop_bytes = 0;
+            suspend_gop_valid = true;
+        }
+        if (!suspend_gop_valid)
+            return;
+        suspend_gop.push_back(pkt);
+        suspend_gop_bytes += pkt.size;
+        if (suspend_gop_bytes > VIDEO_SUSPEND_GOP_BYTES)
+            clearSuspendedVideo();
+    }
+
+    /* the position in the current demuxer of the timestamp, the media chained before is not reachable */
+    double mediaTime(double pts) const
+    {
+        DECL_LOCKGUARD(offset_mutex);
+        if (time_offset == 0)
+            return pts;
+        return std::max(pts, chain_pts) - time_offset;
+    }
+
+    void clearSuspendedVideo()
+    {
+        suspend_gop.clear();
+        suspend_gop_bytes = 0;
+        suspend_gop_valid = false;
+        suspend_pts = NAN;
+    }
+
+    bool chainNext(Demuxer *&current)
+    {
+        Demuxer *next = nullptr;
+        {
+            DECL_LOCKGUARD(next_mutex);
+            if (!next_demuxer || trick_speed != 0 || external_audio || !views.empty() ||
+                    !compatible(current, next_demuxer))
+                return false;
+            next = next_demuxer;
+            next_demuxer = nullptr;
+            prefetch.swap(next_packets);
+            next_packets.clear();
+        }
+        const double end = isnan(last_end) ? 0 : last_end;
+        {
+            DECL_LOCKGUARD(offset_mutex);
+            prev_offset = time_offset;
+            chain_pts = end;
+            time_offset = end - next->startTimeS();
+        }
+        AVDebug("Chain the next media at %.3f, time offset: %.3f\n", end, time_offset);
+        Demuxer *last = current;
+        current = next;
+        demuxer = next;
+        CALL_BACK(mediaChanged, last, next);
+        return true;
     }
 
     //bool packetsEnough(AVStream* s, PacketQueue* queue)
@@ -56,6 +395,9 @@ public:
 
     Demuxer *demuxer;
     AVThread *audio_thread, *video_thread;
+    ExternalAudioThread *external_audio;
+    /* the video threads of the streams besides the main video */
+    std::map<int, AVThread*> views;
     bool stopped;
     bool paused, last_paused;
     PacketQueue* main_buffer;
@@ -65,6 +407,58 @@ public:
     bool seek_req; 
 	double seek_pos, seek_incr;
 	SeekType seek_type;
+    /* the time of latest seek request, 0 means no seek is waiting for the first frame */
+    int64_t seek_time;
+    SeekStatistics seek_statistics;
+    mutable std::mutex seek_mutex;
+    /* trick play, 0 means normal play, < 0 means rewind */
+    bool trick_req;
+    float trick_speed_req;
+    float trick_speed;
+    ClockType trick_clock_type;
+    double trick_last_pts;
+    double trick_back;
+    bool trick_jump, trick_begin, trick_stall;
+    /* adaptive bitrate */
+    bool abr;
+    int variant_req;
+    AdaptiveBitrate abr_policy;
+    /* timeshift of real-time stream */
+    TimeShiftBuffer timeshift;
+    double timeshift_window;
+    std::string timeshift_file;
+    int64_t timeshift_file_bytes;
+    bool timeshift_active;
+    float catch_up_speed;
+    bool catching_up;
+    Recorder *recorder;
+    mutable std::mutex record_mutex;
+    /* the next media of playlist, and the packets read ahead */
+    Demuxer *next_demuxer;
+    StreamPackets next_packets;
+    StreamPackets prefetch;
+    std::mutex next_mutex;
+    /* added to the timestamps of the media chained, it's prev_offset before chain_pts */
+    double time_offset, prev_offset;
+    double chain_pts;
+    /* written in the demux thread only, read by others with the lock */
+    mutable std::mutex offset_mutex;
+    /* the end of the latest packet */
+    double last_end;
+    bool end_notified;
+    std::function<void(Demuxer *last, Demuxer *next)> mediaChanged;
+    /* the stream of audio/subtitle to switch to, -1 if none */
+    int track_req[MediaTypeNb];
+    std::function<void(MediaType type, int stream)> streamChanged;
+    /* video suspended, the clock type is restored after the video catches up */
+    bool suspend_req, suspend_value;
+    bool video_suspended;
+    ClockType suspend_clock_type;
+    bool suspend_clock_restore;
+    std::deque<Packet> suspend_gop;
+    int64_t suspend_gop_bytes;
+    bool suspend_gop_valid;
+    double suspend_pts;
     AVClock *clock;
     bool eof;   /*Enqueue a eof packet if demuxer is at end*/
     std::mutex wait_mutex;
@@ -125,6 +519,15 @@ void AVDemuxThread::pause(bool p)
 		d->audio_thread->pause(p);
 	if (d->video_thread)
 		d->video_thread->pause(p);
+    for (std::map<int, AVThread*>::const_iterator it = d->views.begin(); it != d->views.end(); ++it)
+        it->second->pause(p);
+    VideoThread *vt = dynamic_cast<VideoThread*>(d->video_thread);
+    const double pts = (!p && vt) ? vt->cachedSeekPosition() : NAN;
+    if (!isnan(pts)) {
+        /* the frame shown is from cache, seek the demuxer to it and continue after it */
+        seek(d->mediaTime(pts) - 0.001, 0, SeekType(SeekFromStart | SeekKeyFrame));
+        vt->setResumeTarget(pts);
+    }
 }
 
 void AVDemuxThread::seek(double pos, double incr, SeekType type)
@@ -136,20 +539,59 @@ void AVDemuxThread::seek(double pos, double incr, SeekType type)
         AVDebug("can not to seek when packets is buffering\n");
         return;
     }
-	if (!d->seek_req) {
-		///* if pos is nan, it indicates that the previous seek operation has not been completed */
-		//if (isnan(pos))
-		//	return;
-		//if (d->clock->type() != SyncToVideo && isnan(d->clock->value(SyncToVideo))) {
-		//	AVDebug("Video seek is not finished.\n");
-		//	return;
-		//}
-		d->seek_req = true;
-		d->seek_pos = pos;
-		d->seek_incr = incr;
-		d->seek_type = type;
-		d->continue_read_cond.notify_one();
-	}
+    VideoThread *vt = dynamic_cast<VideoThread*>(d->video_thread);
+    if (vt)
+        vt->setResumeTarget(NAN);
+    /* scrubbing while paused, the frame is shown from cache without seeking the demuxer */
+    if (vt && d->paused && !isnan(pos) && trickPlaySpeed() == 0 && !d->timeshift_active) {
+        bool pending;
+        {
+            DECL_LOCKGUARD(d->seek_mutex);
+            pending = d->seek_req;
+        }
+        double offset;
+        {
+            DECL_LOCKGUARD(d->offset_mutex);
+            offset = d->time_offset;
+        }
+        /* the frames are cached in the timestamps of the chained media */
+        if (!pending && vt->seekCached(pos + incr + offset)) {
+            DECL_LOCKGUARD(d->seek_mutex);
+            d->seek_statistics.requests++;
+            d->seek_statistics.cached++;
+            return;
+        }
+    }
+    {
+        DECL_LOCKGUARD(d->seek_mutex);
+        /* the latest request wins if the previous one is not handled yet */
+        if (d->seek_req) {
+            d->seek_statistics.coalesced++;
+            if (type & SeekFromNow) {
+                /* accumulate the increment to the pending target */
+                const int from = SeekFromStart | SeekFromNow;
+                d->seek_incr += incr;
+                d->seek_type = SeekType((d->seek_type & from) | (type & ~from));
+            }
+            else {
+                d->seek_pos = pos;
+                d->seek_incr = incr;
+                d->seek_type = type;
+            }
+        }
+        else {
+            d->seek_req = true;
+            d->seek_pos = pos;
+            d->seek_incr = incr;
+            d->seek_type = type;
+        }
+        d->seek_time = av_gettime_relative();
+        d->seek_statistics.requests++;
+        /* interrupt the blocking read, it's useless for the new target */
+        if (d->demuxer && !d->timeshift_active)
+            d->demuxer->setInterruptStatus(1);
+    }
+    d->continue_read_cond.notify_one();
 }
 
 void AVDemuxThread::setDemuxer(Demuxer *demuxer)
@@ -170,10 +612,35 @@ AVThread *AVDemuxThread::audioThread()
     return d->audio_thread;
 }
 
+void AVDemuxThread::setExternalAudio(ExternalAudioThread *thread)
+{
+    DPTR_D(AVDemuxThread);
+    d->external_audio = thread;
+}
+
 void AVDemuxThread::setVideoThread(AVThread *thread)
 {
     DPTR_D(AVDemuxThread);
     d->video_thread = thread;
+    VideoThread *vt = dynamic_cast<VideoThread*>(thread);
+    if (!vt)
+        return;
+    /* in the video thread, decode the frame of the step if it's not cached */
+    vt->setStepMissedCallback([this, vt](bool forward, double pts) {
+        DPTR_D(AVDemuxThread);
+        if (forward) {
+            stepToNextFrame();
+            return;
+        }
+        if (isnan(pts) || d->buffering || !d->demuxer->isSeekable())
+            return;
+        /*
+         * seek to the key frame before current frame, and decode the gop into cache,
+         * then the previous frames are shown from cache without decoding again.
+         */
+        vt->setBackwardTarget(pts);
+        seek(d->mediaTime(pts) - 0.001, 0, SeekType(SeekFromStart | SeekKeyFrame));
+    });
 }
 
 AVThread *AVDemuxThread::videoThread()
@@ -182,6 +649,18 @@ AVThread *AVDemuxThread::videoThread()
     return d->video_thread;
 }
 
+void AVDemuxThread::addVideoView(int stream, AVThread *thread)
+{
+    DPTR_D(AVDemuxThread);
+    d->views[stream] = thread;
+}
+
+void AVDemuxThread::clearVideoViews()
+{
+    DPTR_D(AVDemuxThread);
+    d->views.clear();
+}
+
 void AVDemuxThread::setClock(AVClock *clock)
 {
     d_func()->clock = clock;
@@ -190,6 +669,8 @@ void AVDemuxThread::setClock(AVClock *clock)
 void AVDemuxThread::stepToNextFrame()
 {
 	DPTR_D(AVDemuxThread);
+	if (d->video_suspended)
+		return;
 	pause(false);
 	if (d->video_thread) {
 		VideoThread* thread = dynamic_cast<VideoThread*>(d->video_thread);
@@ -199,6 +680,233 @@ void AVDemuxThread::stepToNextFrame()
 	}
 }
 
+void AVDemuxThread::stepForward()
+{
+	DPTR_D(AVDemuxThread);
+	if (!d->video_thread || d->video_suspended)
+		return;
+	if (!d->paused) {
+		stepToNextFrame();
+		return;
+	}
+	dynamic_cast<VideoThread*>(d->video_thread)->requestStep(true);
+}
+
+void AVDemuxThread::stepBackward()
+{
+	DPTR_D(AVDemuxThread);
+	if (!d->video_thread || d->video_suspended)
+		return;
+	if (!d->paused)
+		pause(true);
+	dynamic_cast<VideoThread*>(d->video_thread)->requestStep(false);
+}
+
+void AVDemuxThread::setTrickPlaySpeed(float speed)
+{
+    DPTR_D(AVDemuxThread);
+    if (!d->video_thread || d->demuxer->hasAttachedPic())
+        return;
+    if (speed < 0 && !d->demuxer->isSeekable())
+        return;
+    /* the packets are read from the timeshift buffer in order */
+    if (d->timeshift_active)
+        return;
+    DECL_LOCKGUARD(d->seek_mutex);
+    if (d->suspend_req ? d->suspend_value : d->video_suspended)
+        return;
+    d->trick_speed_req = speed;
+    d->trick_req = true;
+    d->continue_read_cond.notify_one();
+}
+
+float AVDemuxThread::trickPlaySpeed() const
+{
+    DPTR_D(const AVDemuxThread);
+    return d->trick_req ? d->trick_speed_req : d->trick_speed;
+}
+
+bool AVDemuxThread::setVideoSuspended(bool suspended)
+{
+    DPTR_D(AVDemuxThread);
+    DECL_LOCKGUARD(d->seek_mutex);
+    if (suspended && (d->trick_req ? d->trick_speed_req : d->trick_speed) != 0)
+        return false;
+    d->suspend_req = true;
+    d->suspend_value = suspended;
+    d->continue_read_cond.notify_one();
+    return true;
+}
+
+bool AVDemuxThread::isVideoSuspended() const
+{
+    DPTR_D(const AVDemuxThread);
+    DECL_LOCKGUARD(d->seek_mutex);
+    return d->suspend_req ? d->suspend_value : d->video_suspended;
+}
+
+void AVDemuxThread::setAdaptiveBitrate(bool enable)
+{
+    DPTR_D(AVDemuxThread);
+    d->abr = enable;
+}
+
+bool AVDemuxThread::isAdaptiveBitrate() const
+{
+    DPTR_D(const AVDemuxThread);
+    return d->abr;
+}
+
+void AVDemuxThread::selectVariant(int index)
+{
+    DPTR_D(AVDemuxThread);
+    DECL_LOCKGUARD(d->seek_mutex);
+    d->abr = false;
+    d->variant_req = index;
+}
+
+void AVDemuxThread::setTimeShift(double window, const std::string &file, int64_t file_bytes)
+{
+    DPTR_D(AVDemuxThread);
+    d->timeshift_window = window;
+    d->timeshift_file = file;
+    d->timeshift_file_bytes = file_bytes;
+}
+
+bool AVDemuxThread::isTimeShift() const
+{
+    DPTR_D(const AVDemuxThread);
+    return d->timeshift_active;
+}
+
+bool AVDemuxThread::timeShiftRange(double &start, double &end) const
+{
+    DPTR_D(const AVDemuxThread);
+    if (!d->timeshift_active)
+        return false;
+    start = d->timeshift.startTime();
+    end = d->timeshift.endTime();
+    return !isnan(start) && !isnan(end);
+}
+
+void AVDemuxThread::setCatchUpSpeed(float speed)
+{
+    DPTR_D(AVDemuxThread);
+    d->catch_up_speed = speed;
+}
+
+bool AVDemuxThread::startRecord(const std::string &file, const std::string &format)
+{
+    DPTR_D(AVDemuxThread);
+    if (!d->demuxer || !d->demuxer->formatCtx())
+        return false;
+    std::vector<int> streams;
+    streams.push_back(d->demuxer->streamIndex(MediaTypeVideo));
+    streams.push_back(d->demuxer->streamIndex(MediaTypeAudio));
+    streams.push_back(d->demuxer->streamIndex(MediaTypeSubtitle));
+    const int key_stream = d->demuxer->hasAttachedPic() ? -1 : d->demuxer->streamIndex(MediaTypeVideo);
+    Recorder *recorder = new Recorder();
+    if (!recorder->open(file, format, d->demuxer->formatCtx(), streams, key_stream)) {
+        delete recorder;
+        return false;
+    }
+    recorder->start();
+    Recorder *last = nullptr;
+    {
+        DECL_LOCKGUARD(d->record_mutex);
+        last = d->recorder;
+        d->recorder = recorder;
+    }
+    /* the remaining packets of the previous one are written */
+    delete last;
+    return true;
+}
+
+void AVDemuxThread::stopRecord()
+{
+    DPTR_D(AVDemuxThread);
+    DECL_LOCKGUARD(d->record_mutex);
+    if (d->recorder)
+        d->recorder->requestStop();
+}
+
+bool AVDemuxThread::isRecording() const
+{
+    DPTR_D(const AVDemuxThread);
+    DECL_LOCKGUARD(d->record_mutex);
+    return d->recorder && !d->recorder->isFinished();
+}
+
+void AVDemuxThread::setNextDemuxer(Demuxer *demuxer, const StreamPackets &packets)
+{
+    DPTR_D(AVDemuxThread);
+    DECL_LOCKGUARD(d->next_mutex);
+    d->next_demuxer = demuxer;
+    d->next_packets = packets;
+}
+
+Demuxer *AVDemuxThread::takeNextDemuxer(StreamPackets &packets)
+{
+    DPTR_D(AVDemuxThread);
+    DECL_LOCKGUARD(d->next_mutex);
+    Demuxer *demuxer = d->next_demuxer;
+    packets.swap(d->next_packets);
+    d->next_packets.clear();
+    d->next_demuxer = nullptr;
+    return demuxer;
+}
+
+void AVDemuxThread::setPrefetchedPackets(const StreamPackets &packets)
+{
+    DPTR_D(AVDemuxThread);
+    d->prefetch = packets;
+}
+
+double AVDemuxThread::timeOffset(double pts) const
+{
+    DPTR_D(const AVDemuxThread);
+    DECL_LOCKGUARD(d->offset_mutex);
+    return pts >= d->chain_pts ? d->time_offset : d->prev_offset;
+}
+
+void AVDemuxThread::setMediaChangedCallback(std::function<void(Demuxer *last, Demuxer *next)> f)
+{
+    d_func()->mediaChanged = f;
+}
+
+bool AVDemuxThread::switchTrack(MediaType type, int stream)
+{
+    DPTR_D(AVDemuxThread);
+    if (type == MediaTypeAudio ? !d->audio_thread : (type != MediaTypeSubtitle || !d->video_thread))
+        return false;
+    {
+        DECL_LOCKGUARD(d->seek_mutex);
+        d->track_req[type] = stream;
+    }
+    d->continue_read_cond.notify_one();
+    return true;
+}
+
+void AVDemuxThread::setStreamChangedCallback(std::function<void(MediaType type, int stream)> f)
+{
+    d_func()->streamChanged = f;
+}
+
+SeekStatistics AVDemuxThread::seekStatistics() const
+{
+    DPTR_D(const AVDemuxThread);
+    DECL_LOCKGUARD(d->seek_mutex);
+    return d->seek_statistics;
+}
+
+BufferEstimate AVDemuxThread::bufferEstimate() const
+{
+    DPTR_D(const AVDemuxThread);
+    if (!d->main_buffer)
+        return BufferEstimate();
+    return d->main_buffer->estimate();
+}
+
 void AVDemuxThread::updateBufferStatus()
 {
     DPTR_D(AVDemuxThread);
@@ -240,8 +948,10 @@ void AVDemuxThread::run()
     Packet pkt;
     int ret = -1;
 
+    /* the audio queue is fed and flushed by the external audio thread */
+    ExternalAudioThread *external_audio = d->audio_thread ? d->external_audio : nullptr;
     PacketQueue *vbuffer = d->video_thread ? d->video_thread->packets() : nullptr;
-    PacketQueue *abuffer = d->audio_thread ? d->audio_thread->packets() : nullptr;
+    PacketQueue *abuffer = d->audio_thread && !external_audio ? d->audio_thread->packets() : nullptr;
     PacketQueue *sbuffer = nullptr;
     if (d->video_thread) {
         VideoThread *thread = dynamic_cast<VideoThread*>(d->video_thread);
@@ -251,6 +961,9 @@ void AVDemuxThread::run()
     AVThread* thread = !d->video_thread || (d->audio_thread && demuxer->hasAttachedPic())
         ? d->audio_thread : d->video_thread;
     d->main_buffer = thread->packets();
+    thread->setSeekFinishedCallback([d]() {
+        d->seekFinished();
+    });
 	if (abuffer) {
         abuffer->enqueue(Packet::createFlush());
         //Why set it false before...
@@ -264,14 +977,133 @@ void AVDemuxThread::run()
             sbuffer->enqueue(Packet::createFlush());
         }
     }
+    if (external_audio) {
+        external_audio->setAudioThread(d->audio_thread);
+        external_audio->setSkip(false);
+        external_audio->start();
+    }
     if (d->audio_thread && !d->audio_thread->isRunning()) {
         d->audio_thread->start();
     }
     if (d->video_thread && !d->video_thread->isRunning()) {
         d->video_thread->start();
     }
+    typedef std::map<int, AVThread*>::const_iterator ViewIterator;
+    /* the time of the latest packet of each view */
+    std::map<int, int64_t> view_time;
+    for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it) {
+        view_time[it->first] = av_gettime_relative();
+        it->second->packets()->enqueue(Packet::createFlush());
+        if (!it->second->isRunning())
+            it->second->start();
+    }
     bool audio_has_pic = false;
+    // use || or &&? or do not check whether sbuffer is full? 
+    auto queuesFull = [&]() -> bool {
+        if (d->trick_speed != 0) {
+            /* only video packets are queued in trick play */
+            return vbuffer && vbuffer->checkFull();
+        }
+        if (d->video_suspended) {
+            if (abuffer)
+                return abuffer->checkFull();
+            /* nothing is decoded, read in the pace of the clock */
+            return !isnan(d->suspend_pts) && d->suspend_pts - d->clock->value() > VIDEO_SUSPEND_AHEAD;
+        }
+        const int64_t now = av_gettime_relative();
+        const double main_duration = vbuffer ? vbuffer->duration() : 0;
+        for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it) {
+            PacketQueue *packets = it->second->packets();
+            if (packets->checkFull())
+                continue;
+            /* a quiet or low bitrate view does not make the main queues grow without limit */
+            if (main_duration > 0 && packets->duration() >= main_duration)
+                continue;
+            if ((now - view_time[it->first]) / 1000000.0 > std::max(main_duration, VIEW_IDLE_MIN))
+                continue;
+            return false;
+        }
+        return (!abuffer || (abuffer && abuffer->checkFull())) &&
+            (vbuffer && !audio_has_pic && vbuffer->checkFull())/* ||
+            (sbuffer && sbuffer->checkFull())*/;
+    };
+    auto dispatch = [&](const Packet &packet, int index) {
+        if (index == demuxer->streamIndex(MediaTypeVideo)) {
+            if (vbuffer && d->video_suspended) {
+                d->keepSuspendedVideo(packet);
+            } else if (vbuffer) {
+				vbuffer->blockFull(false);
+                vbuffer->enqueue(packet);
+            }
+        }
+        else if (index == demuxer->streamIndex(MediaTypeAudio)) {
+            if (abuffer) {
+				abuffer->blockFull(false);
+                abuffer->enqueue(packet);
+            }
+        }
+        else if (index == demuxer->streamIndex(MediaTypeSubtitle)) {
+            //if (d->subtitlePacketChanged)
+            //    d->subtitlePacketChanged(&packet);
+            if (sbuffer) {
+                sbuffer->blockFull(false);
+                sbuffer->enqueue(packet);
+            }
+        }
+        else {
+            ViewIterator it = d->views.find(index);
+            if (it != d->views.end()) {
+                view_time[index] = av_gettime_relative();
+                it->second->packets()->blockFull(false);
+                it->second->packets()->enqueue(packet);
+            }
+        }
+    };
+    auto enqueueEOF = [&]() {
+        if (abuffer) {
+            abuffer->enqueue(Packet::createEOF());
+        }
+        if (vbuffer) {
+            vbuffer->enqueue(Packet::createEOF());
+            if (sbuffer)
+                sbuffer->enqueue(Packet::createEOF());
+        }
+        for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it)
+            it->second->packets()->enqueue(Packet::createEOF());
+		d->eof = true;
+		d->clock->setEof(true);
+    };
+    {
+        DECL_LOCKGUARD(d->offset_mutex);
+        d->time_offset = d->prev_offset = d->chain_pts = 0;
+    }
+    d->last_end = NAN;
+    d->end_notified = false;
+    /* record the real-time stream, so it can be paused and rewound */
+    const bool timeshift = d->timeshift_window > 0 && demuxer->isRealTime();
+    d->timeshift_active = timeshift;
+    d->catching_up = false;
+    if (timeshift) {
+        d->timeshift.clear();
+        d->timeshift.setWindow(d->timeshift_window);
+        d->timeshift.setFile(d->timeshift_file, d->timeshift_file_bytes);
+        d->timeshift.setKeyStream(demuxer->streamIndex(demuxer->stream(MediaTypeVideo) ? MediaTypeVideo : MediaTypeAudio));
+    }
+    {
+        /* the video of the new media is suspended too */
+        DECL_LOCKGUARD(d->seek_mutex);
+        if (d->video_suspended && !d->suspend_req) {
+            d->suspend_req = true;
+            d->suspend_value = true;
+        }
+        d->video_suspended = false;
+        d->suspend_clock_restore = false;
+        d->clearSuspendedVideo();
+    }
     d->stopped = false;
+    /* start from the lowest variant, so the first frame is shown quickly */
+    if (d->abr)
+        d->abr_policy.start(demuxer, av_gettime_relative());
 
     while (true) {
         if (d->stopped)
@@ -279,9 +1111,87 @@ void AVDemuxThread::run()
         //if (d->paused) {
         //    continue;
         //}
+        if (d->trick_req) {
+            const float last_speed = d->trick_speed;
+            {
+                DECL_LOCKGUARD(d->seek_mutex);
+                d->trick_speed = d->trick_speed_req;
+                d->trick_req = false;
+                /* restart from current position, the packets of different modes can not be mixed */
+                if (!d->seek_req) {
+                    d->seek_req = true;
+                    d->seek_pos = d->mediaTime(d->clock->value());
+                    d->seek_incr = 0;
+                    d->seek_type = SeekType(SeekFromStart | SeekKeyFrame);
+                }
+            }
+            if (external_audio)
+                external_audio->setSkip(d->trick_speed != 0);
+            /* the audio is skipped in trick play, so follow the video clock */
+            if (last_speed == 0 && d->trick_speed != 0) {
+                d->trick_clock_type = d->clock->type();
+                d->clock->setClockType(SyncToVideo);
+            } else if (last_speed != 0 && d->trick_speed == 0) {
+                d->clock->setClockType(d->trick_clock_type);
+            }
+            d->resetTrickPlay();
+            dynamic_cast<VideoThread*>(d->video_thread)->setTrickPlaySpeed(d->trick_speed);
+        }
+        if (d->suspend_req) {
+            bool suspend;
+            {
+                DECL_LOCKGUARD(d->seek_mutex);
+                suspend = d->suspend_value;
+                d->suspend_req = false;
+            }
+            if (vbuffer && suspend != d->video_suspended)
+                d->suspendVideo(suspend, vbuffer);
+        }
+        if (d->suspend_clock_restore && !d->video_suspended &&
+                !dynamic_cast<VideoThread*>(d->video_thread)->isResyncing()) {
+            d->clock->setClockType(d->suspend_clock_type);
+            d->suspend_clock_restore = false;
+        }
         if (d->seek_req) {
-            d->demuxer->setSeekType(d->seek_type);
-            if (d->demuxer->seek(d->seek_pos, d->seek_incr)) {
+            double seek_pos, seek_incr;
+            SeekType seek_type;
+            {
+                /* the request arrived during seeking will be handled in next loop */
+                DECL_LOCKGUARD(d->seek_mutex);
+                seek_pos = d->seek_pos;
+                seek_incr = d->seek_incr;
+                seek_type = d->seek_type;
+                d->seek_req = false;
+                d->demuxer->setInterruptStatus(0);
+            }
+            bool seeked = false;
+            if (timeshift) {
+                const double target = (isnan(seek_pos) ? d->timeshift.position() : seek_pos) + seek_incr;
+                if (target >= d->timeshift.endTime()) {
+                    d->timeshift.seekToLive();
+                    seeked = true;
+                } else {
+                    seeked = d->timeshift.seek(target);
+                }
+            } else {
+                d->demuxer->setSeekType(seek_type);
+                seeked = d->demuxer->seek(seek_pos, seek_incr);
+            }
+            if (seeked && !timeshift) {
+                d->recordDiscontinuity();
+                /* read ahead from the beginning, and the previous media is not reachable */
+                d->prefetch.clear();
+                {
+                    DECL_LOCKGUARD(d->offset_mutex);
+                    d->prev_offset = d->time_offset;
+                }
+                d->last_end = NAN;
+                if (external_audio)
+                    external_audio->seek((isnan(seek_pos) ? d->clock->value() : seek_pos) + seek_incr);
+            }
+            if (!seeked && d->video_thread)
+                dynamic_cast<VideoThread*>(d->video_thread)->cancelCachedSeek();
+            if (seeked) {
                 if (abuffer) {
                     abuffer->clear();
                     abuffer->enqueue(Packet::createFlush());
@@ -293,15 +1203,46 @@ void AVDemuxThread::run()
                     if (sbuffer)
                         sbuffer->enqueue(Packet::createFlush());
                     d->video_thread->requestSeek();
+                    d->clearSuspendedVideo();
+                }
+                for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it) {
+                    it->second->packets()->clear();
+                    it->second->packets()->enqueue(Packet::createFlush());
+                    it->second->requestSeek();
                 }
             }
-            d->seek_req = false;
             d->eof = false;
 			d->clock->setEof(false);
-            if (d->paused) {
+            d->resetTrickPlay();
+            /* no frame is shown to pause again when the video is suspended */
+            if (d->paused && !d->video_suspended) {
 				stepToNextFrame();
             }
         }
+        if (d->variant_req >= 0) {
+            int index;
+            {
+                DECL_LOCKGUARD(d->seek_mutex);
+                index = d->variant_req;
+                d->variant_req = -1;
+            }
+            demuxer->selectVariant(index);
+        } else if (d->abr) {
+            d->updateVariant();
+        }
+        if (d->track_req[MediaTypeAudio] >= 0 || d->track_req[MediaTypeSubtitle] >= 0) {
+            int audio, subtitle;
+            {
+                DECL_LOCKGUARD(d->seek_mutex);
+                audio = d->track_req[MediaTypeAudio];
+                subtitle = d->track_req[MediaTypeSubtitle];
+                d->track_req[MediaTypeAudio] = d->track_req[MediaTypeSubtitle] = -1;
+            }
+            if (audio >= 0)
+                d->switchTrack(MediaTypeAudio, audio, abuffer);
+            if (subtitle >= 0)
+                d->switchTrack(MediaTypeSubtitle, subtitle, sbuffer);
+        }
         /* pause if is buffering*/
         if (d->demuxer->isRealTime()) {
             if (d->buffering) {
@@ -310,40 +1251,103 @@ void AVDemuxThread::run()
                         d->audio_thread->pause(true);
                     if (d->video_thread)
                         d->video_thread->pause(true);
+                    for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it)
+                        it->second->pause(true);
                 }
             } else {
                 if (d->audio_thread)
                     d->audio_thread->pause(d->last_paused);
                 if (d->video_thread)
                     d->video_thread->pause(d->last_paused);
+                for (ViewIterator it = d->views.begin(); it != d->views.end(); ++it)
+                    it->second->pause(d->last_paused);
+            }
+        }
+        /* jump back to the previous key frame for rewind */
+        if (d->trick_speed < 0 && (d->trick_jump || d->trick_stall)) {
+            if (d->trick_stall) {
+                std::unique_lock<std::mutex> lock(d->wait_mutex);
+                d->continue_read_cond.wait_for(lock, std::chrono::milliseconds(10));
+                continue;
             }
+            const double start = demuxer->startTimeS();
+            /* trick_last_pts is shifted if chained, but the demuxer is seeked in its own time */
+            const double target = d->mediaTime(d->trick_last_pts) - d->trick_back;
+            d->trick_begin = target <= start;
+            demuxer->setSeekType(SeekType(SeekFromStart | SeekKeyFrame));
+            demuxer->seek(std::max(target, start), 0);
+            d->recordDiscontinuity();
+            d->trick_jump = false;
         }
         audio_has_pic = demuxer->hasAttachedPic();
-        // use || or &&? or do not check whether sbuffer is full? 
-		if ( (!abuffer || (abuffer && abuffer->checkFull())) &&
-            (vbuffer && !audio_has_pic && vbuffer->checkFull())/* ||
-            (sbuffer && sbuffer->checkFull())*/ ) {
+        bool full = queuesFull();
+		if (full && !timeshift) {
 			/* wait 10 ms */
 			std::unique_lock<std::mutex> lock(d->wait_mutex);
 			d->continue_read_cond.wait_for(lock, std::chrono::milliseconds(10));
 			continue;
 		}
-        ret = demuxer->readFrame();
+        /* the packets read ahead by preload are used first */
+        if (!d->prefetch.empty()) {
+            pkt = d->prefetch.front().first;
+            stream = d->prefetch.front().second;
+            d->prefetch.pop_front();
+            ret = 0;
+        } else {
+            ret = demuxer->readFrame();
+            if (ret >= 0) {
+                pkt = demuxer->packet();
+                stream = demuxer->stream();
+            }
+        }
         if (ret == 999) {
             continue;
         }
+        /* interrupted by a new seek request */
+        if (ret == AVERROR_EXIT && d->seek_req) {
+            continue;
+        }
+        if (ret >= 0)
+            d->applyTimeOffset(pkt, stream);
+        /* record what is received, before trick play and timeshift */
+        if (ret >= 0)
+            d->record(pkt, stream);
+        if (timeshift) {
+            /* the input is recorded even if the queues are full, and played from the cursor */
+            if (ret >= 0)
+                d->timeshift.append(pkt, stream);
+            bool fed = false;
+            while (!full && d->timeshift.read(pkt, stream)) {
+                dispatch(pkt, stream);
+                full = queuesFull();
+                fed = true;
+            }
+            if (fed && d->eof) {
+                d->eof = false;
+                d->clock->setEof(false);
+            }
+            if (ret == AVERROR_EOF && !d->eof && d->timeshift.isLive())
+                enqueueEOF();
+            d->updateCatchUp();
+            if (ret < 0) {
+                std::unique_lock<std::mutex> lock(d->wait_mutex);
+                d->continue_read_cond.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            this->updateBufferStatus();
+            continue;
+        }
         if (ret < 0) {
             if (ret == AVERROR_EOF && !d->eof) {
-                if (abuffer) {
-                    abuffer->enqueue(Packet::createEOF());
-                }
-                if (vbuffer) {
-                    vbuffer->enqueue(Packet::createEOF());
-                    if (sbuffer)
-                        sbuffer->enqueue(Packet::createEOF());
-                }
-				d->eof = true;
-				d->clock->setEof(true);
+                /* continue with the next media in the same queues, so there is no gap */
+                if (d->chainNext(demuxer))
+                    continue;
+                enqueueEOF();
+            }
+            /* all the packets are consumed */
+            if (d->eof && !d->end_notified &&
+                    (!abuffer || abuffer->size() == 0) && (!vbuffer || vbuffer->size() == 0)) {
+                d->end_notified = true;
+                CALL_BACK(d->mediaStatusChanged, End);
             }
             std::unique_lock<std::mutex> lock(d->wait_mutex);
             d->continue_read_cond.wait_for(lock, std::chrono::milliseconds(10));
@@ -351,32 +1355,27 @@ void AVDemuxThread::run()
         } else {
 			d->eof = false;
 			d->clock->setEof(false);
+            d->end_notified = false;
         }
-        stream = demuxer->stream();
-        pkt = demuxer->packet();
-
-        if (stream == demuxer->streamIndex(MediaTypeVideo)) {
-            if (vbuffer) {
-				vbuffer->blockFull(false);
-                vbuffer->enqueue(pkt);
-            }
-        }
-        else if (stream == demuxer->streamIndex(MediaTypeAudio)) {
-            if (abuffer) {
-				abuffer->blockFull(false);
-                abuffer->enqueue(pkt);
-            }
-        }
-        else if (stream == demuxer->streamIndex(MediaTypeSubtitle)) {
-            //if (d->subtitlePacketChanged)
-            //    d->subtitlePacketChanged(&pkt);
-            if (sbuffer) {
-                sbuffer->blockFull(false);
-                sbuffer->enqueue(pkt);
-            }
+        if (d->trick_speed != 0) {
+            if (stream != demuxer->streamIndex(MediaTypeVideo) || !d->acceptTrickPacket(pkt))
+                continue;
         }
+        dispatch(pkt, stream);
         this->updateBufferStatus();
     }
+    if (d->catching_up && d->clock->speed() == d->catch_up_speed)
+        d->clock->setSpeed(1.0f);
+    d->catching_up = false;
+    d->timeshift_active = false;
+    d->prefetch.clear();
+    if (external_audio)
+        external_audio->stop();
+    {
+        DECL_LOCKGUARD(d->record_mutex);
+        if (d->recorder)
+            d->recorder->finish();
+    }
     d->stopped = true;
     CThread::run();
 }
@@ -2,13 +2,22 @@
 #define AVDEMUXTHREAD_H
 
 #include "CThread.h"
+#include "Packet.h"
+#include <deque>
+#include <map>
+
+/* trick play is used if speed is out of the range */
+#define TRICK_PLAY_SPEED_MIN 4.0f
+#define TRICK_PLAY_SPEED_MAX 32.0f
 
 NAMESPACE_BEGIN
 
-class Packet;
+typedef std::deque<std::pair<Packet, int> > StreamPackets;
+
 class AVClock;
 class AVThread;
 class Demuxer;
+class ExternalAudioThread;
 class AVDemuxThreadPrivate;
 class AVDemuxThread: public CThread
 {
@@ -19,20 +28,115 @@ public:
 
     void stop() PU_DECL_OVERRIDE;
     void pause(bool p);
+    /**
+     * @brief seek requests are coalesced, the latest target wins
+     */
     void seek(double pos, double rel, SeekType type);
+    SeekStatistics seekStatistics() const;
+    BufferEstimate bufferEstimate() const;
+    /**
+     * @brief only the key frames are decoded and audio is skipped in trick play,
+     * 0 to exit, and the speed < 0 means rewind
+     */
+    void setTrickPlaySpeed(float speed);
+    float trickPlaySpeed() const;
+    /**
+     * @brief switch the variants of HLS/DASH by the measured throughput,
+     * the demuxer must measure the throughput
+     */
+    void setAdaptiveBitrate(bool enable);
+    bool isAdaptiveBitrate() const;
+    /**
+     * @brief switch to the variant at the next segment, the adaptive bitrate is disabled
+     */
+    void selectVariant(int index);
+    /**
+     * @brief record the real-time stream in a ring of window seconds, the older
+     * packets are moved to the file if it's set. Should be called before start
+     */
+    void setTimeShift(double window, const std::string &file, int64_t file_bytes);
+    bool isTimeShift() const;
+    bool timeShiftRange(double &start, double &end) const;
+    /**
+     * @brief the speed to catch up the live edge, <= 1 means no catch up
+     */
+    void setCatchUpSpeed(float speed);
+    /**
+     * @brief record the input packets to the file without transcoding, the
+     * recording starts at the next key frame. The previous one is finished
+     */
+    bool startRecord(const std::string &file, const std::string &format);
+    /**
+     * @brief the recording stops at the next key frame
+     */
+    void stopRecord();
+    bool isRecording() const;
+    /**
+     * @brief the next media is played in the same queues without a gap when
+     * the current one is at end, if the decoders can be used by both.
+     * The packets are read ahead, they are used before reading the demuxer
+     */
+    void setNextDemuxer(Demuxer *demuxer, const StreamPackets &packets);
+    /**
+     * @brief nullptr if the next media is chained already
+     */
+    Demuxer *takeNextDemuxer(StreamPackets &packets);
+    void setPrefetchedPackets(const StreamPackets &packets);
+    /**
+     * @brief the offset added to the timestamps of the media chained, the
+     * timestamp is of the clock
+     */
+    double timeOffset(double pts) const;
+    /**
+     * @brief switch the audio/subtitle stream at the current position without
+     * seek, only the queue of the type is flushed
+     */
+    bool switchTrack(MediaType type, int stream);
     void setDemuxer(Demuxer *demuxer);
     void setAudioThread(AVThread *thread);
     AVThread *audioThread();
+    /**
+     * @brief the audio thread is fed by the external audio instead of the
+     * audio of the demuxer, nullptr to use the demuxer. Should be called before start
+     */
+    void setExternalAudio(ExternalAudioThread *thread);
     void setVideoThread(AVThread *thread);
     AVThread *videoThread();
+    /**
+     * @brief the packets of the stream are sent to the thread besides the
+     * main video, they are flushed and paused together. Should be called before start
+     */
+    void addVideoView(int stream, AVThread *thread);
+    void clearVideoViews();
+    /**
+     * @brief stop decoding the video, e.g. no renderer is visible. The packets
+     * from the latest key frame are kept, and decoded to catch up when resumed.
+     * It's not available in trick play, and it's kept for the next media
+     */
+    bool setVideoSuspended(bool suspended);
+    bool isVideoSuspended() const;
     void setClock(AVClock *clock);
 	void stepToNextFrame();
+    /**
+     * @brief step one frame when paused, the decoded frames are cached
+     * so stepping backward only decodes the gop once
+     */
+    void stepForward();
+    void stepBackward();
     void updateBufferStatus();
 
     /*Callback*/
     void setMediaStatusChangedCB(std::function<void(MediaStatus s)> f);
     void setBufferProcessChangedCB(std::function<void(float p)> f);
     void setSubtitlePacketCallback(std::function<void(Packet* )> f);
+    /**
+     * @brief called in the demux thread when the next media is chained
+     */
+    void setMediaChangedCallback(std::function<void(Demuxer *last, Demuxer *next)> f);
+    /**
+     * @brief called in the demux thread when the track is switched
+     */
+    void setStreamChangedCallback(std::function<void(MediaType type, int stream)> f);
 
 protected:
     void run() PU_DECL_OVERRIDE;
@@ -0,0 +1,75 @@
+#include "AdaptiveBitrate.h"
+#include "Demuxer.h"
+#include "AVLog.h"
+#include "utils/innermath.h"
+
+NAMESPACE_BEGIN
+
+class AdaptiveBitratePrivate
+{
+public:
+    AdaptiveBitratePrivate():
+        check_time(0),
+        switch_time(0)
+    {
+
+    }
+
+    int64_t check_time, switch_time;
+};
+
+AdaptiveBitrate::AdaptiveBitrate():
+    d_ptr(new AdaptiveBitratePrivate)
+{
+
+}
+
+AdaptiveBitrate::~AdaptiveBitrate()
+{
+
+}
+
+void AdaptiveBitrate::start(Demuxer *demuxer, int64_t now)
+{
+    DPTR_D(AdaptiveBitrate);
+    d->check_time = 0;
+    if (demuxer->variants().empty())
+        return;
+    demuxer->selectVariant(0);
+    d->switch_time = now;
+}
+
+bool AdaptiveBitrate::update(Demuxer *demuxer, bool buffer_enough, int64_t now)
+{
+    DPTR_D(AdaptiveBitrate);
+    const std::vector<VariantInfo> &variants = demuxer->variants();
+    if (variants.empty() || demuxer->isSwitchingVariant())
+        return false;
+    if (now - d->check_time < ABR_CHECK_INTERVAL)
+        return false;
+    d->check_time = now;
+    const double bw = demuxer->throughput();
+    if (bw <= 0)
+        return false;
+    int wanted = 0;
+    for (size_t i = 0; i < variants.size(); ++i) {
+        if (variants[i].bitrate <= bw * ABR_SAFETY_FACTOR)
+            wanted = FORCE_INT(i);
+    }
+    const int current = demuxer->variant();
+    if (wanted == current)
+        return false;
+    if (wanted > current) {
+        if (!buffer_enough)
+            return false;
+        if (now - d->switch_time < ABR_UP_INTERVAL)
+            return false;
+    }
+    AVDebug("ABR: throughput %.0f bps, switch variant %d -> %d\n", bw, current, wanted);
+    if (!demuxer->selectVariant(wanted))
+        return false;
+    d->switch_time = now;
+    return true;
+}
+
+NAMESPACE_END
@@ -0,0 +1,46 @@
+#ifndef ADAPTIVEBITRATE_H
+#define ADAPTIVEBITRATE_H
+
+#include "sdk/global.h"
+#include "sdk/DPTR.h"
+
+/* the variant is checked every second, and switched up at most once in ABR_UP_INTERVAL seconds */
+#define ABR_CHECK_INTERVAL 1000000
+#define ABR_UP_INTERVAL 5000000
+/* the part of the throughput can be used by the bitrate */
+#define ABR_SAFETY_FACTOR 0.8
+
+NAMESPACE_BEGIN
+
+class Demuxer;
+/**
+ * @brief The AdaptiveBitrate class
+ * Selects the variant of HLS/DASH by the throughput measured by the demuxer.
+ * It switches down as soon as the throughput drops, and up only if the buffer
+ * is enough and the last switch is ABR_UP_INTERVAL ago. The time is in
+ * microseconds of av_gettime_relative().
+ */
+class AdaptiveBitratePrivate;
+class AdaptiveBitrate
+{
+    DPTR_DECLARE_PRIVATE(AdaptiveBitrate)
+public:
+    AdaptiveBitrate();
+    ~AdaptiveBitrate();
+
+    /**
+     * @brief select the lowest variant, so the first frame is shown quickly
+     */
+    void start(Demuxer *demuxer, int64_t now);
+    /**
+     * @brief select the variant for the throughput, true if a switch is started
+     * @param buffer_enough the main queue has the buffer wanted, and it's not buffering
+     */
+    bool update(Demuxer *demuxer, bool buffer_enough, int64_t now);
+
+private:
+    DPTR_DECLARE(AdaptiveBitrate)
+};
+
+NAMESPACE_END
+#endif //ADAPTIVEBITRATE_H
@@ -9,7 +9,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <deque>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,12 +22,18 @@ extern "C" {
 #include "libavutil/avutil.h"
 #include "libavutil/display.h"
 #include "libavutil/log.h"
+#include "libavutil/time.h"
 #ifdef __cplusplus
 }
 #endif
 
 NAMESPACE_BEGIN
 
+/* a throughput sample is taken every 256KB read */
+#define THROUGHPUT_SAMPLE_BYTES (256 * 1024)
+/* the packets kept for each alternate track, about 20 seconds of a 192kbps audio */
+#define TRACK_WINDOW_BYTES_DEFAULT (512 * 1024)
+
 class InterruptHandler
 {
 public:
@@ -51,11 +61,11 @@ public:
     Action action() const {return curAction;}
     void begin(Action action)
     {
-
+        curAction = action;
     }
     void end()
     {
-
+        curAction = None;
     }
     void setStatus(int s) { status = s; }
     void setInterruptTimeout(int64_t t) { timeout = t;}
@@ -75,6 +85,9 @@ public:
             case FindStream:
                 break;
             case ReadStream:
+                /* status > 0 means that a new seek is required, the pending read is useless */
+                if (handler->status > 0)
+                    return 1;
                 break;
             default:
                 break;
@@ -83,13 +96,33 @@ public:
     }
 
 private:
-	int status;
+    /* set by the player thread, read in the callback of the demux thread */
+	std::atomic<int> status;
     int64_t timeout;
     Action curAction;
     AVIOInterruptCB *interruptCB;
     Demuxer *demuxer;
 };
 
+/* the latest packets of an audio/subtitle track not selected */
+typedef struct TrackWindow {
+    std::deque<Packet> packets;
+    int64_t bytes;
+    TrackWindow(): bytes(0) {}
+} TrackWindow;
+
+template<class T>
+static T *findTrack(std::list<T> &tracks, int stream, int &track)
+{
+    track = 0;
+    for (typename std::list<T>::iterator it = tracks.begin(); it != tracks.end(); ++it, ++track) {
+        if (it->stream == stream)
+            return &(*it);
+    }
+    track = -1;
+    return nullptr;
+}
+
 class DemuxerPrivate
 {
 public:
@@ -110,9 +143,25 @@ public:
         interrupt_handler(nullptr),
         show_status(false),
 		seek_pos(0),
-        media_io(nullptr)
+        media_io(nullptr),
+        variant(-1),
+        pending_variant(-1),
+        measure(false),
+        io_open_default(nullptr),
+        io_close_default(nullptr),
+        io_closed_bytes(0),
+        read_bytes(0),
+        read_time(0),
+        bw_fast(0),
+        bw_slow(0),
+        bw_samples(0),
+        track_window_bytes(TRACK_WINDOW_BYTES_DEFAULT),
+        tracks_changed(false),
+        switched_variant(-1)
     {
         memset(stream_index, -1, sizeof(stream_index));
+        memset(switched_stream, -1, sizeof(switched_stream));
+        memset(pending_stream, -1, sizeof(pending_stream));
         audio_enabled = video_enabled = subtitle_enabled = true;
 #if FFMPEG_MODULE_CHECK(LIBAVFORMAT, 58, 9, 100)
         void *opaque = nullptr;
@@ -146,6 +195,25 @@ public:
     bool isRealTime();
     bool isSeekable();
 
+    void initVariants();
+    void discardVariants();
+    bool switchVariant(const AVPacket *pkt);
+    int64_t bytesRead();
+    void updateThroughput(int64_t bytes, int64_t time);
+    void publishTracks();
+    void keepAlternate(const AVPacket *pkt);
+    bool isView(int index) const
+    {
+        return std::find(view_streams.begin(), view_streams.end(), index) != view_streams.end();
+    }
+
+    static int ioOpen(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options);
+#if LIBAVFORMAT_VERSION_MAJOR >= 60
+    static int ioClose(AVFormatContext *s, AVIOContext *pb);
+#else
+    static void ioClose(AVFormatContext *s, AVIOContext *pb);
+#endif
+
 public:
     int stream_index[AVMEDIA_TYPE_NB];
     AVPacket *avpkt;
@@ -179,6 +247,40 @@ public:
 
     /* media io */
     MediaIO *media_io;
+
+    /* HLS/DASH variants */
+    std::vector<VariantInfo> variants;
+    int variant;
+    int pending_variant;
+    int pending_stream[AVMEDIA_TYPE_NB];
+    /* the timestamp of the latest packet read for each type, to find the switch point */
+    double last_pts[AVMEDIA_TYPE_NB];
+
+    /* throughput of the io layer, only the time spent in reading is counted */
+    bool measure;
+    int (*io_open_default)(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options);
+#if LIBAVFORMAT_VERSION_MAJOR >= 60
+    int (*io_close_default)(AVFormatContext *s, AVIOContext *pb);
+#else
+    void (*io_close_default)(AVFormatContext *s, AVIOContext *pb);
+#endif
+    std::set<AVIOContext*> ios;
+    int64_t io_closed_bytes;
+    int64_t read_bytes, read_time;
+    double bw_fast, bw_slow;
+    int bw_samples;
+    mutable std::mutex io_mutex;
+
+    /* the alternate tracks of each stream index, so that the switch starts at the current position */
+    int64_t track_window_bytes;
+    std::map<int, TrackWindow> track_windows;
+    /* the video streams of the views besides stream_index[AVMEDIA_TYPE_VIDEO] */
+    std::vector<int> view_streams;
+    /* the tracks and variant switched in the demux thread, not applied to media info yet */
+    std::mutex track_mutex;
+    bool tracks_changed;
+    int switched_stream[AVMEDIA_TYPE_NB];
+    int switched_variant;
 };
 
 void DemuxerPrivate::prepareStreams()
@@ -253,6 +355,209 @@ bool DemuxerPrivate::isSeekable()
     return flag;
 }
 
+void DemuxerPrivate::initVariants()
+{
+    variants.clear();
+    variant = pending_variant = -1;
+    memset(pending_stream, -1, sizeof(pending_stream));
+    for (int i = 0; i < AVMEDIA_TYPE_NB; ++i)
+        last_pts[i] = NAN;
+
+    /* HLS: a program for each variant */
+    if (format_ctx->nb_programs > 1) {
+        for (unsigned int i = 0; i < format_ctx->nb_programs; ++i) {
+            AVProgram *program = format_ctx->programs[i];
+            VariantInfo v;
+            v.program = FORCE_INT(i);
+            v.video_stream = v.audio_stream = -1;
+            v.bitrate = 0;
+            v.width = v.height = 0;
+            for (unsigned int j = 0; j < program->nb_stream_indexes; ++j) {
+                const int index = FORCE_INT(program->stream_index[j]);
+                AVStream *st = format_ctx->streams[index];
+                if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && v.video_stream < 0) {
+                    v.video_stream = index;
+                    v.width = st->codecpar->width;
+                    v.height = st->codecpar->height;
+                    v.bitrate += st->codecpar->bit_rate;
+                } else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && v.audio_stream < 0) {
+                    v.audio_stream = index;
+                    v.bitrate += st->codecpar->bit_rate;
+                }
+            }
+            AVDictionaryEntry *e = av_dict_get(program->metadata, "variant_bitrate", nullptr, 0);
+            if (e)
+                v.bitrate = strtoll(e->value, nullptr, 10);
+            if (v.video_stream >= 0 || v.audio_stream >= 0)
+                variants.push_back(v);
+        }
+    } else {
+        /* DASH: a stream for each representation */
+        for (unsigned int i = 0; i < format_ctx->nb_streams; ++i) {
+            AVStream *st = format_ctx->streams[i];
+            AVDictionaryEntry *e = av_dict_get(st->metadata, "variant_bitrate", nullptr, 0);
+            if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO || !e)
+                continue;
+            VariantInfo v;
+            v.program = -1;
+            v.video_stream = FORCE_INT(i);
+            v.audio_stream = -1;
+            v.bitrate = strtoll(e->value, nullptr, 10);
+            v.width = st->codecpar->width;
+            v.height = st->codecpar->height;
+            variants.push_back(v);
+        }
+    }
+    if (variants.size() < 2) {
+        variants.clear();
+        return;
+    }
+    std::stable_sort(variants.begin(), variants.end(), [](const VariantInfo &a, const VariantInfo &b) {
+        return a.bitrate < b.bitrate;
+    });
+    for (size_t i = 0; i < variants.size(); ++i) {
+        const VariantInfo &v = variants[i];
+        if (stream_index[AVMEDIA_TYPE_VIDEO] >= 0 ?
+                v.video_stream == stream_index[AVMEDIA_TYPE_VIDEO] :
+                v.audio_stream == stream_index[AVMEDIA_TYPE_AUDIO]) {
+            variant = FORCE_INT(i);
+            break;
+        }
+    }
+    if (variant < 0) {
+        variants.clear();
+        return;
+    }
+    discardVariants();
+}
+
+void DemuxerPrivate::discardVariants()
+{
+    /* a stream can be shared by several variants, e.g. the audio rendition of HLS */
+    std::set<int> used;
+    for (int i = 0; i < AVMEDIA_TYPE_NB; ++i) {
+        if (stream_index[i] >= 0)
+            used.insert(stream_index[i]);
+        if (pending_stream[i] >= 0)
+            used.insert(pending_stream[i]);
+    }
+    used.insert(view_streams.begin(), view_streams.end());
+    for (size_t i = 0; i < variants.size(); ++i) {
+        const int streams[] = { variants[i].video_stream, variants[i].audio_stream };
+        for (int j = 0; j < 2; ++j) {
+            if (streams[j] < 0)
+                continue;
+            format_ctx->streams[streams[j]]->discard = used.count(streams[j]) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+    }
+}
+
+bool DemuxerPrivate::switchVariant(const AVPacket *pkt)
+{
+    const AVMediaType types[] = { AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO };
+    for (int i = 0; i < 2; ++i) {
+        const AVMediaType type = types[i];
+        if (pending_stream[type] != pkt->stream_index)
+            continue;
+        AVStream *st = format_ctx->streams[pkt->stream_index];
+        const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        const double pts = ts == AV_NOPTS_VALUE ? NAN : ts * av_q2d(st->time_base);
+        /* continue from the current stream, the first packet must be decodable alone */
+        if (!(pkt->flags & AV_PKT_FLAG_KEY) || (!isnan(last_pts[type]) && !(pts > last_pts[type])))
+            return false;
+        AVDebug("Switch %s stream %d -> %d at %.3f\n", av_get_media_type_string(type), stream_index[type], pkt->stream_index, pts);
+        stream_index[type] = pkt->stream_index;
+        pending_stream[type] = -1;
+        if (pending_stream[AVMEDIA_TYPE_VIDEO] < 0 && pending_stream[AVMEDIA_TYPE_AUDIO] < 0) {
+            variant = pending_variant;
+            pending_variant = -1;
+            discardVariants();
+        }
+        publishTracks();
+        return true;
+    }
+    return false;
+}
+
+void DemuxerPrivate::publishTracks()
+{
+    /* the media info is read by the renderers, it's updated by applyTrackChanges() in the player thread */
+    DECL_LOCKGUARD(track_mutex);
+    memcpy(switched_stream, stream_index, sizeof(switched_stream));
+    switched_variant = variant;
+    tracks_changed = true;
+}
+
+void DemuxerPrivate::keepAlternate(const AVPacket *pkt)
+{
+    AVStream *st = format_ctx->streams[pkt->stream_index];
+    const AVMediaType type = st->codecpar->codec_type;
+    /* no decoder for the type disabled */
+    if ((type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_SUBTITLE) || stream_index[type] < 0)
+        return;
+    TrackWindow &window = track_windows[pkt->stream_index];
+    window.packets.push_back(Packet::fromAVPacket(pkt, av_q2d(st->time_base)));
+    window.bytes += pkt->size;
+    while (window.bytes > track_window_bytes && window.packets.size() > 1) {
+        window.bytes -= window.packets.front().size;
+        window.packets.pop_front();
+    }
+}
+
+int64_t DemuxerPrivate::bytesRead()
+{
+    DECL_LOCKGUARD(io_mutex);
+    int64_t bytes = io_closed_bytes;
+    for (std::set<AVIOContext*>::const_iterator it = ios.begin(); it != ios.end(); ++it)
+        bytes += (*it)->bytes_read;
+    return bytes;
+}
+
+void DemuxerPrivate::updateThroughput(int64_t bytes, int64_t time)
+{
+    read_bytes += bytes;
+    read_time += time;
+    if (read_bytes < THROUGHPUT_SAMPLE_BYTES || read_time <= 0)
+        return;
+    const double bw = read_bytes * 8.0 * 1000000.0 / read_time;
+    read_bytes = read_time = 0;
+    DECL_LOCKGUARD(io_mutex);
+    /* the fast one follows the drop quickly, and the slow one keeps the estimate stable */
+    bw_fast = bw_samples ? bw_fast * 0.5 + bw * 0.5 : bw;
+    bw_slow = bw_samples ? bw_slow * 0.9 + bw * 0.1 : bw;
+    bw_samples++;
+}
+
+int DemuxerPrivate::ioOpen(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options)
+{
+    DemuxerPrivate *d = static_cast<DemuxerPrivate*>(s->opaque);
+    const int ret = d->io_open_default(s, pb, url, flags, options);
+    if (ret >= 0 && *pb) {
+        DECL_LOCKGUARD(d->io_mutex);
+        d->ios.insert(*pb);
+    }
+    return ret;
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 60
+int DemuxerPrivate::ioClose(AVFormatContext *s, AVIOContext *pb)
+#else
+void DemuxerPrivate::ioClose(AVFormatContext *s, AVIOContext *pb)
+#endif
+{
+    DemuxerPrivate *d = static_cast<DemuxerPrivate*>(s->opaque);
+    {
+        DECL_LOCKGUARD(d->io_mutex);
+        if (pb && d->ios.erase(pb))
+            d->io_closed_bytes += pb->bytes_read;
+    }
+#if LIBAVFORMAT_VERSION_MAJOR >= 60
+    return d->io_close_default(s, pb);
+#else
+    d->io_close_default(s, pb);
+#endif
+}
+
 Demuxer::Demuxer():
     d_ptr(new DemuxerPrivate)
 {
@@ -320,6 +625,167 @@ void Demuxer::setMediaStreamDisable(MediaType type)
     }
 }
 
+void Demuxer::copySettings(const Demuxer &other)
+{
+    DPTR_D(Demuxer);
+    const DemuxerPrivate *o = other.d_func();
+    for (int i = 0; i < AVMEDIA_TYPE_NB; ++i)
+        d->wanted_stream_spec[i] = o->wanted_stream_spec[i];
+    d->audio_enabled = o->audio_enabled;
+    d->video_enabled = o->video_enabled;
+    d->subtitle_enabled = o->subtitle_enabled;
+    d->seek_type = o->seek_type;
+    d->measure = o->measure;
+    d->track_window_bytes = o->track_window_bytes;
+}
+
+void Demuxer::setProbeLimit(int64_t size, int64_t duration)
+{
+    DPTR_D(Demuxer);
+    if (size > 0)
+        av_dict_set_int(&d->format_opts, "probesize", size, 0);
+    else
+        av_dict_set(&d->format_opts, "probesize", nullptr, 0);
+    if (duration > 0)
+        av_dict_set_int(&d->format_opts, "analyzeduration", duration, 0);
+    else
+        av_dict_set(&d->format_opts, "analyzeduration", nullptr, 0);
+}
+
+void Demuxer::setThroughputMeasure(bool measure)
+{
+    DPTR_D(Demuxer);
+    d->measure = measure;
+}
+
+double Demuxer::throughput() const
+{
+    DPTR_D(const Demuxer);
+    DECL_LOCKGUARD(d->io_mutex);
+    if (d->bw_samples == 0)
+        return 0;
+    /* be conservative, a drop is seen by the fast one at once */
+    return std::min(d->bw_fast, d->bw_slow);
+}
+
+const std::vector<VariantInfo> &Demuxer::variants() const
+{
+    return d_func()->variants;
+}
+
+int Demuxer::variant() const
+{
+    DPTR_D(const Demuxer);
+    return d->pending_variant >= 0 ? d->pending_variant : d->variant;
+}
+
+bool Demuxer::selectVariant(int index)
+{
+    DPTR_D(Demuxer);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (!d->format_ctx || index < 0 || index >= FORCE_INT(d->variants.size()))
+        return false;
+    if (index == d->variant && d->pending_variant < 0)
+        return true;
+    const VariantInfo &v = d->variants[index];
+    memset(d->pending_stream, -1, sizeof(d->pending_stream));
+    if (d->stream_index[AVMEDIA_TYPE_VIDEO] >= 0 && v.video_stream >= 0 && v.video_stream != d->stream_index[AVMEDIA_TYPE_VIDEO])
+        d->pending_stream[AVMEDIA_TYPE_VIDEO] = v.video_stream;
+    if (d->stream_index[AVMEDIA_TYPE_AUDIO] >= 0 && v.audio_stream >= 0 && v.audio_stream != d->stream_index[AVMEDIA_TYPE_AUDIO])
+        d->pending_stream[AVMEDIA_TYPE_AUDIO] = v.audio_stream;
+    d->pending_variant = index;
+    AVDebug("Select variant %d, bitrate: %lld, %dx%d\n", index, (long long)v.bitrate, v.width, v.height);
+    if (d->pending_stream[AVMEDIA_TYPE_VIDEO] < 0 && d->pending_stream[AVMEDIA_TYPE_AUDIO] < 0) {
+        /* nothing to switch, e.g. the audio only media */
+        d->variant = index;
+        d->pending_variant = -1;
+        d->publishTracks();
+    }
+    /* the new streams are downloaded from now */
+    d->discardVariants();
+    return true;
+}
+
+void Demuxer::applyTrackChanges()
+{
+    DPTR_D(Demuxer);
+    int streams[AVMEDIA_TYPE_NB];
+    int variant;
+    {
+        DECL_LOCKGUARD(d->track_mutex);
+        if (!d->tracks_changed)
+            return;
+        d->tracks_changed = false;
+        memcpy(streams, d->switched_stream, sizeof(streams));
+        variant = d->switched_variant;
+    }
+    MediaInfo *info = d->media_info;
+    if (!info)
+        return;
+    info->video = findTrack(info->videos, streams[AVMEDIA_TYPE_VIDEO], info->video_track);
+    info->audio = findTrack(info->audios, streams[AVMEDIA_TYPE_AUDIO], info->audio_track);
+    info->subtitle = findTrack(info->subtitles, streams[AVMEDIA_TYPE_SUBTITLE], info->subtitle_track);
+    info->variant = variant;
+}
+
+bool Demuxer::isSwitchingVariant() const
+{
+    DPTR_D(const Demuxer);
+    return d->pending_variant >= 0;
+}
+
+void Demuxer::setTrackWindow(int64_t bytes)
+{
+    DPTR_D(Demuxer);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->track_window_bytes = bytes;
+    if (bytes <= 0)
+        d->track_windows.clear();
+}
+
+bool Demuxer::switchTrack(MediaType type, int stream, double pts, std::deque<Packet> &packets)
+{
+    DPTR_D(Demuxer);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (!d->format_ctx || (type != MediaTypeAudio && type != MediaTypeSubtitle))
+        return false;
+    if (stream < 0 || stream >= FORCE_INT(d->format_ctx->nb_streams) ||
+            d->format_ctx->streams[stream]->codecpar->codec_type != static_cast<AVMediaType>(type))
+        return false;
+    const int last = d->stream_index[type];
+    if (last < 0 || last == stream)
+        return false;
+    AVDebug("Switch %s stream %d -> %d at %.3f\n", av_get_media_type_string(static_cast<AVMediaType>(type)), last, stream, pts);
+    d->stream_index[type] = stream;
+    d->publishTracks();
+    std::map<int, TrackWindow>::iterator it = d->track_windows.find(stream);
+    if (it != d->track_windows.end()) {
+        /* a subtitle may be shown before pts and last after it */
+        std::deque<Packet> &window = it->second.packets;
+        for (std::deque<Packet>::const_iterator p = window.begin(); p != window.end(); ++p) {
+            if (isnan(pts) || p->pts + p->duration >= pts)
+                packets.push_back(*p);
+        }
+        d->track_windows.erase(it);
+    }
+    d->track_windows.erase(last);
+    return true;
+}
+
+void Demuxer::setViewStreams(const std::vector<int> &streams)
+{
+    DPTR_D(Demuxer);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->view_streams = streams;
+    if (d->format_ctx && !d->variants.empty())
+        d->discardVariants();
+}
+
+const std::vector<int>& Demuxer::viewStreams() const
+{
+    return d_func()->view_streams;
+}
+
 int Demuxer::load()
 {
     DPTR_D(Demuxer);
@@ -333,6 +799,26 @@ int Demuxer::load()
         AVError("Could not allocate context.\n");
         return AVERROR(ENOMEM);
     }
+    d->ios.clear();
+    d->io_closed_bytes = 0;
+    d->read_bytes = d->read_time = 0;
+    d->bw_fast = d->bw_slow = 0;
+    d->bw_samples = 0;
+    /* hook the io of the playlist and segments, MediaIO is not counted */
+    if (d->measure && !d->media_io && d->format_ctx->io_open) {
+        d->format_ctx->opaque = d;
+        d->io_open_default = d->format_ctx->io_open;
+        d->format_ctx->io_open = DemuxerPrivate::ioOpen;
+#if LIBAVFORMAT_VERSION_MAJOR >= 60
+        d->io_close_default = d->format_ctx->io_close2;
+        if (d->io_close_default)
+            d->format_ctx->io_close2 = DemuxerPrivate::ioClose;
+#else
+        d->io_close_default = d->format_ctx->io_close;
+        if (d->io_close_default)
+            d->format_ctx->io_close = DemuxerPrivate::ioClose;
+#endif
+    }
 
     d->interrupt_handler->begin(InterruptHandler::OpenStream);
     if(d->media_io) {
@@ -378,6 +864,7 @@ int Demuxer::load()
         av_dump_format(d->format_ctx, 0, d->url.c_str(), 0);
     // prepare audio, video and subtitle stream
     d->prepareStreams();
+    d->initVariants();
 
     d->seekable = d->isSeekable();
 
@@ -401,6 +888,14 @@ void Demuxer::unload()
         avformat_close_input(&d->format_ctx);
         d->format_ctx = nullptr;
     }
+    {
+        DECL_LOCKGUARD(d->io_mutex);
+        d->ios.clear();
+    }
+    d->variants.clear();
+    d->variant = d->pending_variant = -1;
+    memset(d->pending_stream, -1, sizeof(d->pending_stream));
+    d->track_windows.clear();
     d->interrupt_handler->setStatus(0);
 }
 
@@ -478,6 +973,9 @@ bool Demuxer::seek(double pos, double incr)
         return false;
     }
 	d->seek_pos = pos;
+    for (int i = 0; i < AVMEDIA_TYPE_NB; ++i)
+        d->last_pts[i] = NAN;
+    d->track_windows.clear();
     return true;
 }
 
@@ -500,10 +998,17 @@ int Demuxer::readFrame()
 	std::lock_guard<std::mutex> lock(d->mutex);
     int ret = -1;
     AVPacket *avpkt = d->avpkt;
+    const bool measure = d->measure && d->io_open_default;
+    const int64_t bytes = measure ? d->bytesRead() : 0;
+    const int64_t time = measure ? av_gettime_relative() : 0;
 
     d->interrupt_handler->begin(InterruptHandler::ReadStream);
     ret = av_read_frame(d->format_ctx, avpkt);
     d->interrupt_handler->end();
+    /* the jitter is measured by the arrival time, not by the time it's queued */
+    const int64_t arrival = av_gettime_relative() / 1000;
+    if (measure)
+        d->updateThroughput(d->bytesRead() - bytes, av_gettime_relative() - time);
 
     if (ret < 0) {
         if (ret == AVERROR_EOF)
@@ -512,14 +1017,37 @@ int Demuxer::readFrame()
         return ret;
     }
     d->stream = avpkt->stream_index;
+    if (d->pending_variant >= 0 && d->switchVariant(avpkt)) {
+        /* the decoder is not reopened, give it the parameter sets of the new stream */
+        AVCodecParameters *par = d->format_ctx->streams[d->stream]->codecpar;
+        if (par->extradata_size > 0) {
+            uint8_t *data = av_packet_new_side_data(avpkt, AV_PKT_DATA_NEW_EXTRADATA, par->extradata_size);
+            if (data)
+                memcpy(data, par->extradata, par->extradata_size);
+        }
+    }
     if (d->stream != d->stream_index[MediaTypeAudio] &&
             d->stream != d->stream_index[MediaTypeVideo] &&
-            d->stream != d->stream_index[MediaTypeSubtitle]) {
+            d->stream != d->stream_index[MediaTypeSubtitle] &&
+            !d->isView(d->stream)) {
+        /* the packet is kept for switching track, it is not an error */
+        if (d->track_window_bytes > 0) {
+            d->keepAlternate(avpkt);
+            av_packet_unref(avpkt);
+            return 999;
+        }
         av_packet_unref(avpkt);
         return -1;
     }
+    {
+        AVStream *st = d->format_ctx->streams[d->stream];
+        const int64_t ts = avpkt->pts != AV_NOPTS_VALUE ? avpkt->pts : avpkt->dts;
+        if (ts != AV_NOPTS_VALUE && st->codecpar->codec_type >= 0 && st->codecpar->codec_type < AVMEDIA_TYPE_NB)
+            d->last_pts[st->codecpar->codec_type] = ts * av_q2d(st->time_base);
+    }
 
     d->curPkt = Packet::fromAVPacket(avpkt, av_q2d(d->format_ctx->streams[d->stream]->time_base));
+    d->curPkt.arrival = arrival;
     av_packet_unref(avpkt);
     d->eof = false;
 
@@ -549,6 +1077,9 @@ void Demuxer::initMediaInfo()
     d->media_info->bit_rate = d->format_ctx->bit_rate;
     d->media_info->start_time = d->format_ctx->start_time / AV_TIME_BASE;
     d->media_info->duration = d->format_ctx->duration / AV_TIME_BASE;
+    const int64_t size = d->format_ctx->pb ? avio_size(d->format_ctx->pb) : 0;
+    d->media_info->size = size > 0 ? size : 0;
+    d->media_info->streams = d->format_ctx->nb_streams;
 
     for (i = 0; FORCE_UINT(i) < d->format_ctx->nb_streams; i++) {
         AVStream *st = d->format_ctx->streams[i];
@@ -558,7 +1089,7 @@ void Demuxer::initMediaInfo()
             info.stream = i;
             info.start_time = st->start_time == AV_NOPTS_VALUE ?
                         0 : FORCE_INT64(st->start_time * av_q2d(st->time_base) * 1000);
-            info.duration = st->duration = AV_NOPTS_VALUE ?
+            info.duration = st->duration == AV_NOPTS_VALUE ?
                         0 : FORCE_INT64(st->duration * av_q2d(st->time_base) * 1000);
             info.frames = st->nb_frames;
             /* Codec Paras */
@@ -585,7 +1116,7 @@ void Demuxer::initMediaInfo()
             info.stream = i;
             info.start_time = st->start_time == AV_NOPTS_VALUE ?
                         0 : FORCE_INT64(st->start_time * av_q2d(st->time_base) * 1000);
-            info.duration = st->duration = AV_NOPTS_VALUE ?
+            info.duration = st->duration == AV_NOPTS_VALUE ?
                         0 : FORCE_INT64(st->duration * av_q2d(st->time_base) * 1000);
             info.frames = st->nb_frames;
             /* Codec Paras */
@@ -618,7 +1149,7 @@ void Demuxer::initMediaInfo()
             info.stream = i;
             info.start_time = st->start_time == AV_NOPTS_VALUE ?
                 0 : FORCE_INT64(st->start_time * av_q2d(st->time_base) * 1000);
-            info.duration = st->duration = AV_NOPTS_VALUE ?
+            info.duration = st->duration == AV_NOPTS_VALUE ?
                 0 : FORCE_INT64(st->duration * av_q2d(st->time_base) * 1000);
             info.frames = st->nb_frames;
             /* Codec Paras */
@@ -633,6 +1164,8 @@ void Demuxer::initMediaInfo()
             }
         }
     }
+    d->media_info->variants = d->variants;
+    d->media_info->variant = d->variant;
 }
 
 double Demuxer::startTimeS()
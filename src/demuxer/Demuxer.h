@@ -7,6 +7,7 @@
 #include "Packet.h"
 
 #include <string>
+#include <deque>
 
 typedef struct AVFormatContext AVFormatContext;
 typedef struct AVStream AVStream;
@@ -31,6 +32,61 @@ public:
     int  streamIndex(MediaType type);
     void setWantedStreamSpec(MediaType type, const char* spec);
     void setMediaStreamDisable(MediaType type);
+    /**
+     * @brief use the stream selection, seek type and throughput measure of
+     * another demuxer, e.g. for the next media of a playlist
+     */
+    void copySettings(const Demuxer &other);
+    /**
+     * @brief limit the bytes read and the duration(microseconds) analyzed when
+     * probing the streams, <= 0 means the default value of ffmpeg.
+     * Should be called before load()
+     */
+    void setProbeLimit(int64_t size, int64_t duration);
+    /**
+     * @brief measure the throughput of the IO layer, so that the variants of
+     * HLS/DASH can be switched by it. Should be called before load()
+     */
+    void setThroughputMeasure(bool measure);
+    /**
+     * @brief bits per second measured when reading, 0 if unknown
+     */
+    double throughput() const;
+    /**
+     * @brief the variants of HLS/DASH sorted by bitrate, the streams of the
+     * other variants are discarded so that they are not downloaded
+     */
+    const std::vector<VariantInfo>& variants() const;
+    int variant() const;
+    /**
+     * @brief switch to another variant without flush. The streams of the new
+     * variant are read together with the current ones, and used from the first
+     * key frame after the packets read, which is the beginning of a segment.
+     */
+    bool selectVariant(int index);
+    bool isSwitchingVariant() const;
+    /**
+     * @brief update the current tracks and variant of media info to the ones
+     * switched by selectVariant() and switchTrack() in the demux thread. Called
+     * in the thread owning the media info, it's not touched by the demux thread
+     */
+    void applyTrackChanges();
+    /**
+     * @brief the latest packets of the audio and subtitle tracks not selected
+     * are kept, at most bytes for each track. <= 0 disables it
+     */
+    void setTrackWindow(int64_t bytes);
+    /**
+     * @brief select another audio/subtitle stream without seek, the packets
+     * kept for it from pts are returned, they are earlier than the next one read
+     */
+    bool switchTrack(MediaType type, int stream, double pts, std::deque<Packet> &packets);
+    /**
+     * @brief the video streams decoded besides the selected one, e.g. the
+     * cameras of a surveillance stream. Their packets are returned by readFrame()
+     */
+    void setViewStreams(const std::vector<int> &streams);
+    const std::vector<int>& viewStreams() const;
     int  load();
     void abort();
     void unload();
@@ -43,8 +99,17 @@ public:
     bool isSeekable() const;
     bool seek(double seek_pos, double seek_incr);
 	void setSeekType(SeekType type); 
+    /**
+     * @brief interrupt < 0: abort all the blocking operation,
+     * interrupt > 0: only abort the blocking read, e.g. a new seek is required
+     */
 	void setInterruptStatus(int interrupt);
 
+    /**
+     * @brief read a packet of the streams selected
+     * @return 0 on success, 999 if a packet of an alternate track is kept by the
+     * track window, -1 if a packet of other streams is dropped, < 0 on error
+     */
     int  readFrame();
 
     AVFormatContext *formatCtx() const;
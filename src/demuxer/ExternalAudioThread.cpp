@@ -0,0 +1,190 @@
+#include "ExternalAudioThread.h"
+#include "Demuxer.h"
+#include "AVThread.h"
+#include "PacketQueue.h"
+#include "AVLog.h"
+#include "utils/innermath.h"
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cmath>
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+NAMESPACE_BEGIN
+
+class ExternalAudioThreadPrivate
+{
+public:
+    ExternalAudioThreadPrivate():
+        audio_thread(nullptr),
+        offset(0),
+        seek_req(false),
+        seek_pos(0),
+        skip(false),
+        abort(false),
+        eof(false)
+    {
+
+    }
+
+    /* follow the timeline of the main media */
+    void applyOffset(Packet &pkt)
+    {
+        if (offset == 0)
+            return;
+        AVStream *st = demuxer.formatCtx()->streams[demuxer.stream()];
+        const int64_t shift = FORCE_INT64(std::llround(offset / av_q2d(st->time_base)));
+        AVPacket *avpkt = pkt.avPacket();
+        if (avpkt->pts != AV_NOPTS_VALUE)
+            avpkt->pts += shift;
+        if (avpkt->dts != AV_NOPTS_VALUE)
+            avpkt->dts += shift;
+        pkt.pts += offset;
+        pkt.dts += offset;
+    }
+
+    Demuxer demuxer;
+    AVThread *audio_thread;
+    std::atomic<double> offset;
+    bool seek_req;
+    double seek_pos;
+    std::atomic<bool> skip;
+    std::atomic<bool> abort;
+    bool eof;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+ExternalAudioThread::ExternalAudioThread():
+    CThread("external audio"),
+    d_ptr(new ExternalAudioThreadPrivate)
+{
+
+}
+
+ExternalAudioThread::~ExternalAudioThread()
+{
+    stop();
+}
+
+Demuxer *ExternalAudioThread::demuxer() const
+{
+    DPTR_D(const ExternalAudioThread);
+    return const_cast<Demuxer*>(&d->demuxer);
+}
+
+void ExternalAudioThread::setAudioThread(AVThread *thread)
+{
+    DPTR_D(ExternalAudioThread);
+    d->audio_thread = thread;
+}
+
+void ExternalAudioThread::setOffset(double offset)
+{
+    DPTR_D(ExternalAudioThread);
+    d->offset = offset;
+}
+
+double ExternalAudioThread::offset() const
+{
+    DPTR_D(const ExternalAudioThread);
+    return d->offset;
+}
+
+void ExternalAudioThread::seek(double pos)
+{
+    DPTR_D(ExternalAudioThread);
+    {
+        DECL_LOCKGUARD(d->mutex);
+        d->seek_req = true;
+        d->seek_pos = pos;
+        /* the pending read is useless */
+        d->demuxer.setInterruptStatus(1);
+    }
+    d->cond.notify_one();
+}
+
+void ExternalAudioThread::setSkip(bool skip)
+{
+    DPTR_D(ExternalAudioThread);
+    d->skip = skip;
+    d->cond.notify_one();
+}
+
+void ExternalAudioThread::stop()
+{
+    DPTR_D(ExternalAudioThread);
+    if (isRunning()) {
+        d->abort = true;
+        d->demuxer.setInterruptStatus(1);
+        d->cond.notify_one();
+    }
+    wait();
+    /* it can be started again */
+    d->abort = false;
+    d->seek_req = false;
+    d->demuxer.setInterruptStatus(0);
+}
+
+void ExternalAudioThread::run()
+{
+    DPTR_D(ExternalAudioThread);
+    PacketQueue *queue = d->audio_thread ? d->audio_thread->packets() : nullptr;
+    if (!queue || !d->demuxer.stream(MediaTypeAudio)) {
+        CThread::run();
+        return;
+    }
+    d->eof = false;
+    d->demuxer.setSeekType(SeekType(SeekFromStart | SeekKeyFrame));
+    queue->enqueue(Packet::createFlush());
+    while (!d->abort) {
+        bool seek_req = false;
+        double seek_pos = 0;
+        {
+            DECL_LOCKGUARD(d->mutex);
+            if (d->seek_req) {
+                seek_req = true;
+                seek_pos = d->seek_pos;
+                d->seek_req = false;
+                d->demuxer.setInterruptStatus(0);
+            }
+        }
+        if (seek_req) {
+            /* the flush is queued here, so no packet before the seek is behind it */
+            d->demuxer.seek(std::max(seek_pos - d->offset, 0.0), 0);
+            queue->clear();
+            queue->blockFull(false);
+            queue->enqueue(Packet::createFlush());
+            d->audio_thread->requestSeek();
+            d->eof = false;
+        }
+        if (d->skip || d->eof || queue->checkFull()) {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            d->cond.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+        const int ret = d->demuxer.readFrame();
+        if (ret == -1 || ret == 999)
+            continue;
+        if (ret == AVERROR_EOF) {
+            queue->enqueue(Packet::createEOF());
+            d->eof = true;
+            continue;
+        }
+        if (ret < 0) {
+            /* interrupted by seek or stop, or the error of network */
+            if (!d->seek_req && !d->abort)
+                msleep(10);
+            continue;
+        }
+        Packet pkt = d->demuxer.packet();
+        d->applyOffset(pkt);
+        queue->blockFull(false);
+        queue->enqueue(pkt);
+    }
+    CThread::run();
+}
+
+NAMESPACE_END
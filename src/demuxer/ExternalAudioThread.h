@@ -0,0 +1,54 @@
+#ifndef EXTERNALAUDIOTHREAD_H
+#define EXTERNALAUDIOTHREAD_H
+
+#include "CThread.h"
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The ExternalAudioThread class
+ * Demux the audio of another file into the queue of the audio thread, e.g.
+ * a dubbing or commentary track. It is started, stopped and seeked by the
+ * main demux thread, and the timestamps are shifted by the offset so that
+ * they follow the clock of the main media.
+ */
+class AVThread;
+class Demuxer;
+class ExternalAudioThreadPrivate;
+class ExternalAudioThread: public CThread
+{
+    DPTR_DECLARE_PRIVATE(ExternalAudioThread)
+public:
+    ExternalAudioThread();
+    ~ExternalAudioThread() PU_DECL_OVERRIDE;
+
+    /**
+     * @brief only the audio stream is selected, the media is loaded by the player
+     */
+    Demuxer *demuxer() const;
+    void setAudioThread(AVThread *thread);
+    /**
+     * @brief seconds added to the timestamps of the external media
+     */
+    void setOffset(double offset);
+    double offset() const;
+    /**
+     * @brief pos is the timestamp of the main media
+     */
+    void seek(double pos);
+    /**
+     * @brief stop reading, e.g. in trick play where the audio is skipped
+     */
+    void setSkip(bool skip);
+
+    void stop() PU_DECL_OVERRIDE;
+
+protected:
+    void run() PU_DECL_OVERRIDE;
+
+private:
+    DPTR_DECLARE(ExternalAudioThread)
+};
+
+NAMESPACE_END
+#endif //EXTERNALAUDIOTHREAD_H
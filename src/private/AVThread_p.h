@@ -74,6 +74,7 @@ public:
      */
     bool seeking = false;
 	bool seek_req;
+	std::function<void()> seekFinished;
 
     /*Filter for audio and video*/
     std::list<Filter*> filters;
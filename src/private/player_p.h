@@ -4,6 +4,7 @@
 #include "sdk/player.h"
 #include "demuxer/Demuxer.h"
 #include "demuxer/AVDemuxThread.h"
+#include "demuxer/ExternalAudioThread.h"
 #include "VideoThread.h"
 #include "AudioThread.h"
 #include "PacketQueue.h"
@@ -18,6 +19,12 @@
 #include "filter/Filter.h"
 #include "subtitle/subtitledecoder.h"
 #include "inner.h"
+#include "utils/innermath.h"
+#include <atomic>
+#include <iterator>
+extern "C" {
+#include "libavformat/avformat.h"
+}
 
 NAMESPACE_BEGIN
 
@@ -40,6 +47,7 @@ public:
     PlayerPrivate* d;
 };
 
+class PreloadMediaAsync;
 class PlayerPrivate
 {
 public:
@@ -49,6 +57,7 @@ public:
         seeking(false),
         buffer_mode(BufferPackets),
         buffer_value(-1),
+        buffer_adaptive(false),
         media_status(NoMedia),
         load_media_async(nullptr),
         demuxer(nullptr),
@@ -60,7 +69,17 @@ public:
         subtitle_dec(nullptr),
         ao(nullptr),
         resample_type(ResampleBase),
-        clock_type(SyncToAudio)
+        clock_type(SyncToAudio),
+        frame_cache_bytes(-1),
+        deinterlace(Deinterlace_Adaptive),
+        field_rate(false),
+        scale_filter(Scale_Bilinear),
+        preload(nullptr),
+        preload_video_dec(nullptr),
+        preload_audio_dec(nullptr),
+        chained_demuxer(nullptr),
+        external_audio(nullptr),
+        external_audio_offset(0)
     {
         ao = new AudioOutput;
         demuxer = new Demuxer();
@@ -68,6 +87,14 @@ public:
         demux_thread = new AVDemuxThread();
         demux_thread->setDemuxer(demuxer);
         demux_thread->setClock(&clock);
+        demux_thread->setMediaChangedCallback([this](Demuxer *last, Demuxer *next) {
+            onMediaChained(last, next);
+        });
+        demux_thread->setStreamChangedCallback([this](MediaType type, int stream) {
+            if (type == MediaTypeSubtitle)
+                applySubtitleStream();
+            CALL_BACK(mediaStreamChanged, type, stream);
+        });
         video_dec_ids = VideoDecoder::registered();
         subtitle_dec_ids = SubtitleDecoder::registered();
     }
@@ -79,6 +106,7 @@ public:
             delete load_media_async;
             load_media_async = nullptr;
         }
+        cancelPreload();
         if (ao) {
             if (ao->isOpen())
                 ao->close();
@@ -106,6 +134,14 @@ public:
             delete demux_thread;
             demux_thread = nullptr;
         }
+        if (external_audio) {
+            delete external_audio;
+            external_audio = nullptr;
+        }
+        for (size_t i = 0; i < video_views.size(); ++i)
+            delete video_views[i].output;
+        video_views.clear();
+        deleteRetiredDemuxers();
         std::list<Subtitle*>::iterator it = external_subtitles.begin();
         for (; it != external_subtitles.end(); ++it) {
             Subtitle* subtitle = *it;
@@ -121,6 +157,8 @@ public:
 
 	bool setupAudioThread();
 	bool setupVideoThread();
+    void setupVideoViews();
+    void releaseVideoViews();
 
 	void updateBufferValue(PacketQueue* buf);
 
@@ -136,6 +174,17 @@ public:
 
     void onSeekFinished(void*) { seeking = false; }
 
+    bool loadExternalAudio();
+    /* the demuxer of audio track, it's the external one if loaded */
+    Demuxer *audioDemuxer();
+
+    void cancelPreload();
+    void onMediaChained(Demuxer *last, Demuxer *next);
+    /* switch to the media chained and apply the tracks switched by the demux thread, called in the player thread */
+    void applyChainedMedia();
+    void deleteRetiredDemuxers();
+    static void copyMediaInfo(MediaInfo &dst, const MediaInfo &src);
+
     std::string url;
     bool loaded;
     bool paused;
@@ -143,6 +192,7 @@ public:
     std::hash<std::string> format_dict;
 	uint8_t buffer_mode;
 	int64_t buffer_value;
+    bool buffer_adaptive;
 
     MediaStatus media_status;
     /*async load*/
@@ -174,6 +224,12 @@ public:
     AVClock clock;
     ClockType clock_type;
     ResampleType resample_type;
+    /* -1 means default */
+    int64_t frame_cache_bytes;
+    /* of the renderers, and the video threads send the frame again for the second field */
+    DeinterlaceMode deinterlace;
+    bool field_rate;
+    ScaleFilter scale_filter;
 
     /*Subtitles*/
     Subtitle internal_subtitle;
@@ -188,6 +244,34 @@ public:
 
     MediaInfo mediainfo;
 
+    /* preload of the next media */
+    PreloadMediaAsync *preload;
+    MediaInfo preload_info;
+    std::string preload_url;
+    VideoDecoder *preload_video_dec;
+    AudioDecoder *preload_audio_dec;
+    /* played by the demux thread already, but not applied in the player thread */
+    Demuxer *chained_demuxer;
+    /* the demuxers of the media chained, they are deleted in the player thread */
+    std::list<Demuxer*> retired_demuxers;
+    std::mutex preload_mutex;
+
+    /* the audio track of another file */
+    ExternalAudioThread *external_audio;
+    std::string external_audio_url;
+    double external_audio_offset;
+    MediaInfo external_info;
+
+    /* the video tracks decoded besides the main one, each is shown on its own renderer */
+    typedef struct VideoView {
+        int track;
+        VideoRenderer *renderer;
+        OutputSet *output;
+        VideoDecoder *decoder;
+        AVThread *thread;
+    } VideoView;
+    std::vector<VideoView> video_views;
+
     std::function<void(MediaStatus s)> mediaStatusChanged;
     std::function<void(MediaType type, int stream)> mediaStreamChanged;
     std::function<void(MediaInfo*)> subtitleHeaderChanged;
@@ -210,6 +294,7 @@ void PlayerPrivate::playInternal()
             video_thread = nullptr;
         }
     }
+    setupVideoViews();
 
     /*Set Clock Type*/
     if (clock_type == SyncToAudio) {
@@ -244,12 +329,16 @@ void PlayerPrivate::initRenderVideo()
 		VideoRenderer* render = static_cast<VideoRenderer*>(output);
 		render->initVideoRender();
 	}
+    for (size_t i = 0; i < video_views.size(); ++i)
+        video_views[i].renderer->initVideoRender();
 }
 
 bool PlayerPrivate::setupAudioThread()
 {
+    Demuxer *source = audioDemuxer();
+    const AudioStreamInfo *info = source == demuxer ? mediainfo.audio : external_info.audio;
     // No audio track
-    if (!mediainfo.audio)
+    if (!info)
         return false;
 	if (audio_thread) {
 		audio_thread->packets()->clear();
@@ -259,16 +348,26 @@ bool PlayerPrivate::setupAudioThread()
 		delete audio_dec;
 		audio_dec = nullptr;
     }
-    if (!demuxer->stream(MediaTypeAudio))
+    if (!source->stream(MediaTypeAudio))
         return false;
 
-	AudioDecoder *dec = AudioDecoder::create();
-	if (!dec)
-        return false;
-    dec->initialize(demuxer->formatCtx(), demuxer->stream(MediaTypeAudio));
-	if (!dec->open()) {
-		return false;
-	}
+    /* opened by preload already */
+    AudioDecoder *dec = preload_audio_dec;
+    preload_audio_dec = nullptr;
+    if (dec && source != demuxer) {
+        delete dec;
+        dec = nullptr;
+    }
+    if (!dec) {
+        dec = AudioDecoder::create();
+        if (!dec)
+            return false;
+        dec->initialize(source->formatCtx(), source->stream(MediaTypeAudio));
+        if (!dec->open()) {
+            delete dec;
+            return false;
+        }
+    }
 	audio_dec = dec;
 	if (!audio_dec) {
 		AVDebug("Can not found audio decoder.\n");
@@ -276,21 +375,24 @@ bool PlayerPrivate::setupAudioThread()
 	}
 
     AudioFormat af;
-    af.setSampleRate(mediainfo.audio->sample_rate);
-    af.setChannelLayoutFFmpeg(mediainfo.audio->channel_layout);
-    af.setSampleFormatFFmpeg(mediainfo.audio->format);
-    af.setChannels(mediainfo.audio->channels);
+    af.setSampleRate(info->sample_rate);
+    af.setChannelLayoutFFmpeg(info->channel_layout);
+    af.setSampleFormatFFmpeg(info->format);
+    af.setChannels(info->channels);
 	if (!af.isValid()) {
 		AVWarning("Invalid audio format, disable audio!");
 		return false;
 	}
 
     ao->setResampleType(resample_type);
-	ao->setAudioFormat(af);
-	ao->close();
-	if (!ao->open()) {
-		return false;
-	}
+    /* keep the device of the previous media if the format is same */
+    if (!ao->isOpen() || !(ao->audioFormat() == af)) {
+        ao->setAudioFormat(af);
+        ao->close();
+        if (!ao->open()) {
+            return false;
+        }
+    }
 
 	if (!audio_thread) {
 		audio_thread = new AudioThread();
@@ -324,7 +426,10 @@ bool PlayerPrivate::setupVideoThread()
     if (!demuxer->stream(MediaTypeVideo))
         return false;
 
-	for (size_t i = 0; i < video_dec_ids.size(); ++i) {
+    /* opened by preload already */
+    video_dec = preload_video_dec;
+    preload_video_dec = nullptr;
+	for (size_t i = 0; !video_dec && i < video_dec_ids.size(); ++i) {
 		VideoDecoder *dec = VideoDecoder::create(video_dec_ids.at(i));
 		if (!dec)
 			continue;
@@ -362,6 +467,11 @@ bool PlayerPrivate::setupVideoThread()
 		demux_thread->setVideoThread(video_thread);
 	}
 	video_thread->setDecoder(video_dec);
+    if (frame_cache_bytes >= 0) {
+        VideoThread *thread = dynamic_cast<VideoThread*>(video_thread);
+        thread->setFrameCacheBytes(frame_cache_bytes);
+    }
+    dynamic_cast<VideoThread*>(video_thread)->setFieldRate(field_rate);
     if (subtitle_dec) {
         VideoThread *thread = dynamic_cast<VideoThread*>(video_thread);
         thread->setSubtitleDecoder(subtitle_dec);
@@ -371,6 +481,71 @@ bool PlayerPrivate::setupVideoThread()
 	return true;
 }
 
+void PlayerPrivate::setupVideoViews()
+{
+    std::vector<int> streams;
+    for (size_t i = 0; i < video_views.size(); ++i) {
+        VideoView &view = video_views[i];
+        if (view.track < 0 || view.track >= FORCE_INT(mediainfo.videos.size()))
+            continue;
+        const int stream = std::next(mediainfo.videos.begin(), view.track)->stream;
+        if (stream == demuxer->streamIndex(MediaTypeVideo)) {
+            AVWarning("Video track %d is the main video, the view is ignored.\n", view.track);
+            continue;
+        }
+        AVStream *st = demuxer->formatCtx()->streams[stream];
+        for (size_t j = 0; !view.decoder && j < video_dec_ids.size(); ++j) {
+            VideoDecoder *dec = VideoDecoder::create(video_dec_ids.at(j));
+            if (!dec)
+                continue;
+            dec->initialize(demuxer->formatCtx(), st);
+            if (dec->open()) {
+                view.decoder = dec;
+                break;
+            }
+            delete dec;
+        }
+        if (!view.decoder) {
+            AVWarning("Can not found video decoder for track %d.\n", view.track);
+            continue;
+        }
+        /* each view decodes in its own threads, and follows the clock of the main one */
+        VideoThread *thread = new VideoThread();
+        thread->setMediaInfo(&mediainfo);
+        thread->setOutputSet(view.output);
+        thread->setClock(&clock);
+        thread->setSlave(true);
+        thread->setFieldRate(field_rate);
+        thread->setDecoder(view.decoder);
+        updateBufferValue(thread->packets());
+        view.thread = thread;
+        demux_thread->addVideoView(stream, thread);
+        streams.push_back(stream);
+    }
+    demuxer->setViewStreams(streams);
+}
+
+void PlayerPrivate::releaseVideoViews()
+{
+    demux_thread->clearVideoViews();
+    demuxer->setViewStreams(std::vector<int>());
+    for (size_t i = 0; i < video_views.size(); ++i) {
+        VideoView &view = video_views[i];
+        if (view.thread) {
+            view.thread->packets()->clear();
+            view.thread->packets()->blockFull(false);
+            view.thread->stop();
+            view.thread->wait();
+            delete view.thread;
+            view.thread = nullptr;
+        }
+        if (view.decoder) {
+            delete view.decoder;
+            view.decoder = nullptr;
+        }
+    }
+}
+
 // TODO: set to a lower value when buffering
 void PlayerPrivate::updateBufferValue(PacketQueue* buf)
 {
@@ -391,6 +566,7 @@ void PlayerPrivate::updateBufferValue(PacketQueue* buf)
     buf->setRealTime(demuxer->isRealTime());
 	buf->setBufferMode((BufferMode)buffer_mode);
 	buf->setBufferValue(buffer_value < 0LL ? bv : buffer_value);
+    buf->setAdaptive(buffer_adaptive);
 }
 
 inline bool PlayerPrivate::installFilter(AudioFilter * filter, int index)
@@ -489,6 +665,7 @@ void LoadMediaAsync::run()
     }
     d->media_status = Loaded;
     CALL_BACK(d->mediaStatusChanged, Loaded);
+    d->loadExternalAudio();
     d->initRenderVideo();
     d->clock.setMaxDuration(d->demuxer->maxDuration());
     d->applySubtitleStream();
@@ -497,5 +674,37 @@ void LoadMediaAsync::run()
     CALL_BACK(d->mediaStatusChanged, Prepared);
 }
 
+bool PlayerPrivate::loadExternalAudio()
+{
+    demux_thread->setExternalAudio(nullptr);
+    if (external_audio_url.empty())
+        return false;
+    if (!external_audio)
+        external_audio = new ExternalAudioThread();
+    Demuxer *ext = external_audio->demuxer();
+    ext->setMediaInfo(&external_info);
+    ext->setMediaStreamDisable(MediaTypeVideo);
+    ext->setMediaStreamDisable(MediaTypeSubtitle);
+    ext->setTrackWindow(0);
+    ext->setMedia(external_audio_url);
+    external_info = MediaInfo();
+    if (ext->load() != 0 || !ext->stream(MediaTypeAudio)) {
+        AVWarning("Load external audio %s failed.\n", external_audio_url.c_str());
+        ext->unload();
+        return false;
+    }
+    /* both start at the beginning of the main media */
+    external_audio->setOffset(demuxer->startTimeS() - ext->startTimeS() + external_audio_offset);
+    demux_thread->setExternalAudio(external_audio);
+    return true;
+}
+
+Demuxer *PlayerPrivate::audioDemuxer()
+{
+    if (external_audio && external_audio->demuxer()->stream(MediaTypeAudio))
+        return external_audio->demuxer();
+    return demuxer;
+}
+
 NAMESPACE_END
 #endif //AVPLAYER_P_H
@@ -67,6 +67,20 @@ const Matrix4x4 yuv2rgb_bt709 =
             0.0f, 0.0f, 1.0f, -0.5f,
             0.0f, 0.0f, 0.0f, 1.0f)
         ;
+// Kr = 0.2627, Kb = 0.0593
+const Matrix4x4 yuv2rgb_bt2020 =
+        Matrix4x4(
+            1.0f,  0.000f,    1.4746f,  0.0f,
+            1.0f, -0.16455f, -0.57135f, 0.0f,
+            1.0f,  1.8814f,   0.000f,   0.0f,
+            0.0f,  0.000f,    0.000f,   1.0f)
+        *
+        Matrix4x4(
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, -0.5f,
+            0.0f, 0.0f, 1.0f, -0.5f,
+            0.0f, 0.0f, 0.0f, 1.0f)
+        ;
 
 // For yuv->rgb, assume yuv is full range before convertion, rgb is full range after convertion. so if input yuv is limited range, transform to full range first. If display rgb is limited range, transform to limited range at last.
 // *ColorRangeYUV(...)
@@ -14,9 +14,10 @@ NAMESPACE_BEGIN
 
 
 //http://msdn.microsoft.com/en-us/library/dd206750.aspx
-// cs: BT601 or BT709
+// cs: BT601, BT709 or BT2020(non-constant luminance)
 extern const Matrix4x4 yuv2rgb_bt601;
 extern const Matrix4x4 yuv2rgb_bt709;
+extern const Matrix4x4 yuv2rgb_bt2020;
 static const Matrix4x4& YUV2RGB(ColorSpace cs)
 {
 	switch (cs) {
@@ -24,6 +25,8 @@ static const Matrix4x4& YUV2RGB(ColorSpace cs)
 		return yuv2rgb_bt601;
 	case ColorSpace_BT709:
 		return yuv2rgb_bt709;
+	case ColorSpace_BT2020:
+		return yuv2rgb_bt2020;
 	default:
 		return yuv2rgb_bt601;
 	}
@@ -0,0 +1,670 @@
+#include "MosaicRenderer.h"
+#include "VideoRenderer.h"
+#include "ColorTransform.h"
+#include "OpenglAide.h"
+#include "ShaderCache.h"
+#include "glpackage.h"
+#include "glad/glad.h"
+#include "Size.h"
+#include "AVLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+extern "C" {
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+#include "libswscale/swscale.h"
+}
+
+/* the attributes of a vertex: position, texture coordinates and layer, the max texture
+ * coordinates of the tile, its layout, and the rows of its color matrix */
+#define MOSAIC_VERTEX_FLOATS (2 + 3 + 2 + 1 + 3*4)
+#define MOSAIC_PLANES 3
+
+NAMESPACE_BEGIN
+
+/* how the planes of a tile are stored in the texture arrays, other formats are converted
+ * to yuv420p in the video thread. 16 bits are in the native endian */
+enum MosaicLayout {
+    Layout_None = -1,
+    Layout_YUV8,    // 3 planes of 8 bits
+    Layout_NV8,     // nv12 and nv21, the chroma is interleaved
+    Layout_YUV16,   // 3 planes of 9 to 16 bits in the low bits
+    Layout_NV16     // p010 and p016
+};
+
+/* the texture arrays, only those of the layouts shown are allocated */
+enum MosaicTexture {
+    Texture_Y8,
+    Texture_U8,
+    Texture_V8,
+    Texture_UV8,
+    Texture_Y16,
+    Texture_U16,
+    Texture_V16,
+    Texture_UV16,
+    MOSAIC_TEXTURES
+};
+
+typedef struct MosaicTextureFormat {
+    GLint internal_format;
+    GLenum format;
+    GLenum type;
+    int bytes;      // of a texel
+    bool chroma;    // half the size of the slot
+} MosaicTextureFormat;
+
+static const MosaicTextureFormat mosaic_textures[MOSAIC_TEXTURES] = {
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, false },
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, true },
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, true },
+    { GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2, true },
+    { GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2, false },
+    { GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2, true },
+    { GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2, true },
+    { GL_RG16, GL_RG, GL_UNSIGNED_SHORT, 4, true }
+};
+
+/* the texture of each plane, -1 if there are 2 planes */
+static const int layout_textures[][MOSAIC_PLANES] = {
+    { Texture_Y8, Texture_U8, Texture_V8 },
+    { Texture_Y8, Texture_UV8, -1 },
+    { Texture_Y16, Texture_U16, Texture_V16 },
+    { Texture_Y16, Texture_UV16, -1 }
+};
+
+static int layoutOf(const VideoFormat &fmt, bool native16)
+{
+    switch (fmt.pixelFormatFFmpeg()) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+        return Layout_YUV8;
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+        return Layout_NV8;
+    case AV_PIX_FMT_YUV420P9:
+    case AV_PIX_FMT_YUV420P10:
+    case AV_PIX_FMT_YUV420P12:
+    case AV_PIX_FMT_YUV420P14:
+    case AV_PIX_FMT_YUV420P16:
+        return native16 ? Layout_YUV16 : Layout_None;
+    case AV_PIX_FMT_P010:
+    case AV_PIX_FMT_P016:
+        return native16 ? Layout_NV16 : Layout_None;
+    default:
+        return Layout_None;
+    }
+}
+
+/* converts the frames without a layout in the video thread, the render thread only uploads them */
+class MosaicTileRenderer : public VideoRenderer
+{
+public:
+    MosaicTileRenderer():
+        native16(false),
+        sws(nullptr)
+    {
+
+    }
+    ~MosaicTileRenderer()
+    {
+        sws_freeContext(sws);
+    }
+    void receive(const VideoFrame &frame) override;
+
+    /* 16 bit textures are supported, known in the GL thread */
+    std::atomic<bool> native16;
+
+private:
+    SwsContext *sws;
+};
+
+void MosaicTileRenderer::receive(const VideoFrame &frame)
+{
+    if (layoutOf(frame.format(), native16) != Layout_None) {
+        VideoRenderer::receive(frame);
+        return;
+    }
+    sws = sws_getCachedContext(sws, frame.width(), frame.height(), static_cast<AVPixelFormat>(frame.pixelFormatFFmpeg()),
+        frame.width(), frame.height(), AV_PIX_FMT_YUV420P, SWS_POINT, nullptr, nullptr, nullptr);
+    if (!sws || !frame.constBits(0)) {
+        AVWarning("MosaicRenderer: can not convert %s.\n", frame.format().name().c_str());
+        return;
+    }
+    AVFrame *f = av_frame_alloc();
+    f->format = AV_PIX_FMT_YUV420P;
+    f->width = frame.width();
+    f->height = frame.height();
+    if (av_frame_get_buffer(f, 0) < 0) {
+        av_frame_free(&f);
+        return;
+    }
+    sws_scale(sws, frame.datas(), frame.lineSize(), 0, frame.height(), f->data, f->linesize);
+    VideoFrame converted(frame.width(), frame.height(), VideoFormat(VideoFormat::Format_YUV420P));
+    converted.setData(f);
+    av_frame_free(&f);
+    converted.setTimestamp(frame.timestamp());
+    converted.setPos(frame.pos());
+    converted.setDisplayAspectRatio(frame.displayAspectRatio());
+    // rgb is converted to bt601 in limited range
+    converted.setColorSpace(frame.format().isRGB() ? ColorSpace_BT601 : frame.colorSpace());
+    converted.setColorRange(frame.format().isRGB() ? ColorRange_Limited : frame.colorRange());
+    VideoRenderer::receive(converted);
+}
+
+static const char *mosaic_attributes[] = {
+    "a_Position",
+    "a_TexCoords",
+    "a_TexMax",
+    "a_Layout",
+    "a_ColorRow0",
+    "a_ColorRow1",
+    "a_ColorRow2",
+    0
+};
+
+static const int mosaic_attribute_sizes[] = { 2, 3, 2, 1, 4, 4, 4 };
+
+static const char *mosaic_vs =
+    "in vec2 a_Position;\n"
+    "in vec3 a_TexCoords;\n"
+    "in vec2 a_TexMax;\n"
+    "in float a_Layout;\n"
+    "in vec4 a_ColorRow0;\n"
+    "in vec4 a_ColorRow1;\n"
+    "in vec4 a_ColorRow2;\n"
+    "out vec3 v_TexCoords;\n"
+    "out vec2 v_TexMax;\n"
+    "out float v_Layout;\n"
+    "out vec4 v_ColorRow0;\n"
+    "out vec4 v_ColorRow1;\n"
+    "out vec4 v_ColorRow2;\n"
+    "void main() {\n"
+    "    gl_Position = vec4(a_Position, 0.0, 1.0);\n"
+    "    v_TexCoords = a_TexCoords;\n"
+    "    v_TexMax = a_TexMax;\n"
+    "    v_Layout = a_Layout;\n"
+    "    v_ColorRow0 = a_ColorRow0;\n"
+    "    v_ColorRow1 = a_ColorRow1;\n"
+    "    v_ColorRow2 = a_ColorRow2;\n"
+    "}\n";
+
+/* 4 taps in the footprint of the pixel, tiles downscaled up to 4x are not aliased.
+ * The taps are clamped in the frame, the rest of the layer is not initialized.
+ * The layout is the same in a triangle, the branches are uniform in the quads of pixels */
+static const char *mosaic_fs =
+    "uniform sampler2DArray u_Texture0;\n"
+    "uniform sampler2DArray u_Texture1;\n"
+    "uniform sampler2DArray u_Texture2;\n"
+    "uniform sampler2DArray u_Texture3;\n"
+    "uniform sampler2DArray u_Texture4;\n"
+    "uniform sampler2DArray u_Texture5;\n"
+    "uniform sampler2DArray u_Texture6;\n"
+    "uniform sampler2DArray u_Texture7;\n"
+    "in vec3 v_TexCoords;\n"
+    "in vec2 v_TexMax;\n"
+    "in float v_Layout;\n"
+    "in vec4 v_ColorRow0;\n"
+    "in vec4 v_ColorRow1;\n"
+    "in vec4 v_ColorRow2;\n"
+    "out vec4 out_color;\n"
+    "vec2 sampleTile(sampler2DArray tex, vec2 d) {\n"
+    "    vec2 c = v_TexCoords.xy;\n"
+    "    float l = v_TexCoords.z;\n"
+    "    return 0.25 * (texture(tex, vec3(clamp(c - d, vec2(0.0), v_TexMax), l)).rg\n"
+    "        + texture(tex, vec3(clamp(c + vec2(d.x, -d.y), vec2(0.0), v_TexMax), l)).rg\n"
+    "        + texture(tex, vec3(clamp(c + vec2(-d.x, d.y), vec2(0.0), v_TexMax), l)).rg\n"
+    "        + texture(tex, vec3(clamp(c + d, vec2(0.0), v_TexMax), l)).rg);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 d = fwidth(v_TexCoords.xy) * 0.25;\n"
+    "    vec4 yuv;\n"
+    "    if (v_Layout < 0.5)\n"
+    "        yuv = vec4(sampleTile(u_Texture0, d).r, sampleTile(u_Texture1, d).r, sampleTile(u_Texture2, d).r, 1.0);\n"
+    "    else if (v_Layout < 1.5)\n"
+    "        yuv = vec4(sampleTile(u_Texture0, d).r, sampleTile(u_Texture3, d), 1.0);\n"
+    "    else if (v_Layout < 2.5)\n"
+    "        yuv = vec4(sampleTile(u_Texture4, d).r, sampleTile(u_Texture5, d).r, sampleTile(u_Texture6, d).r, 1.0);\n"
+    "    else\n"
+    "        yuv = vec4(sampleTile(u_Texture4, d).r, sampleTile(u_Texture7, d), 1.0);\n"
+    "    out_color = clamp(vec4(dot(v_ColorRow0, yuv), dot(v_ColorRow1, yuv), dot(v_ColorRow2, yuv), 1.0), 0.0, 1.0);\n"
+    "}\n";
+
+typedef struct MosaicTile {
+    MosaicTileRenderer *renderer;
+    RectF rect;
+    RectF roi;
+    VideoFrame frame;   /* the frame shown */
+    bool upload;
+} MosaicTile;
+
+class MosaicRendererPrivate
+{
+public:
+    MosaicRendererPrivate():
+        opaque(nullptr),
+        width(0),
+        height(0),
+        program(nullptr),
+        vao(nullptr),
+        vbo(nullptr),
+        layers(0),
+        native16(false),
+        update_geometry(true),
+        vertex_count(0),
+        draw_calls(0)
+    {
+        std::fill(textures, textures + MOSAIC_TEXTURES, 0);
+    }
+    ~MosaicRendererPrivate()
+    {
+        for (size_t i = 0; i < tiles.size(); ++i)
+            releaseTile(tiles[i]);
+        for (int t = 0; t < MOSAIC_TEXTURES; ++t) {
+            if (textures[t])
+                glDeleteTextures(1, &textures[t]);
+        }
+        delete vbo;
+        delete vao;
+        delete program;
+    }
+
+    void releaseTile(MosaicTile &tile) {
+        delete tile.renderer;
+    }
+    int indexOf(VideoRenderer *tile) const {
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            if (tiles[i].renderer == tile)
+                return FORCE_INT(i);
+        }
+        return -1;
+    }
+    bool ensureProgram();
+    bool ensureTextures();
+    void uploadTile(int layer, MosaicTile &tile);
+    void updateGeometry();
+
+    std::mutex mutex;
+    void *opaque;
+    int width, height;
+    Color background;
+    std::vector<MosaicTile> tiles; // the layer of a tile is its index
+    GLShaderProgram *program;
+    GLArray *vao;
+    GLBuffer *vbo;
+    GLuint textures[MOSAIC_TEXTURES]; // the texture arrays, 0 if not allocated
+    Size slot; // of the luma of a layer
+    int layers;
+    bool native16;
+    bool update_geometry;
+    int vertex_count;
+    int draw_calls;
+};
+
+bool MosaicRendererPrivate::ensureProgram()
+{
+    if (program)
+        return program->isLinked();
+    program = new GLShaderProgram();
+    if (!OpenglAide::isTextureArraySupported()) {
+        AVWarning("MosaicRenderer: texture arrays are not supported.\n");
+        return false;
+    }
+    std::string header = OpenglAide::isOpenGLES()
+            ? "#version 300 es\nprecision highp float;\nprecision mediump sampler2DArray;\n" : "#version 130\n";
+    const std::string vs = header + mosaic_vs;
+    const std::string fs = header + mosaic_fs;
+    if (!ShaderCache::load(program, vs, fs)) {
+        program->addShaderFromSourceCode(GLShaderProgram::Vertex, vs.c_str());
+        program->addShaderFromSourceCode(GLShaderProgram::Fragment, fs.c_str());
+        for (int i = 0; mosaic_attributes[i]; ++i)
+            program->bindAttributeLocation(mosaic_attributes[i], i);
+        if (!program->link()) {
+            AVWarning("MosaicRenderer: failed to link the program.\n");
+            return false;
+        }
+        ShaderCache::store(program, vs, fs);
+    }
+    program->bind();
+    for (int t = 0; t < MOSAIC_TEXTURES; ++t) {
+        const std::string name = "u_Texture" + std::to_string(t);
+        program->setUniformValue(program->uniformLocation(name.c_str()), (GLint)t);
+    }
+    program->unBind();
+    // frames of more than 8 bits are converted in the video thread if not supported
+    native16 = OpenglAide::has16BitTexture();
+
+    vao = new GLArray();
+    vao->create();
+    vao->bind();
+    vbo = new GLBuffer(GLBuffer::VertexBuffer);
+    vbo->create();
+    vbo->bind();
+    int offset = 0;
+    for (int i = 0; mosaic_attributes[i]; ++i) {
+        glVertexAttribPointer(i, mosaic_attribute_sizes[i], GL_FLOAT, GL_FALSE,
+                              MOSAIC_VERTEX_FLOATS * sizeof(GLfloat), BUFFER_OFFSET(offset * sizeof(GLfloat)));
+        glEnableVertexAttribArray(i);
+        offset += mosaic_attribute_sizes[i];
+    }
+    vao->unbind();
+    vbo->unbind();
+    return true;
+}
+
+bool MosaicRendererPrivate::ensureTextures()
+{
+    // a layer for each tile, as large as the largest frame
+    Size s = slot;
+    bool used[MOSAIC_TEXTURES] = { false };
+    bool allocate = false;
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const VideoFrame &f = tiles[i].frame;
+        if (!f.isValid())
+            continue;
+        s.width = std::max(s.width, (f.width() + 1) & ~1);
+        s.height = std::max(s.height, (f.height() + 1) & ~1);
+        const int layout = layoutOf(f.format(), native16);
+        if (layout == Layout_None)
+            continue;
+        for (int p = 0; p < MOSAIC_PLANES && layout_textures[layout][p] >= 0; ++p) {
+            const int t = layout_textures[layout][p];
+            used[t] = true;
+            allocate |= !textures[t];
+        }
+    }
+    const int n = std::max(FORCE_INT(tiles.size()), 1);
+    if (!allocate && s == slot && n <= layers)
+        return layers > 0;
+    if (s.width <= 0 || s.height <= 0)
+        return false;
+    AVDebug("MosaicRenderer: %d layers of %dx%d.\n", n, s.width, s.height);
+    for (int t = 0; t < MOSAIC_TEXTURES; ++t) {
+        // the arrays of the layouts not shown any more are released
+        if (!used[t]) {
+            if (textures[t])
+                glDeleteTextures(1, &textures[t]);
+            textures[t] = 0;
+            continue;
+        }
+        const MosaicTextureFormat &tf = mosaic_textures[t];
+        if (!textures[t])
+            glGenTextures(1, &textures[t]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[t]);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        const int w = tf.chroma ? s.width / 2 : s.width;
+        const int h = tf.chroma ? s.height / 2 : s.height;
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, tf.internal_format, w, h, n, 0, tf.format, tf.type, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    slot = s;
+    layers = n;
+    // the contents are lost, and the texture coordinates are changed
+    for (size_t i = 0; i < tiles.size(); ++i)
+        tiles[i].upload = tiles[i].frame.isValid();
+    update_geometry = true;
+    return true;
+}
+
+void MosaicRendererPrivate::uploadTile(int layer, MosaicTile &tile)
+{
+    const VideoFrame &f = tile.frame;
+    // converted in the video thread, or received before 16 bits are known to be supported
+    const int layout = layoutOf(f.format(), native16);
+    if (layout == Layout_None || !f.constBits(0))
+        return;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int p = 0; p < MOSAIC_PLANES && layout_textures[layout][p] >= 0; ++p) {
+        const int t = layout_textures[layout][p];
+        const MosaicTextureFormat &tf = mosaic_textures[t];
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[t]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, f.bytesPerLine(p) / tf.bytes);
+        const int w = tf.chroma ? (f.width() + 1) / 2 : f.width();
+        const int h = tf.chroma ? (f.height() + 1) / 2 : f.height();
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, w, h, 1, tf.format, tf.type, f.constBits(p));
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void MosaicRendererPrivate::updateGeometry()
+{
+    std::vector<GLfloat> v;
+    v.reserve(tiles.size() * 6 * MOSAIC_VERTEX_FLOATS);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const MosaicTile &tile = tiles[i];
+        const VideoFrame &f = tile.frame;
+        if (!f.isValid() || tile.rect.width() <= 0 || tile.rect.height() <= 0)
+            continue;
+        const RectF roi = tile.roi.isValid() ? tile.roi : RectF(0, 0, 1, 1);
+        // the roi keeps the display aspect ratio, centered in the rect
+        const double dar = f.displayAspectRatio() * roi.width() / roi.height();
+        RectF r = tile.rect;
+        if (r.width() / r.height() > dar) {
+            const double w = r.height() * dar;
+            r = RectF(r.x() + (r.width() - w) / 2.0, r.y(), w, r.height());
+        } else {
+            const double h = r.width() / dar;
+            r = RectF(r.x(), r.y() + (r.height() - h) / 2.0, r.width(), h);
+        }
+        const float x0 = r.x() * 2.0 / width - 1.0, x1 = (r.x() + r.width()) * 2.0 / width - 1.0;
+        const float y0 = 1.0 - r.y() * 2.0 / height, y1 = 1.0 - (r.y() + r.height()) * 2.0 / height;
+        const float sw = (float)f.width() / slot.width, sh = (float)f.height() / slot.height;
+        const float u0 = roi.x() * sw, u1 = (roi.x() + roi.width()) * sw;
+        const float v0 = roi.y() * sh, v1 = (roi.y() + roi.height()) * sh;
+        // a luma texel inside, it is half a texel of chroma
+        const float max_u = (f.width() - 1.0f) / slot.width, max_v = (f.height() - 1.0f) / slot.height;
+        ColorSpace cs = f.colorSpace();
+        if (cs != ColorSpace_BT601 && cs != ColorSpace_BT709 && cs != ColorSpace_BT2020)
+            cs = f.width() >= 1280 || f.height() > 576 ? ColorSpace_BT709 : ColorSpace_BT601;
+        ColorTransform ct;
+        ct.setInputColorSpace(cs);
+        ct.setInputColorRange(f.colorRange());
+        ct.setOutputColorRange(ColorRange_Full);
+        Matrix4x4 m = ct.matrixRef();
+        const int layout = layoutOf(f.format(), native16);
+        // 9 to 14 bits in the low bits of the 16 bit textures, p010 is in the high bits
+        if (layout == Layout_YUV16) {
+            const float scale = 65535.0f / ((1 << f.format().bitsPerComponent()) - 1);
+            for (int r = 0; r < 3; ++r) {
+                for (int c = 0; c < 3; ++c)
+                    m(r, c) *= scale;
+            }
+        }
+        // nv21 is vu
+        if (f.format().pixelFormatFFmpeg() == AV_PIX_FMT_NV21) {
+            for (int r = 0; r < 3; ++r)
+                std::swap(m(r, 1), m(r, 2));
+        }
+        const float corners[6][4] = {
+            { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x0, y1, u0, v1 },
+            { x0, y1, u0, v1 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 }
+        };
+        for (int c = 0; c < 6; ++c) {
+            const GLfloat vertex[MOSAIC_VERTEX_FLOATS] = {
+                corners[c][0], corners[c][1],
+                corners[c][2], corners[c][3], (GLfloat)i,
+                max_u, max_v,
+                (GLfloat)layout,
+                m(0, 0), m(0, 1), m(0, 2), m(0, 3),
+                m(1, 0), m(1, 1), m(1, 2), m(1, 3),
+                m(2, 0), m(2, 1), m(2, 2), m(2, 3)
+            };
+            v.insert(v.end(), vertex, vertex + MOSAIC_VERTEX_FLOATS);
+        }
+    }
+    vertex_count = FORCE_INT(v.size() / MOSAIC_VERTEX_FLOATS);
+    vbo->bind();
+    vbo->allocate(v.data(), FORCE_INT(v.size() * sizeof(GLfloat)));
+    vbo->unbind();
+    update_geometry = false;
+}
+
+MosaicRenderer::MosaicRenderer():
+    d_ptr(new MosaicRendererPrivate)
+{
+
+}
+
+MosaicRenderer::~MosaicRenderer()
+{
+
+}
+
+void MosaicRenderer::setOpaque(void *o)
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    d->opaque = o;
+    for (size_t i = 0; i < d->tiles.size(); ++i)
+        d->tiles[i].renderer->setOpaque(o);
+}
+
+void *MosaicRenderer::opaque() const
+{
+    return d_func()->opaque;
+}
+
+VideoRenderer *MosaicRenderer::addTile(const RectF &rect)
+{
+    DPTR_D(MosaicRenderer);
+    MosaicTile tile;
+    tile.renderer = new MosaicTileRenderer();
+    tile.renderer->setOpaque(d->opaque);
+    tile.rect = rect;
+    tile.upload = false;
+    DECL_LOCKGUARD(d->mutex);
+    tile.renderer->native16 = d->native16;
+    d->tiles.push_back(tile);
+    d->update_geometry = true;
+    return tile.renderer;
+}
+
+void MosaicRenderer::removeTile(VideoRenderer *tile)
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    const int i = d->indexOf(tile);
+    if (i < 0)
+        return;
+    d->releaseTile(d->tiles[i]);
+    d->tiles.erase(d->tiles.begin() + i);
+    // the layers of the tiles after it are changed
+    for (size_t j = i; j < d->tiles.size(); ++j)
+        d->tiles[j].upload = d->tiles[j].frame.isValid();
+    d->update_geometry = true;
+}
+
+int MosaicRenderer::tileCount() const
+{
+    DPTR_D(const MosaicRenderer);
+    return FORCE_INT(d->tiles.size());
+}
+
+void MosaicRenderer::setTileRect(VideoRenderer *tile, const RectF &rect)
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    const int i = d->indexOf(tile);
+    if (i < 0)
+        return;
+    d->tiles[i].rect = rect;
+    d->update_geometry = true;
+}
+
+void MosaicRenderer::setTileROI(VideoRenderer *tile, const RectF &roi)
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    const int i = d->indexOf(tile);
+    if (i < 0)
+        return;
+    d->tiles[i].roi = roi;
+    d->update_geometry = true;
+}
+
+void MosaicRenderer::setBackgroundColor(const Color &c)
+{
+    DPTR_D(MosaicRenderer);
+    d->background = c;
+}
+
+void MosaicRenderer::resizeWindow(int width, int height)
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    if (d->width == width && d->height == height)
+        return;
+    d->width = width;
+    d->height = height;
+    d->update_geometry = true;
+}
+
+void MosaicRenderer::renderVideo()
+{
+    DPTR_D(MosaicRenderer);
+    DECL_LOCKGUARD(d->mutex);
+    d->draw_calls = 0;
+    if (d->width <= 0 || d->height <= 0)
+        return;
+    glViewport(0, 0, d->width, d->height);
+    glClearColor(d->background.r / 255.0f, d->background.g / 255.0f, d->background.b / 255.0f, d->background.a / 255.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!d->ensureProgram())
+        return;
+    for (size_t i = 0; i < d->tiles.size(); ++i) {
+        MosaicTile &tile = d->tiles[i];
+        tile.renderer->native16 = d->native16;
+        VideoFrame frame;
+        if (!tile.renderer->takeReceived(frame) || !frame.isValid())
+            continue;
+        const VideoFrame &last = tile.frame;
+        if (!last.isValid() || last.width() != frame.width() || last.height() != frame.height()
+                || last.displayAspectRatio() != frame.displayAspectRatio()
+                || last.colorSpace() != frame.colorSpace() || last.colorRange() != frame.colorRange()
+                || last.format() != frame.format())
+            d->update_geometry = true;
+        tile.frame = frame;
+        tile.upload = true;
+    }
+    if (!d->ensureTextures())
+        return;
+    for (size_t i = 0; i < d->tiles.size(); ++i) {
+        if (!d->tiles[i].upload)
+            continue;
+        d->uploadTile(FORCE_INT(i), d->tiles[i]);
+        d->tiles[i].upload = false;
+    }
+    if (d->update_geometry)
+        d->updateGeometry();
+    if (d->vertex_count <= 0)
+        return;
+    d->program->bind();
+    for (int t = 0; t < MOSAIC_TEXTURES; ++t) {
+        glActiveTexture(GL_TEXTURE0 + t);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, d->textures[t]);
+    }
+    d->vao->bind();
+    glDrawArrays(GL_TRIANGLES, 0, d->vertex_count);
+    d->draw_calls = 1;
+    d->vao->unbind();
+    for (int t = MOSAIC_TEXTURES - 1; t >= 0; --t) {
+        glActiveTexture(GL_TEXTURE0 + t);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    d->program->unBind();
+}
+
+int MosaicRenderer::drawCalls() const
+{
+    DPTR_D(const MosaicRenderer);
+    return d->draw_calls;
+}
+
+NAMESPACE_END
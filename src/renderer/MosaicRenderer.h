@@ -0,0 +1,65 @@
+#ifndef MOSAICRENDERER_H
+#define MOSAICRENDERER_H
+
+#include "sdk/DPTR.h"
+#include "sdk/global.h"
+#include "renderer/RectF.h"
+
+NAMESPACE_BEGIN
+
+class VideoRenderer;
+class MosaicRendererPrivate;
+/**
+ * @brief The MosaicRenderer class
+ * Composes the videos of many players into one surface, e.g. a video wall. The frames of
+ * the tiles are uploaded to the layers of texture arrays, and all tiles are drawn by one
+ * program in one draw call. yuv420p, nv12 and their 16bit formats(p010, yuv420p10 etc.) are
+ * uploaded as they are, the other formats are converted to yuv420p in the video thread.
+ * Requires GL 3.0 or ES 3.0. Created, rendered and deleted in the GL thread.
+ */
+class MosaicRenderer
+{
+    DPTR_DECLARE_PRIVATE(MosaicRenderer)
+public:
+    MosaicRenderer();
+    ~MosaicRenderer();
+
+    /**
+     * @brief the opaque passed to the render callback of the tiles
+     */
+    void setOpaque(void* o);
+    void* opaque() const;
+    /**
+     * @brief add a tile to receive the frames of a player, see Player::addVideoRenderer().
+     * The renderer is owned by the mosaic, it is not rendered by itself
+     * @param rect in pixels of the surface, the video keeps its aspect ratio in it
+     */
+    VideoRenderer *addTile(const RectF &rect);
+    /**
+     * @brief remove the tile from the player before
+     */
+    void removeTile(VideoRenderer *tile);
+    int tileCount() const;
+    void setTileRect(VideoRenderer *tile, const RectF &rect);
+    /**
+     * @brief the region of the frames shown in the tile, normalized. The whole frame by default
+     */
+    void setTileROI(VideoRenderer *tile, const RectF &roi);
+
+    void setBackgroundColor(const Color &c);
+    void resizeWindow(int width, int height);
+    /**
+     * @brief upload the frames received since the last call, and draw all tiles
+     */
+    void renderVideo();
+    /**
+     * @brief the draw calls of the last renderVideo(), 1 unless no tile has a frame
+     */
+    int drawCalls() const;
+
+private:
+    DPTR_DECLARE(MosaicRenderer)
+};
+
+NAMESPACE_END
+#endif //MOSAICRENDERER_H
@@ -569,5 +569,80 @@ bool isPBOSupported() {
     return supported;
 }
 
+bool hasUnpackRowLength() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    const char* exts[] = {
+        "GL_EXT_unpack_subimage", //OpenGL ES2
+        NULL
+    };
+    supported = !isOpenGLES() || getOpenglVersion().major >= 3 || hasExtension(exts);
+    return !!supported;
+}
+
+bool isSyncSupported() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    const char* exts[] = {
+        "GL_ARB_sync",
+        "GL_APPLE_sync", //OpenGL ES
+        NULL
+    };
+    supported = (GLAD_GL_VERSION_3_2 || hasExtension(exts)) && glFenceSync && glClientWaitSync;
+    return !!supported;
+}
+
+bool isBufferStorageSupported() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    const char* exts[] = {
+        "GL_ARB_buffer_storage",
+        NULL
+    };
+    supported = (GLAD_GL_VERSION_4_4 || hasExtension(exts)) && glBufferStorage;
+    return !!supported;
+}
+
+bool isProgramBinarySupported() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    const char* exts[] = {
+        "GL_ARB_get_program_binary",
+        "GL_OES_get_program_binary", //OpenGL ES2
+        NULL
+    };
+    supported = (GLAD_GL_VERSION_4_1 || hasExtension(exts)) && glGetProgramBinary && glProgramBinary;
+    if (supported) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    return !!supported;
+}
+
+bool isFloatTextureSupported() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    const char* exts[] = {
+        "GL_ARB_texture_float",
+        NULL
+    };
+    supported = (getOpenglVersion().major >= 3 || hasExtension(exts)) && glGenerateMipmap;
+    return !!supported;
+}
+
+bool isTextureArraySupported() {
+    static int supported = -1;
+    if (supported >= 0)
+        return !!supported;
+    supported = getOpenglVersion().major >= 3 && glTexImage3D && GLSLVersion() >= 130;
+    return !!supported;
+}
+
 }
 NAMESPACE_END
@@ -51,6 +51,30 @@ int bytesOfTexel(GLenum format, GLenum dataType);
 int GLSLVersion();
 
 bool isPBOSupported();
+/**
+ * GL_UNPACK_ROW_LENGTH, lines with padding can be uploaded without copy
+ */
+bool hasUnpackRowLength();
+/**
+ * fences, required to reuse a PBO without waiting in glMapBuffer
+ */
+bool isSyncSupported();
+/**
+ * immutable storage, a PBO can be mapped persistently
+ */
+bool isBufferStorageSupported();
+/**
+ * glGetProgramBinary/glProgramBinary and at least 1 binary format
+ */
+bool isProgramBinarySupported();
+/**
+ * GL_RGBA16F textures with linear filtering, and glGenerateMipmap
+ */
+bool isFloatTextureSupported();
+/**
+ * GL_TEXTURE_2D_ARRAY and sampler2DArray, GL 3.0 or ES 3.0
+ */
+bool isTextureArraySupported();
 
 }
 NAMESPACE_END
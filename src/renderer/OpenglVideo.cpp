@@ -9,6 +9,8 @@
 //#include <GL/GLU.h>
 //#define TEST_YUV
 #include "glpackage.h"
+#include <cmath>
+#include <mutex>
 //#include <windows.h>
 //#include <WINGDI.h>
 
@@ -48,7 +50,9 @@ public:
 		mesh_type(OpenglVideo::RectMesh),
 		geometry(nullptr),
 		gr(nullptr),
-		user_shader(nullptr)
+		user_shader(nullptr),
+		deinterlace(Deinterlace_Adaptive),
+		scale_filter(Scale_Bilinear)
 	{
         //sub_render.setFontFile("E:/ht.ttf");
 	}
@@ -62,6 +66,7 @@ public:
 
 	ShaderManager *manager;
 	VideoMaterial *material;
+	std::mutex material_mutex; // the material is recreated in the GL thread while frames are staged
 	long long material_type;
 	bool norm_viewport;
 	bool has_a;
@@ -78,6 +83,9 @@ public:
 	GeometryRenderer* gr;
 	VideoShader *user_shader;
     Color background;
+    SharedTexturesPtr shared_textures;
+    DeinterlaceMode deinterlace;
+    ScaleFilter scale_filter;
     //SubtitleRender sub_render;
 };
 
@@ -278,12 +286,12 @@ void OpenglVideo::initGL()
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width / 2, height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
 
+#ifdef TEST_YUV
 	//分配材质内存空间
 	datas[0] = new unsigned char[width * height];       //y
 	datas[1] = new unsigned char[width * height / 4];   //u
 	datas[2] = new unsigned char[width * height / 4];   //v
 
-#ifdef TEST_YUV
 	fp = fopen("E://out400x240.yuv", "rb");
 	if (!fp) {
 		printf("Read file failed!\n");
@@ -310,45 +318,35 @@ void OpenglVideo::renderVideo(const VideoFrame &frame)
 	fread(datas[0], 1, width * height, fp);
 	fread(datas[1], 1, width * height / 4, fp);
 	fread(datas[2], 1, width * height / 4, fp);
+	const unsigned char *planes[3] = { datas[0], datas[1], datas[2] };
+	const int row_length[3] = { width, width / 2, width / 2 };
 #else
-	int type = frame.pixelFormat();
 	int width = frame.width(), height = frame.height();
-    if (width == frame.bytesPerLine(0))
-    {
-        memcpy(datas[0], frame.constBits(0), width * height);
-        memcpy(datas[1], frame.constBits(1), width * height / 4);
-        memcpy(datas[2], frame.constBits(2), width * height / 4);
-    }
-    else
-    {
-        for(int i = 0; i < height; i++) //Y
-            memcpy(datas[0] + width*i, frame.constBits(0) + frame.bytesPerLine(0)*i, width);
-        for (int i = 0; i < height/2; i++) //U
-            memcpy(datas[1] + width/2*i, frame.constBits(1) + frame.bytesPerLine(1)*i, width / 2); //if not use "width / 2", the program will crash when exit. 2020-08-03
-        for (int i = 0; i < height/2; i++) //V
-            memcpy(datas[2] + width/2*i, frame.constBits(2) + frame.bytesPerLine(2)*i, width / 2);
-
-    }
+	// the lines are uploaded from the frame directly, the padding is skipped by the row length
+	const unsigned char *planes[3] = { frame.constBits(0), frame.constBits(1), frame.constBits(2) };
+	const int row_length[3] = { frame.bytesPerLine(0), frame.bytesPerLine(1), frame.bytesPerLine(2) };
 #endif
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texs[0]);  //0层绑定到y材质
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length[0]);
 	//copy the data to texture
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, datas[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, planes[0]);
 	glUniform1i(unis[0], 0);
 
 	glActiveTexture(GL_TEXTURE0 + 1);
 	glBindTexture(GL_TEXTURE_2D, texs[1]);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, datas[1]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length[1]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, planes[1]);
 	glUniform1i(unis[1], 1);
 
 	glActiveTexture(GL_TEXTURE0 + 2);
 	glBindTexture(GL_TEXTURE_2D, texs[2]);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, datas[2]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length[2]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, planes[2]);
 	glUniform1i(unis[2], 2);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	vao->unbind();
@@ -361,12 +359,15 @@ void OpenglVideo::initialize()
 	DPTR_D(OpenglVideo);
 
 	fill(d->background);
+	std::unique_lock<std::mutex> lock(d->material_mutex);
 	double b = 0, c = 0, h = 0, s = 0;
+	ToneMapping tone = ToneMapping_Hable;
 	if (d->material) {
 		b = d->material->brightness();
 		c = d->material->contrast();
 		h = d->material->hue();
 		s = d->material->saturation();
+		tone = d->material->toneMapping();
 		delete d->material;
 		d->material = nullptr;
 	}
@@ -376,6 +377,11 @@ void OpenglVideo::initialize()
 	d->material->setContrast(c);
 	d->material->setHue(h);
 	d->material->setSaturation(s);
+	d->material->setToneMapping(tone);
+	d->material->setDeinterlace(d->deinterlace);
+	d->material->setScaleFilter(d->scale_filter);
+	d->material->setSharedTextures(d->shared_textures);
+	lock.unlock();
 	updateViewport();
 	if (d->manager)
 		return;
@@ -399,6 +405,15 @@ void OpenglVideo::initialize()
 	}
 }
 
+bool OpenglVideo::stageFrame(const VideoFrame &frame)
+{
+	DPTR_D(OpenglVideo);
+	std::lock_guard<std::mutex> lock(d->material_mutex);
+	if (!d->material)
+		return false;
+	return d->material->stageFrame(frame);
+}
+
 void OpenglVideo::setCurrentFrame(const VideoFrame & frame)
 {
 	DPTR_D(OpenglVideo);
@@ -416,6 +431,14 @@ void OpenglVideo::render(const RectF &target, const RectF& roi, const Matrix4x4&
             , VideoMaterial::typeName(mt).c_str());
 		d->material_type = mt;
 	}
+	if (d->norm_viewport && roi.isValid()) {
+		// the quad is 2x2, its edges on screen are the columns of the matrix in pixels
+		const Matrix4x4 m = transform*d->matrix;
+		const float w = std::sqrt(std::pow(m(0, 0)*d->rect.width(), 2) + std::pow(m(1, 0)*d->rect.height(), 2));
+		const float h = std::sqrt(std::pow(m(0, 1)*d->rect.width(), 2) + std::pow(m(1, 1)*d->rect.height(), 2));
+		if (w > 0 && h > 0)
+			d->material->setOutputScale(roi.width() / w, roi.height() / h);
+	}
 	if (!d->material->bind()) // bind first because texture parameters(target) mapped from native buffer is unknown before it
 		return;
 	VideoShader *shader = d->user_shader;
@@ -484,4 +507,55 @@ void OpenglVideo::setViewPort(RectF roi)
 	glViewport(d->rect.x(), d->rect.y(), d->rect.width(), d->rect.height());
 }
 
+void OpenglVideo::setToneMapping(ToneMapping value)
+{
+	DPTR_D(OpenglVideo);
+	if (d->material)
+		d->material->setToneMapping(value);
+}
+
+void OpenglVideo::setDeinterlace(DeinterlaceMode value)
+{
+	DPTR_D(OpenglVideo);
+	d->deinterlace = value;
+	if (d->material)
+		d->material->setDeinterlace(value);
+}
+
+void OpenglVideo::setScaleFilter(ScaleFilter value)
+{
+	DPTR_D(OpenglVideo);
+	d->scale_filter = value;
+	if (d->material)
+		d->material->setScaleFilter(value);
+}
+
+void OpenglVideo::setField(int field)
+{
+	DPTR_D(OpenglVideo);
+	if (d->material)
+		d->material->setField(field);
+}
+
+void OpenglVideo::setSharedTextures(const SharedTexturesPtr &textures)
+{
+	DPTR_D(OpenglVideo);
+	d->shared_textures = textures;
+	if (d->material)
+		d->material->setSharedTextures(textures);
+}
+
+SharedTexturesPtr OpenglVideo::sharedTextures() const
+{
+	return d_func()->shared_textures;
+}
+
+UploadStatistics OpenglVideo::uploadStatistics() const
+{
+	DPTR_D(const OpenglVideo);
+	if (!d->material)
+		return UploadStatistics();
+	return d->material->uploadStatistics();
+}
+
 NAMESPACE_END
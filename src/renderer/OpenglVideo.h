@@ -16,6 +16,7 @@ extern "C" {
 #include "renderer/glpackage.h"
 #include "sdk/mediainfo.h"
 #include "VideoFrame.h"
+#include "VideoMaterial.h"
 #include "Matrix4x4.h"
 #include "RectF.h"
 
@@ -73,6 +74,10 @@ public:
 	void renderVideo(const VideoFrame &frame);
 
 	void initialize();
+	/**
+	 * @brief copy the frame to the PBOs in the thread of the frames, see VideoMaterial::stageFrame()
+	 */
+	bool stageFrame(const VideoFrame& frame);
 	void setCurrentFrame(const VideoFrame& frame);
 	void render(const RectF &target, const RectF& roi, const Matrix4x4& transform);
 	void updateViewport();
@@ -83,6 +88,23 @@ public:
 
 	void setViewPort(RectF roi);
 
+	void setToneMapping(ToneMapping value);
+	void setDeinterlace(DeinterlaceMode value);
+	/**
+	 * @brief the filter of the video scaled, see VideoMaterial::setScaleFilter()
+	 */
+	void setScaleFilter(ScaleFilter value);
+	/**
+	 * @brief the field of the current frame to show, see VideoMaterial::setField()
+	 */
+	void setField(int field);
+	UploadStatistics uploadStatistics() const;
+	/**
+	 * @brief upload the frames once for the OpenglVideos in shared GL contexts
+	 */
+	void setSharedTextures(const SharedTexturesPtr &textures);
+	SharedTexturesPtr sharedTextures() const;
+
 private:
 	DPTR_DECLARE(OpenglVideo);
 
@@ -0,0 +1,159 @@
+#include "ShaderCache.h"
+#include "glpackage.h"
+#include "OpenglAide.h"
+#include "AVLog.h"
+#include "glad/glad.h"
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+#define SHADER_CACHE_MAGIC 0x534D4950 /* "SMIP" */
+#define SHADER_CACHE_VERSION 1
+
+NAMESPACE_BEGIN
+namespace ShaderCache
+{
+
+typedef struct ProgramBinary {
+    std::string driver;
+    GLenum format;
+    std::vector<char> data;
+} ProgramBinary;
+
+static std::mutex cache_mutex;
+static std::string cache_dir;
+static std::map<uint64_t, ProgramBinary> binaries;
+
+/* FNV-1a, the same in every run unlike std::hash */
+static uint64_t hashString(const std::string &s, uint64_t h = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < s.size(); ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static std::string driverString()
+{
+    std::string s;
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        const char *v = (const char*)glGetString(names[i]);
+        if (v)
+            s += v;
+        s += "\n";
+    }
+    return s;
+}
+
+static std::string filePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return cache_dir + "/" + name;
+}
+
+static bool readFile(const std::string &file, ProgramBinary &b)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+        return false;
+    int32_t header[5];
+    bool ok = fread(header, sizeof(header), 1, fp) == 1
+            && header[0] == SHADER_CACHE_MAGIC && header[1] == SHADER_CACHE_VERSION
+            && header[3] > 0 && header[4] > 0;
+    if (ok) {
+        b.format = header[2];
+        b.driver.resize(header[3]);
+        b.data.resize(header[4]);
+        ok = fread(&b.driver[0], 1, b.driver.size(), fp) == b.driver.size()
+                && fread(b.data.data(), 1, b.data.size(), fp) == b.data.size();
+    }
+    fclose(fp);
+    if (!ok)
+        AVWarning("ShaderCache: invalid program binary %s.\n", file.c_str());
+    return ok;
+}
+
+static bool writeFile(const std::string &file, const ProgramBinary &b)
+{
+    // written to a temporary file first, another process may read it
+    const std::string tmp = file + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp) {
+        AVWarning("ShaderCache: can not open %s.\n", tmp.c_str());
+        return false;
+    }
+    const int32_t header[] = { SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, FORCE_INT(b.format),
+                               FORCE_INT(b.driver.size()), FORCE_INT(b.data.size()) };
+    const bool ok = fwrite(header, sizeof(header), 1, fp) == 1
+            && fwrite(b.driver.data(), 1, b.driver.size(), fp) == b.driver.size()
+            && fwrite(b.data.data(), 1, b.data.size(), fp) == b.data.size();
+    fclose(fp);
+    remove(file.c_str());
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void setDirectory(const std::string &dir)
+{
+    DECL_LOCKGUARD(cache_mutex);
+    cache_dir = dir;
+}
+
+std::string directory()
+{
+    DECL_LOCKGUARD(cache_mutex);
+    return cache_dir;
+}
+
+bool load(GLShaderProgram *program, const std::string &vertex, const std::string &fragment)
+{
+    if (!OpenglAide::isProgramBinarySupported())
+        return false;
+    const std::string driver = driverString();
+    const uint64_t key = hashString(driver, hashString(fragment, hashString(vertex)));
+    ProgramBinary b;
+    {
+        DECL_LOCKGUARD(cache_mutex);
+        std::map<uint64_t, ProgramBinary>::const_iterator it = binaries.find(key);
+        if (it != binaries.end())
+            b = it->second;
+        else if (cache_dir.empty() || !readFile(filePath(key), b))
+            return false;
+    }
+    if (b.driver != driver)
+        return false;
+    if (!program->setProgramBinary(b.format, b.data.data(), FORCE_INT(b.data.size()))) {
+        // e.g. the driver is updated but the version string is not changed
+        AVWarning("ShaderCache: the program binary is rejected, compile the shaders.\n");
+        DECL_LOCKGUARD(cache_mutex);
+        binaries.erase(key);
+        return false;
+    }
+    AVDebug("ShaderCache: program %016llx is linked from the binary.\n", (unsigned long long)key);
+    DECL_LOCKGUARD(cache_mutex);
+    binaries[key] = b;
+    return true;
+}
+
+void store(GLShaderProgram *program, const std::string &vertex, const std::string &fragment)
+{
+    ProgramBinary b;
+    if (!program->programBinary(&b.format, b.data))
+        return;
+    b.driver = driverString();
+    const uint64_t key = hashString(b.driver, hashString(fragment, hashString(vertex)));
+    DECL_LOCKGUARD(cache_mutex);
+    if (!cache_dir.empty() && !writeFile(filePath(key), b))
+        AVWarning("ShaderCache: failed to write the program binary to %s.\n", cache_dir.c_str());
+    binaries[key] = b;
+}
+
+}
+NAMESPACE_END
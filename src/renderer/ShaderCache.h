@@ -0,0 +1,32 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <string>
+#include "sdk/global.h"
+
+NAMESPACE_BEGIN
+
+class GLShaderProgram;
+/**
+ * The binaries of linked programs, in memory and in the directory if set. A binary
+ * is keyed by the hash of the shader sources and the driver(vendor, renderer, version),
+ * and a mismatched binary is compiled again.
+ * The functions must be called in a GL thread.
+ */
+namespace ShaderCache
+{
+
+/**
+ * empty to cache in memory only, default
+ */
+void setDirectory(const std::string &dir);
+std::string directory();
+/**
+ * @return true if the program is linked from the binary cached
+ */
+bool load(GLShaderProgram *program, const std::string &vertex, const std::string &fragment);
+void store(GLShaderProgram *program, const std::string &vertex, const std::string &fragment);
+
+}
+NAMESPACE_END
+#endif // SHADER_CACHE_H
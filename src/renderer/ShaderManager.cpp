@@ -2,7 +2,12 @@
 #include "VideoShader.h"
 #include "VideoMaterial.h"
 #include "AVLog.h"
+#include "glad/glad.h"
 #include <map>
+#include <set>
+extern "C" {
+#include "libavutil/time.h"
+}
 
 NAMESPACE_BEGIN
 
@@ -48,4 +53,39 @@ VideoShader* ShaderManager::prepareMaterial(VideoMaterial *material, int materia
 	return shader;
 }
 
+void ShaderManager::prewarm(const std::vector<VideoFormat> &formats)
+{
+	std::vector<VideoFormat> fmts(formats);
+	if (fmts.empty()) {
+		const VideoFormat::PixelFormat common[] = {
+			VideoFormat::Format_YUV420P, VideoFormat::Format_NV12, VideoFormat::Format_YUV422P,
+			VideoFormat::Format_YUV444P, VideoFormat::Format_RGB32,
+			VideoFormat::Format_YUV420P10LE, VideoFormat::Format_P010LE
+		};
+		for (size_t i = 0; i < sizeof(common) / sizeof(common[0]); ++i)
+			fmts.push_back(VideoFormat(common[i]));
+	}
+	const ColorTransfer transfers[] = { ColorTransfer_SDR, ColorTransfer_PQ, ColorTransfer_HLG };
+	const int64_t start = av_gettime_relative();
+	std::set<int> types;
+	for (size_t i = 0; i < fmts.size(); ++i) {
+		if (!fmts[i].isValid())
+			continue;
+		// HDR video is 10 bits at least
+		const int nb_transfers = fmts[i].bitsPerComponent() > 8 ? 3 : 1;
+		for (int t = 0; t < nb_transfers; ++t) {
+			const int type = VideoMaterial::typeOf(fmts[i], GL_TEXTURE_2D, transfers[t], ToneMapping_Hable);
+			if (!types.insert(type).second)
+				continue;
+			VideoShader shader;
+			shader.setVideoFormat(fmts[i]);
+			shader.setTextureTarget(GL_TEXTURE_2D);
+			shader.setMaterialType(type);
+			shader.initialize();
+		}
+	}
+	AVDebug("[ShaderManager] %d programs are prewarmed in %lld ms.\n", FORCE_INT(types.size()),
+		(long long)(av_gettime_relative() - start) / 1000);
+}
+
 NAMESPACE_END
@@ -3,6 +3,8 @@
 
 #include <sdk/DPTR.h>
 #include "global.h"
+#include "VideoFormat.h"
+#include <vector>
 
 NAMESPACE_BEGIN
 class VideoShader;
@@ -20,6 +22,13 @@ public:
     ShaderManager();
     ~ShaderManager();
     VideoShader* prepareMaterial(VideoMaterial *material, int materialType = -1);
+    /*!
+     * \brief prewarm
+     * Build the programs of the formats in the current GL context, e.g. a background
+     * context at startup, so their binaries are cached before the first frame(see ShaderCache).
+     * Common formats, including the HDR ones, if empty
+     */
+    static void prewarm(const std::vector<VideoFormat> &formats = std::vector<VideoFormat>());
 //    void setCacheSize(int value);
 
 private:
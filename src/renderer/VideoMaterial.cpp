@@ -9,12 +9,141 @@
 
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <mutex>
 #include <math.h>
+extern "C" {
+#include "libavutil/time.h"
+}
 
 #define YUVA_DONE 0
+/* the PBOs of a plane are used in turn, the GPU can copy from one while the next one is filled */
+#define PBO_RING_SIZE 3
+/* nanoseconds to wait for the GPU before uploading from the frame directly */
+#define PBO_WAIT_TIMEOUT 2000000
+/* textures and PBOs released by a change of size or format are kept for the next change, e.g. of adaptive streams */
+#define POOL_MAX_TEXTURES 12
+#define POOL_MAX_PBO_RINGS 8
+/* microseconds, the pool is trimmed on changes only */
+#define POOL_IDLE_TIMEOUT 10000000
+
+typedef struct PBOSlot {
+    GLuint id;
+    GLubyte *mapped;    /* the persistent mapping, null if mapped for each upload */
+    int size;
+} PBOSlot;
+
+typedef struct TextureKey {
+    GLint internal_format;
+    GLenum format;
+    GLenum type;
+    int width, height;
+    bool operator==(const TextureKey &other) const {
+        return internal_format == other.internal_format && format == other.format && type == other.type
+                && width == other.width && height == other.height;
+    }
+} TextureKey;
+
+typedef struct PooledTexture {
+    GLuint id;
+    TextureKey key;
+    int64_t released;
+} PooledTexture;
+
+typedef struct PooledPBORing {
+    std::vector<PBOSlot> ring;
+    int64_t released;
+} PooledPBORing;
 
 NAMESPACE_BEGIN
 
+class SharedTextures
+{
+public:
+    SharedTextures():
+        target(GL_TEXTURE_2D),
+        generation(0),
+        fence(nullptr)
+    {
+
+    }
+    ~SharedTextures()
+    {
+        // released in a GL thread like the materials
+        if (!textures.empty())
+            glDeleteTextures(textures.size(), textures.data());
+        if (fence)
+            glDeleteSync(fence);
+    }
+
+    // the frame is referenced, so the same buffer is the same frame
+    bool isUploaded(const VideoFrame &f) const {
+        return frame.constBits(0) && frame.constBits(0) == f.constBits(0);
+    }
+
+    std::mutex mutex;
+    std::vector<GLuint> textures;
+    // the textures are created again if any of them changes
+    VideoFormat format;
+    GLenum target;
+    std::vector<Size> texture_size;
+    std::vector<GLint> internal_format;
+    int generation;
+    VideoFrame frame;
+    GLsync fence; // signaled when the upload in the context of another material is done
+};
+
+/* the persistently mapped PBOs filled by VideoMaterial::stageFrame() in the thread of the frames, which has no
+   GL context. The GL thread only binds the slot staged, fences it after the copy to textures and frees it when the
+   fence is signaled */
+class FrameStaging
+{
+public:
+    enum SlotState {
+        Slot_Free,      // not read by the GPU, can be filled
+        Slot_Staged,    // has a frame not uploaded yet
+        Slot_Uploading  // read by the GPU until the fence of the slot is signaled
+    };
+    FrameStaging():
+        enabled(false),
+        seq(0)
+    {
+
+    }
+
+    int find(const VideoFrame &f) const {
+        for (size_t i = 0; i < state.size(); ++i) {
+            if (state[i] == Slot_Staged && frames[i].constBits(0) == f.constBits(0))
+                return i;
+        }
+        return -1;
+    }
+    int findFree() const {
+        for (size_t i = 0; i < state.size(); ++i) {
+            if (state[i] == Slot_Free)
+                return i;
+        }
+        return -1;
+    }
+    int oldestStaged() const {
+        int slot = -1;
+        for (size_t i = 0; i < state.size(); ++i) {
+            if (state[i] == Slot_Staged && (slot < 0 || serial[i] < serial[slot]))
+                slot = i;
+        }
+        return slot;
+    }
+
+    std::mutex mutex;
+    bool enabled;   // written in the GL thread only
+    std::vector<std::vector<GLubyte*> > mapped; //[plane][slot]
+    std::vector<int> sizes; //[plane]
+    std::vector<SlotState> state;   //[slot]
+    std::vector<VideoFrame> frames; //[slot], the frames staged
+    std::vector<int64_t> serial;    //[slot], the order of staging
+    int64_t seq;
+};
+
 class VideoMaterialPrivate
 {
 public:
@@ -26,25 +155,99 @@ public:
         update_texture(true),
         init_textures_required(true),
 		effective_tex_width_ratio(1.0),
+        unpack_row_length(false),
         target(GL_TEXTURE_2D),
         dirty(true),
-        try_pbo(true)
+        transfer(ColorTransfer_Unknown),
+        tone_mapping(ToneMapping_Hable),
+        deinterlace(Deinterlace_Adaptive),
+        interlaced(false),
+        top_field_first(true),
+        field(0),
+        prev_texture(0),
+        scale_filter(Scale_Bilinear),
+        scale_x(1.0f),
+        scale_y(1.0f),
+        scale_weights(0),
+        scale_weights_filter(Scale_Bilinear),
+        mipmapped(false),
+        try_pbo(true),
+        pbo_sync(true),
+        pbo_persistent(true),
+        pbo_index(0),
+        pbo_busy(false),
+        staged(false),
+        upload_start(0),
+        shared_generation(-1)
 	{
 		textures.reserve(4);
 		texture_size.reserve(4);
 		internal_format.reserve(4);
 		data_format.reserve(4);
 		data_type.reserve(4);
+        pbo_fences.assign(PBO_RING_SIZE, nullptr);
 	}
+    ~VideoMaterialPrivate()
+    {
+        unpublishStaging();
+        for (size_t i = 0; i < pbos.size(); ++i)
+            releasePBO(i);
+        trimPool(true);
+        for (size_t i = 0; i < pbo_fences.size(); ++i) {
+            if (pbo_fences[i])
+                glDeleteSync(pbo_fences[i]);
+        }
+        if (scale_weights)
+            glDeleteTextures(1, &scale_weights);
+    }
 
 	bool initTexture(GLuint tex, GLint internal_format, GLenum format,
 		GLenum dataType, int width, int height);
+    GLuint createTexture(unsigned int plane);
+    void recycleTexture(GLuint tex);
     bool initPBO(unsigned int plane, int size);
+    void releasePBO(unsigned int plane);
+    void releasePBORing(std::vector<PBOSlot> &ring);
+    void recyclePBO(unsigned int plane);
+    void trimPool(bool all = false);
+    bool waitPBO();
+    void publishStaging();
+    void unpublishStaging();
+    bool takeStagedSlot();
+    void beginUpload();
+    void endUpload();
 	void setupQuality();
+    void ensureScaleWeights(ScaleFilter filter);
     bool updateTextureParameters(const VideoFormat& fmt);
 	bool ensureResources();
 	bool ensureTextures();
+    bool ensureSharedTextures();
+    bool isSharedUploaded();
+    void publishShared();
     void uploadPlane(unsigned int p, bool updateTexture = true);
+    double validWidthRatio() const {
+        return unpack_row_length ? 1.0 : effective_tex_width_ratio;
+    }
+    DeinterlaceMode deinterlaceMode() const {
+        if (!interlaced || target != GL_TEXTURE_2D)
+            return Deinterlace_None;
+        // the previous frame can not be kept in the textures shared
+        if (shared && deinterlace == Deinterlace_Adaptive)
+            return Deinterlace_Bob;
+        return deinterlace;
+    }
+    ScaleFilter scaleFilter() const {
+        // the lines of fields are sampled by the deinterlacer
+        if (target != GL_TEXTURE_2D || !video_format.isPlanar() || video_format.isRGB()
+                || deinterlaceMode() != Deinterlace_None || !OpenglAide::isFloatTextureSupported())
+            return Scale_Bilinear;
+        return scale_filter;
+    }
+    bool useMipmaps() const {
+        // textureLod() is required to select the level. the textures shared may be drawn in other sizes
+        return scaleFilter() != Scale_Bilinear && !shared && !OpenglAide::isOpenGLES()
+                && OpenglAide::GLSLVersion() >= 130 && std::max(scale_x, scale_y) > 2.0f;
+    }
 
 	int width, height;
 	int bpc;
@@ -58,9 +261,13 @@ public:
 	bool init_textures_required;
 	std::vector<GLuint> textures;
 	std::map<GLuint, bool> owns_texture;
+	std::map<GLuint, TextureKey> texture_keys; // of the owned textures, to recycle them
 	std::vector<Size> texture_size;
 	std::vector<int> effective_tex_width; //without additional width for alignment
 	double effective_tex_width_ratio;
+	// the padding of lines is skipped by GL_UNPACK_ROW_LENGTH, textures have the valid pixels only
+	bool unpack_row_length;
+	std::vector<int> row_length; // texels of a line in frame, including the padding
 	GLenum target;
 	/**
 	 * What format does OpenGL use to store and use this texture data?
@@ -76,9 +283,36 @@ public:
 
 	bool dirty;
 	ColorTransform colorTransform;
+	ColorTransfer transfer;
+	ToneMapping tone_mapping;
+	DeinterlaceMode deinterlace;
+	bool interlaced;
+	bool top_field_first;
+	int field;
+	GLuint prev_texture; // luma of the previous frame, swapped with textures[0] before upload
+	ScaleFilter scale_filter;
+	float scale_x, scale_y;
+	GLuint scale_weights; // lookup texture of the weights of scale_weights_filter
+	ScaleFilter scale_weights_filter;
+	bool mipmapped; // the textures uploaded last have mipmaps
     //PBO
     bool try_pbo;
-    std::vector<GLBuffer> pbos;
+    bool pbo_sync;
+    bool pbo_persistent;
+    std::vector<std::vector<PBOSlot> > pbos; //[plane][slot]
+    std::vector<GLsync> pbo_fences; // signaled when the GPU has copied the slot to textures
+    int pbo_index;
+    bool pbo_busy;
+    FrameStaging staging;
+    bool staged; // the frame is in the slot of pbo_index, it is not copied in bind()
+    int64_t upload_start;
+    UploadStatistics upload_stats;
+    std::vector<PooledTexture> texture_pool;
+    std::vector<PooledPBORing> pbo_pool;
+    //shared textures, locked from bind() to unbind()
+    SharedTexturesPtr shared;
+    int shared_generation;
+    std::unique_lock<std::mutex> shared_lock;
 
 };
 
@@ -95,25 +329,268 @@ bool VideoMaterialPrivate::initTexture(GLuint tex, GLint internal_format, GLenum
 	return true;
 }
 
+GLuint VideoMaterialPrivate::createTexture(unsigned int plane)
+{
+    TextureKey key;
+    key.internal_format = internal_format[plane];
+    key.format = data_format[plane];
+    key.type = data_type[plane];
+    key.width = texture_size[plane].width;
+    key.height = texture_size[plane].height;
+    GLuint tex = 0;
+    for (size_t i = 0; i < texture_pool.size(); ++i) {
+        if (texture_pool[i].key == key) {
+            tex = texture_pool[i].id;
+            texture_pool.erase(texture_pool.begin() + i);
+            break;
+        }
+    }
+    if (!tex) {
+        glGenTextures(1, &tex);
+        initTexture(tex, key.internal_format, key.format, key.type, key.width, key.height);
+        upload_stats.allocations++;
+    }
+    owns_texture[tex] = true;
+    texture_keys[tex] = key;
+    return tex;
+}
+
+void VideoMaterialPrivate::recycleTexture(GLuint tex)
+{
+    std::map<GLuint, TextureKey>::iterator it = texture_keys.find(tex);
+    if (it == texture_keys.end()) {
+        glDeleteTextures(1, &tex);
+        return;
+    }
+    PooledTexture t;
+    t.id = tex;
+    t.key = it->second;
+    t.released = av_gettime_relative();
+    texture_pool.push_back(t);
+    texture_keys.erase(it);
+}
+
 bool VideoMaterialPrivate::initPBO(unsigned int plane, int size)
 {
-    GLBuffer &pb = pbos[plane];
-    if (!pb.isCreated()) {
-        AVDebug("Creating PBO for plane %d, size: %d...\n", plane, size);
-        pb.create();
+    recyclePBO(plane);
+    std::vector<PBOSlot> &ring = pbos[plane];
+    for (size_t i = 0; i < pbo_pool.size(); ++i) {
+        const std::vector<PBOSlot> &r = pbo_pool[i].ring;
+        // the mapping is kept in the pool
+        if (r[0].size == size && !!r[0].mapped == pbo_persistent) {
+            ring.swap(pbo_pool[i].ring);
+            pbo_pool.erase(pbo_pool.begin() + i);
+            return true;
+        }
     }
-    if (!pb.bind()) {
-        AVWarning("Failed to bind PBO for plane %d!!!!!!\n", plane);
-        try_pbo = false;
+    ring.resize(PBO_RING_SIZE);
+    upload_stats.allocations++;
+    AVDebug("Creating %d PBOs for plane %d, size: %d, persistent: %d\n", PBO_RING_SIZE, plane, size, pbo_persistent);
+    for (size_t i = 0; i < ring.size(); ++i) {
+        PBOSlot &slot = ring[i];
+        glGenBuffers(1, &slot.id);
+        if (!slot.id) {
+            AVWarning("Failed to create PBO for plane %d!!!!!!\n", plane);
+            releasePBO(plane);
+            try_pbo = false;
+            return false;
+        }
+        slot.size = size;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+        if (pbo_persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            slot.mapped = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            if (!slot.mapped) {
+                // the storage is immutable, create the buffers again
+                AVWarning("Failed to map PBO persistently, map it for each upload\n");
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                releasePBO(plane);
+                pbo_persistent = false;
+                return initPBO(plane, size);
+            }
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+void VideoMaterialPrivate::releasePBO(unsigned int plane)
+{
+    releasePBORing(pbos[plane]);
+}
+
+void VideoMaterialPrivate::releasePBORing(std::vector<PBOSlot> &ring)
+{
+    for (size_t i = 0; i < ring.size(); ++i) {
+        PBOSlot &slot = ring[i];
+        if (!slot.id)
+            continue;
+        if (slot.mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        // the copy in flight is not affected, the buffer is deleted after it
+        glDeleteBuffers(1, &slot.id);
+    }
+    ring.clear();
+}
+
+void VideoMaterialPrivate::recyclePBO(unsigned int plane)
+{
+    std::vector<PBOSlot> &ring = pbos[plane];
+    if (ring.empty())
+        return;
+    // the fences are of the ring index, not of the buffers, so they still protect the slots in the pool
+    PooledPBORing r;
+    r.ring.swap(ring);
+    r.released = av_gettime_relative();
+    pbo_pool.push_back(r);
+}
+
+void VideoMaterialPrivate::trimPool(bool all)
+{
+    const int64_t now = av_gettime_relative();
+    // the oldest ones are at the front
+    while (!texture_pool.empty() && (all || FORCE_INT(texture_pool.size()) > POOL_MAX_TEXTURES
+                                     || now - texture_pool.front().released > POOL_IDLE_TIMEOUT)) {
+        glDeleteTextures(1, &texture_pool.front().id);
+        texture_pool.erase(texture_pool.begin());
+    }
+    while (!pbo_pool.empty() && (all || FORCE_INT(pbo_pool.size()) > POOL_MAX_PBO_RINGS
+                                 || now - pbo_pool.front().released > POOL_IDLE_TIMEOUT)) {
+        releasePBORing(pbo_pool.front().ring);
+        pbo_pool.erase(pbo_pool.begin());
+    }
+}
+
+bool VideoMaterialPrivate::waitPBO()
+{
+    GLsync &fence = pbo_fences[pbo_index];
+    if (!fence)
+        return true;
+    // usually signaled long ago, the ring is longer than the frames queued by the driver
+    const GLenum ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, PBO_WAIT_TIMEOUT);
+    if (ret == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(fence);
+    fence = nullptr;
+    return ret != GL_WAIT_FAILED;
+}
+
+void VideoMaterialPrivate::publishStaging()
+{
+    // the textures shared are uploaded by any of the materials, from their own frames
+    if (!try_pbo || !pbo_persistent || shared || pbos.empty())
+        return;
+    std::lock_guard<std::mutex> lock(staging.mutex);
+    staging.mapped.assign(pbos.size(), std::vector<GLubyte*>(PBO_RING_SIZE, nullptr));
+    staging.sizes.assign(pbos.size(), 0);
+    for (size_t p = 0; p < pbos.size(); ++p) {
+        if (pbos[p].size() != PBO_RING_SIZE)
+            return;
+        for (int i = 0; i < PBO_RING_SIZE; ++i) {
+            if (!pbos[p][i].mapped)
+                return;
+            staging.mapped[p][i] = pbos[p][i].mapped;
+        }
+        staging.sizes[p] = pbos[p][0].size;
+    }
+    // the fences are of the slot index, a ring from the pool may still be read by the GPU
+    staging.state.assign(PBO_RING_SIZE, FrameStaging::Slot_Free);
+    for (int i = 0; i < PBO_RING_SIZE; ++i) {
+        if (pbo_fences[i])
+            staging.state[i] = FrameStaging::Slot_Uploading;
+    }
+    staging.frames.assign(PBO_RING_SIZE, VideoFrame());
+    staging.serial.assign(PBO_RING_SIZE, 0);
+    staging.enabled = true;
+}
+
+void VideoMaterialPrivate::unpublishStaging()
+{
+    std::lock_guard<std::mutex> lock(staging.mutex);
+    staging.enabled = false;
+    staging.mapped.clear();
+    staging.sizes.clear();
+    staging.state.clear();
+    staging.frames.clear();
+    staging.serial.clear();
+}
+
+bool VideoMaterialPrivate::takeStagedSlot()
+{
+    std::lock_guard<std::mutex> lock(staging.mutex);
+    // free the slots copied to textures by the GPU, without waiting
+    for (size_t i = 0; i < staging.state.size(); ++i) {
+        if (staging.state[i] != FrameStaging::Slot_Uploading)
+            continue;
+        GLsync &fence = pbo_fences[i];
+        if (fence) {
+            if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+                continue;
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        staging.state[i] = FrameStaging::Slot_Free;
+    }
+    int slot = staging.find(frame);
+    staged = slot >= 0;
+    // not staged, e.g. changed by the render thread filters, copied in bind() to a free slot
+    if (!staged)
+        slot = staging.findFree();
+    if (slot < 0)
         return false;
+    if (staged) {
+        // the frames staged before are replaced by this one, they will not be shown
+        for (size_t i = 0; i < staging.state.size(); ++i) {
+            if (staging.state[i] == FrameStaging::Slot_Staged && staging.serial[i] < staging.serial[slot]) {
+                staging.state[i] = FrameStaging::Slot_Free;
+                staging.frames[i] = VideoFrame();
+            }
+        }
+        upload_stats.staged++;
     }
-    //pb.setUsagePattern(QOpenGLBuffer::DynamicCopy);
-    AVDebug("Allocate PBO size %d\n", size);
-    pb.allocate(size);
-    pb.unbind();
+    staging.state[slot] = FrameStaging::Slot_Uploading;
+    staging.frames[slot] = VideoFrame();
+    pbo_index = slot;
     return true;
 }
 
+void VideoMaterialPrivate::beginUpload()
+{
+    upload_start = av_gettime_relative();
+    pbo_busy = false;
+    staged = false;
+    if (!try_pbo || pbos.empty())
+        return;
+    if (staging.enabled && shared)
+        unpublishStaging();
+    if (staging.enabled)
+        pbo_busy = !takeStagedSlot();
+    else if (pbo_sync)
+        pbo_busy = !waitPBO();
+}
+
+void VideoMaterialPrivate::endUpload()
+{
+    if (try_pbo && !pbo_busy && !pbos.empty()) {
+        if (pbo_sync)
+            pbo_fences[pbo_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // the slot is taken by takeStagedSlot() for each frame
+        if (!staging.enabled)
+            pbo_index = (pbo_index + 1) % PBO_RING_SIZE;
+    }
+    UploadStatistics &st = upload_stats;
+    st.last = (av_gettime_relative() - upload_start) / 1000.0;
+    st.frames++;
+    st.average += (st.last - st.average) / st.frames;
+    st.max = std::max(st.max, st.last);
+}
+
 void VideoMaterialPrivate::setupQuality()
 {
 	// Zoom filter, linear interpolation
@@ -121,6 +598,56 @@ void VideoMaterialPrivate::setupQuality()
 	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 }
 
+static double scaleKernel(ScaleFilter filter, double x)
+{
+    x = fabs(x);
+    if (filter == Scale_Bicubic) {
+        // Catmull-Rom, B = 0, C = 0.5
+        if (x < 1.0)
+            return (1.5 * x - 2.5) * x * x + 1.0;
+        if (x < 2.0)
+            return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+        return 0.0;
+    }
+    const double a = filter == Scale_Lanczos3 ? 3.0 : 2.0;
+    if (x < 1e-8)
+        return 1.0;
+    if (x >= a)
+        return 0.0;
+    return a * sin(M_PI * x) * sin(M_PI * x / a) / (M_PI * M_PI * x * x);
+}
+
+void VideoMaterialPrivate::ensureScaleWeights(ScaleFilter filter)
+{
+    if (scale_weights && scale_weights_filter == filter)
+        return;
+    const int taps = filter == Scale_Lanczos3 ? 6 : 4;
+    // x: the fraction i/(SCALE_WEIGHTS_PHASES-1) of the position between texels, row 0: taps 0~3, row 1: taps 4~7
+    std::vector<GLfloat> w(SCALE_WEIGHTS_PHASES * 2 * 4, 0.0f);
+    for (int i = 0; i < SCALE_WEIGHTS_PHASES; ++i) {
+        const double f = (double)i / (double)(SCALE_WEIGHTS_PHASES - 1);
+        double k[8] = { 0 };
+        double sum = 0;
+        for (int t = 0; t < taps; ++t) {
+            k[t] = scaleKernel(filter, t - taps / 2 + 1 - f);
+            sum += k[t];
+        }
+        // normalized, flat areas keep the color
+        for (int t = 0; t < taps; ++t)
+            w[((t / 4) * SCALE_WEIGHTS_PHASES + i) * 4 + t % 4] = GLfloat(k[t] / sum);
+    }
+    if (!scale_weights)
+        glGenTextures(1, &scale_weights);
+    glBindTexture(GL_TEXTURE_2D, scale_weights);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // the weights are negative for lanczos and sharpened bicubic, a float texture is required
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCALE_WEIGHTS_PHASES, 2, 0, GL_RGBA, GL_FLOAT, w.data());
+    scale_weights_filter = filter;
+}
+
 bool VideoMaterialPrivate::updateTextureParameters(const VideoFormat& fmt)
 {
 	if (!fmt.isValid())
@@ -134,11 +661,23 @@ bool VideoMaterialPrivate::updateTextureParameters(const VideoFormat& fmt)
         AVWarning("No OpenGL support for %s.\n", fmt.name().c_str());
 		return false;
 	}
+    // lines must be whole texels, otherwise upload the padding and crop it in sampling
+    unpack_row_length = OpenglAide::hasUnpackRowLength();
+    for (unsigned int i = 0; i < nb_planes; ++i) {
+        const int bpp_gl = OpenglAide::bytesOfTexel(data_format[i], data_type[i]);
+        if (bpp_gl <= 0 || texture_size[i].width % bpp_gl || effective_tex_width[i] % bpp_gl)
+            unpack_row_length = false;
+    }
+    row_length.assign(nb_planes, 0);
     for (unsigned int i = 0; i < nb_planes; ++i) {
         const int bpp_gl = OpenglAide::bytesOfTexel(data_format[i], data_type[i]);
         const double pad = std::ceil((double)(texture_size[i].width - effective_tex_width[i])/(double)bpp_gl);
         texture_size[i].width = (std::ceil((double)texture_size[i].width / (double)bpp_gl));
         effective_tex_width[i] /= bpp_gl; //fmt.bytesPerPixel(i);
+        if (unpack_row_length) {
+            row_length[i] = texture_size[i].width;
+            texture_size[i].width = effective_tex_width[i];
+        }
         v_texture_size[i] = Vector2D(texture_size[i].width, texture_size[i].height);
         //effective_tex_width_ratio =
         AVDebug("texture width: %d - %d = pad: %d. bpp(gl): %d", texture_size[i].width, effective_tex_width[i], pad, bpp_gl);
@@ -165,7 +704,7 @@ bool VideoMaterialPrivate::updateTextureParameters(const VideoFormat& fmt)
                 GLuint &t = textures[nb_planes+i];
                 AVDebug("try to delete texture[%d]: %u. can delete: %d", nb_planes+i, t, owns_texture[t]);
                 if (owns_texture[t])
-                    glDeleteTextures(1, &t);
+                    recycleTexture(t);
             }
             //DYGL(glDeleteTextures(nb_delete, textures.data() + nb_planes));
         }
@@ -230,20 +769,25 @@ bool VideoMaterialPrivate::ensureResources()
     }
     if (update_textures) {
         updateTextureParameters(fmt);
-		//TODO use pbo 2020-08-02
         // check pbo support
         try_pbo = try_pbo && OpenglAide::isPBOSupported();
-        // check PBO support with bind() is fine, no need to check extensions
+        // without fences, a PBO is orphaned before it is mapped
+        pbo_sync = pbo_sync && OpenglAide::isSyncSupported();
+        pbo_persistent = pbo_persistent && pbo_sync && OpenglAide::isBufferStorageSupported();
         if (try_pbo) {
+            // the slots are not filled by stageFrame() while the rings change
+            unpublishStaging();
+            for (size_t i = nb_planes; i < pbos.size(); ++i)
+                recyclePBO(i);
             pbos.resize(nb_planes);
             for (int i = 0; i < nb_planes; ++i) {
-                AVDebug("Init PBO for plane %d\n", i);
-                pbos[i] = GLBuffer(GLBuffer::PixelUnpackBuffer); //QOpenGLBuffer is shared, must initialize 1 by 1 but not use fill
                 if (!initPBO(i, frame.bytesPerLine(i)*frame.planeHeight(i))) {
                     AVWarning("Failed to init PBO for plane %d\n", i);
                     break;
                 }
             }
+            if (try_pbo)
+                publishStaging();
         }
     }
 	return true;
@@ -255,12 +799,26 @@ bool VideoMaterialPrivate::ensureTextures()
 		return true;
 	// create in bindPlane loop will cause wrong texture binding
 	const int nb_planes = video_format.planeCount();
+	if (prev_texture) {
+		recycleTexture(prev_texture);
+		owns_texture.erase(prev_texture);
+		prev_texture = 0;
+	}
+	if (shared) {
+		for (size_t i = 0; i < textures.size(); ++i) {
+			if (owns_texture[textures[i]])
+				recycleTexture(textures[i]);
+		}
+		owns_texture.clear();
+		trimPool();
+		return ensureSharedTextures();
+	}
 	for (int p = 0; p < nb_planes; ++p) {
 		GLuint &tex = textures[p];
 		if (tex) { // can be 0 if resized to a larger size
 			AVDebug("try to delete texture for plane %d (id=%u). can delete: %d", p, tex, owns_texture[tex]);
 			if (owns_texture[tex])
-				glDeleteTextures(1, &tex);
+				recycleTexture(tex);
 			owns_texture.erase(tex);
 			tex = 0;
 		}
@@ -272,17 +830,67 @@ bool VideoMaterialPrivate::ensureTextures()
 			//	owns_texture[tex] = true;
 			//}
 			//else {
-				glGenTextures(1, &tex);
-				owns_texture[tex] = true;
-				initTexture(tex, internal_format[p], data_format[p], data_type[p], texture_size[p].width, texture_size[p].height);
+				tex = createTexture(p);
 			//}
 			AVDebug("texture for plane %d is created (id=%u)\n", p, tex);
 		}
 	}
+	// what is not reused by this change is unlikely to be reused soon
+	trimPool();
 	init_textures_required = false;
 	return true;
 }
 
+bool VideoMaterialPrivate::ensureSharedTextures()
+{
+	const int nb_planes = video_format.planeCount();
+	SharedTextures &st = *shared;
+	if (st.format != video_format || st.target != target || st.texture_size != texture_size
+		|| st.internal_format != internal_format || FORCE_INT(st.textures.size()) != nb_planes) {
+		// materials showing different frames(e.g. filtered) recreate them in turn, do not share textures for them
+		AVDebug("creating shared textures, generation: %d\n", st.generation + 1);
+		if (!st.textures.empty())
+			glDeleteTextures(st.textures.size(), st.textures.data());
+		st.textures.assign(nb_planes, 0);
+		glGenTextures(nb_planes, st.textures.data());
+		for (int p = 0; p < nb_planes; ++p)
+			initTexture(st.textures[p], internal_format[p], data_format[p], data_type[p], texture_size[p].width, texture_size[p].height);
+		st.format = video_format;
+		st.target = target;
+		st.texture_size = texture_size;
+		st.internal_format = internal_format;
+		st.frame = VideoFrame();
+		st.generation++;
+	}
+	// owned by the shared object, owns_texture is empty
+	textures = st.textures;
+	shared_generation = st.generation;
+	init_textures_required = false;
+	return true;
+}
+
+bool VideoMaterialPrivate::isSharedUploaded()
+{
+	if (!shared || !shared->isUploaded(frame))
+		return false;
+	// the GPU of this context waits for the upload commands of the other one
+	if (shared->fence)
+		glWaitSync(shared->fence, 0, GL_TIMEOUT_IGNORED);
+	return true;
+}
+
+void VideoMaterialPrivate::publishShared()
+{
+	shared->frame = frame;
+	if (shared->fence)
+		glDeleteSync(shared->fence);
+	shared->fence = nullptr;
+	if (OpenglAide::isSyncSupported())
+		shared->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// the commands must be flushed to be seen by other contexts
+	glFlush();
+}
+
 void VideoMaterialPrivate::uploadPlane(unsigned int p, bool updateTexture)
 {
     GLuint &tex = textures[p];
@@ -311,28 +919,57 @@ void VideoMaterialPrivate::uploadPlane(unsigned int p, bool updateTexture)
     // FIXME: why happens on win?
     if (frame.bytesPerLine(p) <= 0)
         return;
-    if (try_pbo) {
-        //qDebug("bind PBO %d", p);
-        GLBuffer &pb = pbos[p];
-        pb.bind();
-        // glMapBuffer() causes sync issue.
-        // Call glBufferData() with NULL pointer before glMapBuffer(), the previous data in PBO will be discarded and
-        // glMapBuffer() returns a new allocated pointer or an unused block immediately even if GPU is still working with the previous data.
-        // https://www.opengl.org/wiki/Buffer_Object_Streaming#Buffer_re-specification
-        pb.allocate(pb.size());
-        GLubyte* ptr = (GLubyte*)pb.map(GLBuffer::WriteOnly);
+    const int bytes = frame.bytesPerLine(p)*frame.planeHeight(p);
+    GLuint pbo = 0;
+    if (try_pbo && !pbo_busy && p < pbos.size() && !pbos[p].empty()) {
+        const PBOSlot &slot = pbos[p][pbo_index];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+        GLubyte* ptr = slot.mapped;
+        if (!ptr) {
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+            if (pbo_sync) {
+                // the fence of the slot is signaled, the GPU does not read it any more
+                access |= GL_MAP_UNSYNCHRONIZED_BIT;
+            } else {
+                // glMapBuffer() causes sync issue.
+                // Call glBufferData() with NULL pointer before glMapBuffer(), the previous data in PBO will be discarded and
+                // glMapBuffer() returns a new allocated pointer or an unused block immediately even if GPU is still working with the previous data.
+                // https://www.opengl.org/wiki/Buffer_Object_Streaming#Buffer_re-specification
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.size, nullptr, GL_STREAM_DRAW);
+            }
+            ptr = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot.size, access);
+        }
         if (ptr) {
-            memcpy(ptr, frame.constBits(p), pb.size());
-            pb.unmap();
+            if (!staged)
+                memcpy(ptr, frame.constBits(p), std::min(bytes, slot.size));
+            if (!slot.mapped)
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            pbo = slot.id;
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         }
     }
+    if (!pbo)
+        upload_stats.direct++;
+    upload_stats.bytes += bytes;
     //qDebug("bpl[%d]=%d width=%d", p, frame.bytesPerLine(p), frame.planeWidth(p));
     glBindTexture(target, tex);
+    if (unpack_row_length) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length[p]);
+    }
     glTexSubImage2D(target, 0, 0, 0, texture_size[p].width, texture_size[p].height,
-                    data_format[p], data_type[p], try_pbo ? nullptr : frame.constBits(p));
-    if (try_pbo) {
-        pbos[p].unbind();
+                    data_format[p], data_type[p], pbo ? nullptr : frame.constBits(p));
+    if (unpack_row_length) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     }
+    if (pbo)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // the prefilter of large downscales, the scaling filter samples the level of at most 2x downscale
+    if (mipmapped)
+        glGenerateMipmap(target);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
 }
 
 VideoMaterial::VideoMaterial():
@@ -341,6 +978,34 @@ VideoMaterial::VideoMaterial():
 
 }
 
+bool VideoMaterial::stageFrame(const VideoFrame &frame)
+{
+	DPTR_D(VideoMaterial);
+	FrameStaging &st = d->staging;
+	// the GL thread waits for the copy only if it takes a slot at the same time
+	std::lock_guard<std::mutex> lock(st.mutex);
+	if (!st.enabled || !frame.constBits(0) || frame.planeCount() != FORCE_INT(st.sizes.size()))
+		return false;
+	if (st.find(frame) >= 0)
+		return true;
+	for (int p = 0; p < frame.planeCount(); ++p) {
+		if (frame.bytesPerLine(p)*frame.planeHeight(p) != st.sizes[p])
+			return false;
+	}
+	int slot = st.findFree();
+	if (slot < 0)
+		slot = st.oldestStaged();
+	if (slot < 0)
+		return false;
+	// the mapping is coherent, the data is seen by the GL commands issued after the slot is taken
+	for (int p = 0; p < frame.planeCount(); ++p)
+		memcpy(st.mapped[p][slot], frame.constBits(p), st.sizes[p]);
+	st.state[slot] = FrameStaging::Slot_Staged;
+	st.frames[slot] = frame;
+	st.serial[slot] = ++st.seq;
+	return true;
+}
+
 void VideoMaterial::setCurrentFrame(const VideoFrame & frame)
 {
 	DPTR_D(VideoMaterial);
@@ -398,6 +1063,9 @@ void VideoMaterial::setCurrentFrame(const VideoFrame & frame)
 		else if (fmt.isXYZ()) {
 			cs = ColorSpace_XYZ;
 		}
+		else if (frame.colorTransfer() == ColorTransfer_PQ || frame.colorTransfer() == ColorTransfer_HLG) {
+			cs = ColorSpace_BT2020;
+		}
 		else {
 			if (frame.width() >= 1280 || frame.height() > 576) //values from mpv
 				cs = ColorSpace_BT709;
@@ -406,6 +1074,10 @@ void VideoMaterial::setCurrentFrame(const VideoFrame & frame)
 		}
 	}
 	d->colorTransform.setInputColorSpace(cs);
+	d->transfer = frame.colorTransfer();
+	d->interlaced = frame.isInterlaced();
+	d->top_field_first = frame.isTopFieldFirst();
+	d->field = 0;
 	d->colorTransform.setInputColorRange(frame.colorRange());
 	// TODO: use graphics driver's color range option if possible
 	static const ColorRange kRgbDispRange = getenv("QTAV_DISPLAY_RGB_RANGE") == "limited" ? ColorRange_Limited : ColorRange_Full;
@@ -445,12 +1117,31 @@ int VideoMaterial::textureTarget() const
 int VideoMaterial::type() const
 {
 	DPTR_D(const VideoMaterial);
-	const VideoFormat &fmt = d->video_format;
-	const bool tex_2d = d->target == GL_TEXTURE_2D;
+	return typeOf(d->video_format, d->target, d->transfer, d->tone_mapping, d->deinterlaceMode(), d->scaleFilter());
+}
+
+int VideoMaterial::typeOf(const VideoFormat &fmt, int target, ColorTransfer transfer, ToneMapping toneMapping,
+	DeinterlaceMode deinterlace, ScaleFilter scale)
+{
+	const bool tex_2d = target == GL_TEXTURE_2D;
+	const int bpc = fmt.bitsPerComponent();
 	// 2d,alpha,planar,8bit
 	const int rg_biplane = fmt.planeCount() == 2 && !OpenglAide::useDeprecatedFormats() && OpenglAide::hasRG();
-	const int channel16_to8 = d->bpc > 8 && (OpenglAide::depth16BitTexture() < 16 || !OpenglAide::has16BitTexture() || fmt.isBigEndian());
-	return (fmt.isXYZ() << 5) | (rg_biplane << 4) | (tex_2d << 3) | (fmt.hasAlpha() << 2) | (fmt.isPlanar() << 1) | (channel16_to8);
+	const int channel16_to8 = bpc > 8 && (OpenglAide::depth16BitTexture() < 16 || !OpenglAide::has16BitTexture() || fmt.isBigEndian());
+	// hdr: 1 PQ, 2 HLG, only if tone mapped. the shader reads bits 6~9
+	int hdr = 0;
+	if (toneMapping != ToneMapping_None && fmt.isPlanar() && !fmt.isRGB()) {
+		if (transfer == ColorTransfer_PQ)
+			hdr = 1;
+		else if (transfer == ColorTransfer_HLG)
+			hdr = 2;
+	}
+	const int tone = hdr ? toneMapping : 0;
+	// the shader reads bits 10~11, planar yuv only
+	const int deint = fmt.isPlanar() && !fmt.isRGB() && tex_2d ? deinterlace : 0;
+	// the shader reads bits 12~13, planar yuv only
+	const int scaler = fmt.isPlanar() && !fmt.isRGB() && tex_2d && !deint ? scale : 0;
+	return (scaler << 12) | (deint << 10) | (tone << 8) | (hdr << 6) | (fmt.isXYZ() << 5) | (rg_biplane << 4) | (tex_2d << 3) | (fmt.hasAlpha() << 2) | (fmt.isPlanar() << 1) | (channel16_to8);
 }
 
 std::string VideoMaterial::typeName(int value)
@@ -462,23 +1153,67 @@ std::string VideoMaterial::typeName(int value)
 	s << ", 2d texture: " << (!!(value & (1 << 3)));
 	s << ", 2nd plane rg: " << (!!(value & (1 << 4)));
 	s << ", xyz: " << (!!(value & (1 << 5)));
+	s << ", hdr: " << ((value >> 6) & 3);
+	s << ", tone mapping: " << ((value >> 8) & 3);
+	s << ", deinterlace: " << ((value >> 10) & 3);
+	s << ", scale filter: " << ((value >> 12) & 3);
 	return s.str();
 }
 
 bool VideoMaterial::bind()
 {
 	DPTR_D(VideoMaterial);
-	if (!d->ensureResources())
+	if (d->shared) {
+		d->shared_lock = std::unique_lock<std::mutex>(d->shared->mutex);
+		// recreated by another material
+		if (d->shared_generation != d->shared->generation)
+			d->init_textures_required = true;
+	}
+	if (!d->ensureResources()) {
+		d->shared_lock = std::unique_lock<std::mutex>();
 		return false;
+	}
     unsigned int nb_planes = d->textures.size(); //number of texture id
-    if (nb_planes <= 0 || nb_planes > 4)
+    if (nb_planes <= 0 || nb_planes > 4) {
+		d->shared_lock = std::unique_lock<std::mutex>();
 		return false;
+	}
 	d->ensureTextures();
+    // uploaded by another material, only bind the textures
+    const bool update = d->update_texture && !d->isSharedUploaded();
+    const bool keep_prev = d->deinterlaceMode() == Deinterlace_Adaptive;
+    if (update && keep_prev) {
+        // the luma of the frame shown becomes the previous one, the texture is reused for the new frame
+        if (!d->prev_texture)
+            d->prev_texture = d->createTexture(0);
+        std::swap(d->textures[0], d->prev_texture);
+    }
+    if (update) {
+        d->mipmapped = d->useMipmaps();
+        d->beginUpload();
+    }
     //write data to GPU
     for (unsigned int i = 0; i < nb_planes; ++i) {
         const unsigned int p = i % nb_planes;
-		d->uploadPlane(p, d->update_texture);
+		d->uploadPlane(p, update);
 	}
+    if (update) {
+        d->endUpload();
+        if (d->shared)
+            d->publishShared();
+    }
+    if (keep_prev && d->prev_texture) {
+        glActiveTexture(GL_TEXTURE0 + DEINTERLACE_PREV_TEXTURE_UNIT);
+        glBindTexture(d->target, d->prev_texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    const ScaleFilter scale = d->scaleFilter();
+    if (scale != Scale_Bilinear) {
+        glActiveTexture(GL_TEXTURE0 + SCALE_WEIGHTS_TEXTURE_UNIT);
+        d->ensureScaleWeights(scale);
+        glBindTexture(GL_TEXTURE_2D, d->scale_weights);
+        glActiveTexture(GL_TEXTURE0);
+    }
 	return true;
 }
 
@@ -496,6 +1231,15 @@ void VideoMaterial::unbind()
 		d->frame = VideoFrame(); //FIXME: why need this? we must unmap correctly before frame is reset.
 	}
 	setDirty(false);
+	// the draw calls are issued, other materials can upload now
+	if (d->shared_lock.owns_lock())
+		d->shared_lock.unlock();
+}
+
+UploadStatistics VideoMaterial::uploadStatistics() const
+{
+	DPTR_D(const VideoMaterial);
+	return d->upload_stats;
 }
 
 void VideoMaterial::setDirty(bool value)
@@ -525,7 +1269,7 @@ Vector2D VideoMaterial::vectorTo8bit() const
 
 double VideoMaterial::validTextureWidth() const
 {
-	return d_func()->effective_tex_width_ratio;
+	return d_func()->validWidthRatio();
 }
 
 Size VideoMaterial::frameSize() const
@@ -553,6 +1297,87 @@ std::vector<Vector2D> VideoMaterial::textureSize() const
 	return d_func()->v_texture_size;
 }
 
+void VideoMaterial::setToneMapping(ToneMapping value)
+{
+	d_func()->tone_mapping = value;
+	d_func()->dirty = true;
+}
+
+ToneMapping VideoMaterial::toneMapping() const
+{
+	return d_func()->tone_mapping;
+}
+
+void VideoMaterial::setDeinterlace(DeinterlaceMode value)
+{
+	d_func()->deinterlace = value;
+	d_func()->dirty = true;
+}
+
+DeinterlaceMode VideoMaterial::deinterlace() const
+{
+	return d_func()->deinterlace;
+}
+
+void VideoMaterial::setField(int field)
+{
+	d_func()->field = field;
+}
+
+float VideoMaterial::fieldParity() const
+{
+	DPTR_D(const VideoMaterial);
+	// the top field is the even lines
+	return (d->field == 0) == d->top_field_first ? 0.0f : 1.0f;
+}
+
+void VideoMaterial::setScaleFilter(ScaleFilter value)
+{
+	d_func()->scale_filter = value;
+	d_func()->dirty = true;
+}
+
+ScaleFilter VideoMaterial::scaleFilter() const
+{
+	return d_func()->scale_filter;
+}
+
+void VideoMaterial::setOutputScale(float sx, float sy)
+{
+	DPTR_D(VideoMaterial);
+	d->scale_x = sx;
+	d->scale_y = sy;
+}
+
+Vector2D VideoMaterial::outputScale() const
+{
+	DPTR_D(const VideoMaterial);
+	return Vector2D(d->scale_x, d->scale_y);
+}
+
+float VideoMaterial::maxMipmapLevel() const
+{
+	DPTR_D(const VideoMaterial);
+	if (!d->mipmapped || d->texture_size.empty())
+		return 0.0f;
+	return floorf(log2f((float)std::max(d->texture_size[0].width, d->texture_size[0].height)));
+}
+
+void VideoMaterial::setSharedTextures(const SharedTexturesPtr &textures)
+{
+	DPTR_D(VideoMaterial);
+	if (d->shared == textures)
+		return;
+	d->shared = textures;
+	d->shared_generation = -1;
+	d->init_textures_required = true;
+}
+
+SharedTexturesPtr VideoMaterial::createSharedTextures()
+{
+	return std::make_shared<SharedTextures>();
+}
+
 double VideoMaterial::brightness() const
 {
 	return d_func()->colorTransform.brightness();
@@ -612,7 +1437,7 @@ RectF VideoMaterial::mapToTexture(int plane, const RectF & roi, int normalize) c
 		normalize = d->target != GL_TEXTURE_RECTANGLE;
 	if (!roi.isValid()) {
 		if (normalize)
-			return RectF(0, 0, d->effective_tex_width_ratio, 1); //NOTE: not (0, 0, 1, 1)
+			return RectF(0, 0, d->validWidthRatio(), 1); //NOTE: not (0, 0, 1, 1)
 		return RectF(0, 0, tex0W*pw, d->height * ph);
 	}
 	double x = roi.x();
@@ -648,8 +1473,8 @@ RectF VideoMaterial::mapToTexture(int plane, const RectF & roi, int normalize) c
 			h *= (double)d->height;
 	}
 	// multiply later because we compare with 1 before it
-	x *= d->effective_tex_width_ratio;
-	w *= d->effective_tex_width_ratio;
+	x *= d->validWidthRatio();
+	w *= d->validWidthRatio();
 	return RectF(x*pw, y*ph, w*pw, h*ph);
 }
 
@@ -9,12 +9,24 @@
 
 NAMESPACE_BEGIN
 
+/* the luma of the previous frame for motion adaptive deinterlacing, after the planes */
+#define DEINTERLACE_PREV_TEXTURE_UNIT 4
+/* the weights of the scaling filter, for fractions of a texel in SCALE_WEIGHTS_PHASES steps */
+#define SCALE_WEIGHTS_TEXTURE_UNIT 5
+#define SCALE_WEIGHTS_PHASES 64
+
 /**
  * @brief The VideoMaterial class
  * Encapsulates rendering state for a video shader program.
  * Low-level api. Used by OpenGLVideo and Scene Graph
  */
 //class VideoShader;
+/**
+ * @brief The textures of materials in shared GL contexts, a frame is uploaded once
+ * and drawn by all of them
+ */
+class SharedTextures;
+typedef std::shared_ptr<SharedTextures> SharedTexturesPtr;
 class VideoMaterialPrivate;
 class VideoMaterial
 {
@@ -23,15 +35,33 @@ public:
 	VideoMaterial();
 	virtual ~VideoMaterial() {}
 
+	/*!
+	 * \brief stageFrame
+	 * Copy the frame to a persistently mapped PBO before it is set by setCurrentFrame(), so bind() only
+	 * uploads it from the PBO. Can be called in any thread, the copy is done without the GL context.
+	 * \return false if the PBOs are not mapped persistently, not created for the format yet, or shared
+	 */
+	bool stageFrame(const VideoFrame& frame);
 	void setCurrentFrame(const VideoFrame& frame);
 	VideoFormat currentFormat() const;
 	int textureTarget() const;
 	//VideoShader* createShader() const;
 	virtual int type() const;
+	/*!
+	 * \brief typeOf
+	 * The type of a material showing the format, e.g. to build the shaders before the first frame
+	 */
+	static int typeOf(const VideoFormat &fmt, int target, ColorTransfer transfer, ToneMapping toneMapping,
+		DeinterlaceMode deinterlace = Deinterlace_None, ScaleFilter scale = Scale_Bilinear);
 	static std::string typeName(int value);
 
 	bool bind(); // TODO: roi
 	void unbind();
+	/*!
+	 * \brief uploadStatistics
+	 * The time spent in bind() to upload new frames
+	 */
+	UploadStatistics uploadStatistics() const;
 	void setDirty(bool value);    /*!
      * \brief isDirty
      * \return true if material type changed, or other properties changed, e.g. 8bit=>10bit (the same material type) and eq
@@ -73,6 +103,57 @@ public:
 	void setHue(float value);
 	double saturation() const;
 	void setSaturation(float value);
+	/*!
+	 * \brief setToneMapping
+	 * HDR video(PQ, HLG) is mapped to SDR in the shader, Hable by default
+	 */
+	void setToneMapping(ToneMapping value);
+	ToneMapping toneMapping() const;
+	/*!
+	 * \brief setDeinterlace
+	 * The mode for interlaced frames, adaptive by default. Adaptive is bob with shared textures
+	 */
+	void setDeinterlace(DeinterlaceMode value);
+	DeinterlaceMode deinterlace() const;
+	/*!
+	 * \brief setField
+	 * 0: the first field of the frame in time, 1: the second one, for field rate output
+	 */
+	void setField(int field);
+	/*!
+	 * \brief fieldParity
+	 * For GLSL. The parity of the lines of the field shown, 0 for the top field
+	 */
+	float fieldParity() const;
+	/*!
+	 * \brief setScaleFilter
+	 * The filter of planar yuv scaled in the shader, bilinear by default. Not used for deinterlaced frames
+	 */
+	void setScaleFilter(ScaleFilter value);
+	ScaleFilter scaleFilter() const;
+	/*!
+	 * \brief setOutputScale
+	 * Texels of plane 0 per pixel on screen, > 1 if downscaled. The textures are mipmapped
+	 * for the scaling filter if downscaled more than 2x
+	 */
+	void setOutputScale(float sx, float sy);
+	/*!
+	 * \brief outputScale
+	 * For GLSL. The scale set, 1 for bilinear
+	 */
+	Vector2D outputScale() const;
+	/*!
+	 * \brief maxMipmapLevel
+	 * For GLSL. The last mipmap level of the textures uploaded, 0 if not mipmapped
+	 */
+	float maxMipmapLevel() const;
+	/*!
+	 * \brief setSharedTextures
+	 * Use the textures of the materials sharing the same object, null to use its own.
+	 * Their GL contexts must be shared
+	 */
+	void setSharedTextures(const SharedTexturesPtr &textures);
+	static SharedTexturesPtr createSharedTextures();
 
 	RectF mapToTexture(int plane, const RectF& r, int normalize = -1) const;
 
@@ -8,6 +8,8 @@
 #include "subtitle.h"
 #include "subtitle/subtitleframe.h"
 #include "innermath.h"
+#include "utils/TripleBuffer.h"
+#include <atomic>
 
 NAMESPACE_BEGIN
 
@@ -138,12 +140,14 @@ public:
         renderer_height(0),
 		glv(nullptr),
 		frame_changed(false),
+		dropped(0),
 		update_background(true),
 		aspect_ratio_changed(true),
 		source_aspect_ratio(1.0),
 		out_aspect_ratio_mode(VideoRenderer::VideoAspectRatio),
 		out_aspect_ratio(0),
 		orientation(0),
+        stage_frames(true),
         internal_subtitle_enabled(true)
     {
 		glv = new OpenglVideo();
@@ -158,6 +162,7 @@ public:
 
 	bool computeOutParameters(double outAspectRatio);
 
+    void takeFrame(VideoRenderer *q, const VideoFrame &frame);
     void applyVideoFilter();
     void applyRenderFilter();
     void processSubtitleSeek();
@@ -169,7 +174,12 @@ public:
     VideoRenderer::OutAspectRatioMode out_ratio_mode;
 	OpenglVideo *glv;
 	Matrix4x4 matrix;
-	bool frame_changed;
+	std::atomic<bool> frame_changed;
+	/* the latest frame received, taken by renderVideo() */
+	TripleBuffer<VideoFrame> frames;
+	/* before video filters, to find the frame sent again for its second field */
+	VideoFrame received_frame;
+	std::atomic<int64_t> dropped;
 	int src_width, src_height; //TODO: in_xxx
 	bool update_background;
 	bool aspect_ratio_changed;
@@ -182,6 +192,8 @@ public:
 	int orientation;
 
     std::list<Filter*> filters;
+    /* the frames received are copied to the PBOs in the video thread, unless changed by the video filters */
+    std::atomic<bool> stage_frames;
 
     std::list<Subtitle*> subtitles;
     bool internal_subtitle_enabled;
@@ -229,6 +241,22 @@ bool VideoRendererPrivate::computeOutParameters(double outAspectRatio)
 	return out_rect0 != out_rect;
 }
 
+/* in the render thread */
+void VideoRendererPrivate::takeFrame(VideoRenderer *q, const VideoFrame &frame)
+{
+    const float ratio = source_aspect_ratio;
+    source_aspect_ratio = frame.displayAspectRatio();
+    if (FuzzyCompare(ratio, source_aspect_ratio))
+        CALL_BACK(q->sourceAspectRatioChanged, source_aspect_ratio);
+    q->setSourceSize(frame.width(), frame.height());
+    if (frame.serial() != current_frame.serial()) {
+        processSubtitleSeek();
+    }
+    current_frame = frame;
+    prepareExternalSubtitleFrame();
+    frame_changed = true;
+}
+
 inline void VideoRendererPrivate::applyVideoFilter()
 {
     if (!filters.empty()) {
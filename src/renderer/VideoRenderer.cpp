@@ -44,22 +44,17 @@ void VideoRenderer::setBackgroundColor(const Color &c)
 void VideoRenderer::receive(const VideoFrame &frame)
 {
 	DPTR_D(VideoRenderer);
-    std::lock_guard<std::mutex> lock(d->mtx);
+    /* the copy to the PBOs is done here, the render thread only uploads it to the textures */
+    if (d->stage_frames)
+        d->glv->stageFrame(frame);
+    /* never wait for rendering, a frame not rendered yet is replaced */
+    if (d->frames.write(frame))
+        d->dropped++;
 #ifdef RENDER_TEST
-	d->current_frame = frame;
 	d->render_cb(nullptr);
 #else
-    const float ratio = d->source_aspect_ratio;
-	d->source_aspect_ratio = frame.displayAspectRatio();
-    if (FuzzyCompare(ratio, d->source_aspect_ratio))
-        CALL_BACK(sourceAspectRatioChanged, d->source_aspect_ratio);
-	setSourceSize(frame.width(), frame.height());
-    if (frame.serial() != d->current_frame.serial()) {
-        d->processSubtitleSeek();
-    }
-    d->current_frame = frame;
-    d->prepareExternalSubtitleFrame();
-    update();
+    /* frame_changed is set when the frame is taken, not here */
+    CALL_BACK(d->render_cb, d->opaque);
 #endif
 }
 
@@ -107,9 +102,21 @@ void VideoRenderer::renderVideo()
 {
 	DPTR_D(VideoRenderer);
     std::lock_guard<std::mutex> lock(d->mtx);
+    VideoFrame frame;
 #ifdef RENDER_TEST
+    if (d->frames.read(frame))
+        d->current_frame = frame;
     d->glv->renderVideo(d->current_frame);
 #else
+    if (d->frames.read(frame)) {
+        if (frame.isInterlaced() && frame.constBits(0) && frame.constBits(0) == d->received_frame.constBits(0)) {
+            /* the same frame for the second field, only the field changes */
+            d->glv->setField(1);
+        } else {
+            d->received_frame = frame;
+            d->takeFrame(this, frame);
+        }
+    }
 	RectF roi = realROI();
 	//d->glv.render(QRectF(-1, 1, 2, -2), roi, d->matrix);
     if (d->frame_changed) {
@@ -232,6 +239,12 @@ void VideoRenderer::updateFilters(const std::list<Filter*> filters)
     DPTR_D(VideoRenderer);
     std::unique_lock<std::mutex> lock_mtx(d->mtx);
     d->filters = filters;
+    bool stage = true;
+    for (std::list<Filter*>::const_iterator it = filters.begin(); it != filters.end(); ++it) {
+        if ((*it)->type() == Filter::Video)
+            stage = false;
+    }
+    d->stage_frames = stage;
 }
 
 const std::list<Filter*>& VideoRenderer::filters() const
@@ -239,4 +252,67 @@ const std::list<Filter*>& VideoRenderer::filters() const
     return d_func()->filters;
 }
 
+void VideoRenderer::setToneMapping(ToneMapping value)
+{
+    DPTR_D(VideoRenderer);
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->glv->setToneMapping(value);
+}
+
+void VideoRenderer::shareTextures(VideoRenderer *renderer)
+{
+    DPTR_D(VideoRenderer);
+    if (renderer == this)
+        return;
+    if (!renderer) {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        d->glv->setSharedTextures(SharedTexturesPtr());
+        return;
+    }
+    VideoRendererPrivate *other = renderer->d_func();
+    std::lock(d->mtx, other->mtx);
+    std::lock_guard<std::mutex> lock(d->mtx, std::adopt_lock);
+    std::lock_guard<std::mutex> lock_other(other->mtx, std::adopt_lock);
+    SharedTexturesPtr textures = other->glv->sharedTextures();
+    if (!textures)
+        textures = d->glv->sharedTextures();
+    if (!textures)
+        textures = VideoMaterial::createSharedTextures();
+    d->glv->setSharedTextures(textures);
+    other->glv->setSharedTextures(textures);
+}
+
+void VideoRenderer::setDeinterlace(DeinterlaceMode value)
+{
+    DPTR_D(VideoRenderer);
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->glv->setDeinterlace(value);
+}
+
+void VideoRenderer::setScaleFilter(ScaleFilter value)
+{
+    DPTR_D(VideoRenderer);
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->glv->setScaleFilter(value);
+}
+
+bool VideoRenderer::takeReceived(VideoFrame &frame)
+{
+    DPTR_D(VideoRenderer);
+    return d->frames.read(frame);
+}
+
+int64_t VideoRenderer::droppedFrames() const
+{
+    DPTR_D(const VideoRenderer);
+    return d->dropped;
+}
+
+UploadStatistics VideoRenderer::uploadStatistics()
+{
+    DPTR_D(VideoRenderer);
+    std::lock_guard<std::mutex> lock(d->mtx);
+    return d->glv->uploadStatistics();
+}
+
 NAMESPACE_END
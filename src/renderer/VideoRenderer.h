@@ -31,7 +31,11 @@ public:
 
     virtual void setBackgroundColor(const Color &c);
 
-	void receive(const VideoFrame &frame);
+	/**
+	 * @brief never blocks, the frame is rendered by the next renderVideo()
+	 * unless it is replaced by a newer one
+	 */
+	virtual void receive(const VideoFrame &frame);
 
     void receiveSubtitle(SubtitleFrame &frame);
 
@@ -52,12 +56,43 @@ public:
 
     void updateFilters(const std::list<Filter*> filters);
     const std::list<Filter *> &filters() const;
+    /**
+     * @brief the frames replaced before they are rendered
+     */
+    int64_t droppedFrames() const;
+    /**
+     * @brief the operator to show HDR video(PQ, HLG) on SDR display, Hable by default
+     */
+    void setToneMapping(ToneMapping value);
+    /**
+     * @brief the deinterlacer of interlaced frames in the shader, adaptive by default.
+     * A frame received twice shows its second field, see Player::setDeinterlace()
+     */
+    void setDeinterlace(DeinterlaceMode value);
+    /**
+     * @brief the filter of planar yuv scaled in the shader, bilinear by default.
+     * Bicubic and lanczos downscale the frames without aliasing, e.g. the tiles of a mosaic
+     */
+    void setScaleFilter(ScaleFilter value);
+    /**
+     * @brief upload the frames once for this and the renderer, e.g. a preview and
+     * a monitor of the same player. Their GL contexts must be shared. null to stop
+     */
+    void shareTextures(VideoRenderer *renderer);
+    /**
+     * @brief the time spent by renderVideo() to upload the frames to textures
+     */
+    UploadStatistics uploadStatistics();
 
 protected:
     virtual void onResizeWindow();
     virtual void update();
 
 private:
+    friend class MosaicRenderer;
+    /* the latest frame received, for the mosaic composing the tile */
+    bool takeReceived(VideoFrame &frame);
+
     std::function<void(float)> sourceAspectRatioChanged;
 
 };
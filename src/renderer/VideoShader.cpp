@@ -4,6 +4,7 @@
 #include "OpenglAide.h"
 #include "glpackage.h"
 #include "VideoMaterial.h"
+#include "ShaderCache.h"
 
 #include <sstream>
 #include <vector>
@@ -69,6 +70,142 @@ static std::string compatibleShaderHeader(GLShaderProgram::ShaderType type)
     return h;
 }
 
+/*
+ * R'G'B' of BT.2020 => linear light => tone mapped, BT.709 primaries => R'G'B' of SDR.
+ * hdr and tone are the bits of material type, see VideoMaterial::type()
+ */
+static std::string toneMappingFunction(int hdr, int tone)
+{
+    std::string f;
+    std::stringstream s;
+    // 203 nits is the reference white of HDR(BT.2408)
+    const float peak = (hdr == 1 ? 10000.0f : 1000.0f) / 203.0f;
+    s << std::fixed << peak;
+    f += "vec3 toneMap(vec3 c) {\n";
+    if (hdr == 1) {
+        // ST 2084 EOTF, 1.0 is 10000 nits
+        f += "    vec3 p = pow(c, vec3(1.0/78.84375));\n"
+             "    c = pow(max(p - 0.8359375, 0.0) / (18.8515625 - 18.6875 * p), vec3(1.0/0.1593017578125));\n";
+    } else {
+        // inverse OETF of HLG, then OOTF of a 1000 nits display
+        f += "    c = mix(c * c / 3.0, (exp((c - 0.55991073) / 0.17883277) + 0.28466892) / 12.0, step(0.5, c));\n"
+             "    c *= pow(max(dot(c, vec3(0.2627, 0.6780, 0.0593)), 1e-6), 0.2);\n";
+    }
+    f += "    c *= " + s.str() + ";\n";
+    // BT.2020 => BT.709 primaries, column major
+    f += "    c = max(mat3(1.6605, -0.1246, -0.0182, -0.5876, 1.1329, -0.1006, -0.0728, -0.0083, 1.1187) * c, 0.0);\n";
+    switch (tone) {
+    case ToneMapping_Reinhard:
+        f += "    c = c * (1.0 + c / (" + s.str() + " * " + s.str() + ")) / (1.0 + c);\n";
+        break;
+    case ToneMapping_Hable:
+        f += "    const float A = 0.15, B = 0.50, C = 0.10, D = 0.20, E = 0.02, F = 0.30;\n"
+             "    vec3 h = ((c * (A * c + C * B) + D * E) / (c * (A * c + B) + D * F)) - E / F;\n"
+             "    float w = " + s.str() + ";\n"
+             "    w = ((w * (A * w + C * B) + D * E) / (w * (A * w + B) + D * F)) - E / F;\n"
+             "    c = h / w;\n";
+        break;
+    default:
+        break;
+    }
+    f += "    return pow(clamp(c, 0.0, 1.0), vec3(1.0/2.2));\n"
+         "}\n";
+    return f;
+}
+
+/*
+ * Replaces sample2d() of planar yuv. The lines are sampled at the center, so the
+ * fields are not mixed by linear filtering. deint is the bits of material type,
+ * see VideoMaterial::type()
+ */
+static std::string deinterlaceFunction(int deint)
+{
+    std::string f;
+    f += "uniform vec2 u_textureSize[4];\n"
+         "uniform float u_field;\n";
+    if (deint == Deinterlace_Adaptive)
+        f += "uniform sampler2D u_PrevTexture0;\n";
+    f += "vec4 deinterlace(sampler2D tex, vec2 pos, float h) {\n"
+         "    float line = floor(pos.y * h);\n"
+         "    vec2 c = vec2(pos.x, (line + 0.5) / h);\n"
+         "    vec2 dy = vec2(0.0, 1.0 / h);\n";
+    if (deint == Deinterlace_Blend) {
+        f += "    return 0.25 * texture(tex, c - dy) + 0.5 * texture(tex, c) + 0.25 * texture(tex, c + dy);\n";
+    } else {
+        f += "    if (abs(mod(line, 2.0) - u_field) < 0.5)\n"
+             "        return texture(tex, c);\n"
+             "    vec4 bob = 0.5 * (texture(tex, c - dy) + texture(tex, c + dy));\n";
+        if (deint == Deinterlace_Adaptive) {
+            // the line of the other field is weaved if the luma is not changed since the previous frame
+            f += "    float motion = abs(texture(u_PrevTexture0, c).r - texture(u_Texture0, c).r);\n"
+                 "    return mix(texture(tex, c), bob, smoothstep(0.02, 0.08, motion));\n";
+        } else {
+            f += "    return bob;\n";
+        }
+    }
+    f += "}\n"
+         // plane is a literal, so u_textureSize is indexed by a constant
+         "#define sample2d(tex, pos, plane) deinterlace(tex, pos, u_textureSize[plane].y)\n";
+    return f;
+}
+
+/*
+ * Replaces sample2d() of planar yuv. The taps of the separable kernel are weighted by the
+ * lookup texture of VideoMaterial. For downscales the taps are apart by the scale, up to 2
+ * texels, and a larger downscale samples the mipmap level of at most 2x if textureLod() exists.
+ * scale is the bits of material type, see VideoMaterial::type()
+ */
+static std::string scaleFunction(int scale)
+{
+    const int taps = scale == Scale_Lanczos3 ? 6 : 4;
+    // the same condition as the mipmaps of VideoMaterial
+    const bool lod = !OpenglAide::isOpenGLES() && OpenglAide::GLSLVersion() >= 130;
+    const char *xyzw = "xyzw";
+    std::stringstream f;
+    f << "uniform vec2 u_textureSize[4];\n"
+         "uniform vec2 u_scale;\n"
+         "uniform float u_lodMax;\n"
+         "uniform sampler2D u_ScaleWeights;\n"
+         "vec4 scale2d(sampler2D tex, vec2 pos, vec2 size, vec2 ratio) {\n"
+         "    vec2 s = u_scale * ratio;\n";
+    if (lod) {
+        f << "    float lod = clamp(ceil(log2(max(s.x, s.y) * 0.5)), 0.0, u_lodMax);\n"
+             "    s /= exp2(lod);\n"
+             "    size /= exp2(lod);\n";
+    }
+    // the taps are on the grid of s texels, the weights are of the fraction on the grid
+    f << "    s = clamp(s, 1.0, 2.0);\n"
+         "    vec2 q = pos * size / s - 0.5;\n"
+         "    vec2 fr = fract(q);\n"
+         "    vec2 d = s / size;\n"
+         "    vec2 base = (q - fr + 0.5) * d;\n"
+         "    vec2 x = fr * " << std::fixed << (SCALE_WEIGHTS_PHASES - 1.0) / SCALE_WEIGHTS_PHASES
+      << " + " << 0.5 / SCALE_WEIGHTS_PHASES << ";\n"
+         "    vec4 wx0 = texture(u_ScaleWeights, vec2(x.x, 0.25));\n"
+         "    vec4 wy0 = texture(u_ScaleWeights, vec2(x.y, 0.25));\n";
+    if (taps > 4) {
+        f << "    vec4 wx1 = texture(u_ScaleWeights, vec2(x.x, 0.75));\n"
+             "    vec4 wy1 = texture(u_ScaleWeights, vec2(x.y, 0.75));\n";
+    }
+    f << "    vec4 c = vec4(0.0);\n";
+    for (int j = 0; j < taps; ++j) {
+        f << "    c += wy" << j / 4 << "." << xyzw[j % 4] << " * (";
+        for (int i = 0; i < taps; ++i) {
+            if (i > 0)
+                f << "\n        + ";
+            f << "wx" << i / 4 << "." << xyzw[i % 4] << " * "
+              << (lod ? "textureLod" : "texture") << "(tex, base + vec2("
+              << (i - taps / 2 + 1) << ".0, " << (j - taps / 2 + 1) << ".0) * d"
+              << (lod ? ", lod)" : ")");
+        }
+        f << ");\n";
+    }
+    f << "    return c;\n"
+         "}\n"
+         "#define sample2d(tex, pos, plane) scale2d(tex, pos, u_textureSize[plane], u_textureSize[plane] / u_textureSize[0])\n";
+    return f.str();
+}
+
 class VideoShaderPrivate
 {
 public:
@@ -81,10 +218,20 @@ public:
 		u_to8(-1),
 		u_opacity(-1),
 		u_c(-1),
+		u_field(-1),
+		u_PrevTexture(-1),
+		u_scale(-1),
+		u_lodMax(-1),
+		u_ScaleWeights(-1),
 		material_type(0),
 		texture_target(GL_TEXTURE_2D)
 	{
 
+	}
+	~VideoShaderPrivate()
+	{
+		// in the GL thread, e.g. ShaderManager::prewarm()
+		delete program;
 	}
 	GLShaderProgram* program;
 	bool rebuild_program;
@@ -97,6 +244,11 @@ public:
 	int u_c;
 	int u_texelSize;
 	int u_textureSize;
+	int u_field;
+	int u_PrevTexture;
+	int u_scale;
+	int u_lodMax;
+	int u_ScaleWeights;
 
 	int material_type;
 	GLenum texture_target;
@@ -174,6 +326,7 @@ std::string VideoShader::vertexShader() const
         multiCoords = true;
     hasAlpha = d->video_format.hasAlpha();
 
+    d->vert.clear();
     d->vert.append("attribute vec4 a_Position;\n"
                    "attribute vec2 a_TexCoords0;\n"
                    "uniform mat4 u_Matrix;\n"
@@ -219,7 +372,13 @@ std::string VideoShader::fragmentShader() const
             channel16To8 = true;
     }
 
+    const int hdr = (d->material_type >> 6) & 3;
+    const int tone = (d->material_type >> 8) & 3;
+    const int deint = (d->material_type >> 10) & 3;
+    const int scale = (d->material_type >> 12) & 3;
+
     std::string& frag = d->video_format.isPlanar() ? d->planar_frag : d->packed_frag;
+    frag.clear();
     if (d->video_format.isPlanar()) {
         frag.append("uniform sampler2D u_Texture0;\n"
                               "uniform sampler2D u_Texture1;\n"
@@ -241,9 +400,16 @@ std::string VideoShader::fragmentShader() const
                               "uniform mat4 u_colorMatrix;\n");
         if (channel16To8)
             frag.append("uniform vec2 u_to8;\n");
-        frag.append("vec4 sample2d(sampler2D tex, vec2 pos, int plane) {"
-                                "return texture(tex, pos);}\n"
-                              "void main(){\n"
+        if (hdr)
+            frag.append(toneMappingFunction(hdr, tone));
+        if (deint)
+            frag.append(deinterlaceFunction(deint));
+        else if (scale)
+            frag.append(scaleFunction(scale));
+        else
+            frag.append("vec4 sample2d(sampler2D tex, vec2 pos, int plane) {"
+                                    "return texture(tex, pos);}\n");
+        frag.append("void main(){\n"
                                 "gl_FragColor = clamp(u_colorMatrix * vec4(");
         if (channel16To8) {
             if (useRG) {
@@ -267,7 +433,11 @@ std::string VideoShader::fragmentShader() const
                                       "sample2d(u_Texture2, v_TexCoords2, 2).a,\n");
             }
         }
-        frag.append(" 1.0), 0.0, 1.0) * u_opacity;\n");
+        frag.append(" 1.0), 0.0, 1.0)");
+        if (hdr)
+            frag.append(";\n gl_FragColor.rgb = toneMap(gl_FragColor.rgb);\n"
+                        " gl_FragColor = gl_FragColor");
+        frag.append(" * u_opacity;\n");
         if (hasAlpha) {
             frag.append(" float a = ");
             if (channel16To8) {
@@ -349,6 +519,11 @@ void VideoShader::initialize()
     d->u_c = d->program->uniformLocation("u_c");
 	d->u_texelSize = d->program->uniformLocation("u_texelSize");
     d->u_textureSize = d->program->uniformLocation("u_textureSize");
+    d->u_field = d->program->uniformLocation("u_field");
+    d->u_PrevTexture = d->program->uniformLocation("u_PrevTexture0");
+    d->u_scale = d->program->uniformLocation("u_scale");
+    d->u_lodMax = d->program->uniformLocation("u_lodMax");
+    d->u_ScaleWeights = d->program->uniformLocation("u_ScaleWeights");
     d->u_Texture.resize(textureLocationCount());
     AVDebug("uniform locations:\n");
     for (unsigned i = 0; i < d->u_Texture.size(); ++i) {
@@ -367,6 +542,10 @@ void VideoShader::initialize()
 		AVDebug("u_texelSize: %d\n", d->u_texelSize);
 	if (d->u_textureSize >= 0)
 		AVDebug("u_textureSize: %d\n", d->u_textureSize);
+	if (d->u_field >= 0)
+		AVDebug("u_field: %d\n", d->u_field);
+	if (d->u_scale >= 0)
+		AVDebug("u_scale: %d\n", d->u_scale);
 
 	//d->user_uniforms[VertexShader].clear();
 	//d->user_uniforms[FragmentShader].clear();
@@ -390,8 +569,12 @@ bool VideoShader::buildShader()
 		AVWarning("Shader program is already linked");
 	}
 	d->program->removeAllShaders();
-    d->program->addShaderFromSourceCode(GLShaderProgram::Vertex, vertexShader().c_str());
-    d->program->addShaderFromSourceCode(GLShaderProgram::Fragment, fragmentShader().c_str());
+	const std::string vs = vertexShader();
+	const std::string fs = fragmentShader();
+	if (ShaderCache::load(d->program, vs, fs))
+		return true;
+    d->program->addShaderFromSourceCode(GLShaderProgram::Vertex, vs.c_str());
+    d->program->addShaderFromSourceCode(GLShaderProgram::Fragment, fs.c_str());
 	int maxVertexAttribs = 0;
 	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxVertexAttribs);
 	char const *const *attr = attributeNames();
@@ -413,6 +596,7 @@ bool VideoShader::buildShader()
 	if (!d->program->link()) {
 		return false;
 	}
+	ShaderCache::store(d->program, vs, fs);
 	return true;
 }
 
@@ -453,6 +637,14 @@ bool VideoShader::update(VideoMaterial *material)
 	//		}
 	//	}
 	//}
+	// changed for each field
+	if (d->u_field >= 0)
+		d->program->setUniformValue(d->u_field, (GLfloat)material->fieldParity());
+	// changed with the size of the view
+	if (d->u_scale >= 0)
+		d->program->setUniformValue(d->u_scale, material->outputScale());
+	if (d->u_lodMax >= 0)
+		d->program->setUniformValue(d->u_lodMax, (GLfloat)material->maxMipmapLevel());
 	// shader type changed, eq mat changed, or other material properties changed (e.g. texture, 8bit=>10bit)
 	if (!d->update_builtin_uniforms && !material->isDirty())
 		return true;
@@ -480,6 +672,10 @@ bool VideoShader::update(VideoMaterial *material)
 		d->program->setUniformValueArray(texelSizeLocation(), material->texelSize().data(), nb_planes);
 	if (textureSizeLocation() >= 0)
 		d->program->setUniformValueArray(textureSizeLocation(), material->textureSize().data(), nb_planes);
+	if (d->u_PrevTexture >= 0)
+		d->program->setUniformValue(d->u_PrevTexture, (GLint)DEINTERLACE_PREV_TEXTURE_UNIT);
+	if (d->u_ScaleWeights >= 0)
+		d->program->setUniformValue(d->u_ScaleWeights, (GLint)SCALE_WEIGHTS_TEXTURE_UNIT);
 	// uniform end. attribute begins
 	return true;
 }
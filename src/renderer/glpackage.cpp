@@ -271,6 +271,8 @@ bool GLShaderProgram::link()
 	DPTR_D(GLShaderProgram);
     int ret;
 
+    if (OpenglAide::isProgramBinarySupported())
+        glProgramParameteri(d->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(d->program);
     glGetProgramiv(d->program, GL_LINK_STATUS, &ret);
 	if (ret == GL_FALSE) {
@@ -292,6 +294,34 @@ bool GLShaderProgram::isLinked() const
 	return d->islinked;
 }
 
+bool GLShaderProgram::programBinary(GLenum *format, std::vector<char> &data) const
+{
+	DPTR_D(const GLShaderProgram);
+	if (!d->islinked || !OpenglAide::isProgramBinarySupported())
+		return false;
+	GLint len = 0;
+	glGetProgramiv(d->program, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (len <= 0)
+		return false;
+	data.resize(len);
+	glGetProgramBinary(d->program, len, &len, format, data.data());
+	data.resize(len);
+	return len > 0;
+}
+
+bool GLShaderProgram::setProgramBinary(GLenum format, const void *data, int size)
+{
+	DPTR_D(GLShaderProgram);
+	GLint ret = GL_FALSE;
+
+	if (!OpenglAide::isProgramBinarySupported())
+		return false;
+	glProgramBinary(d->program, format, data, size);
+	glGetProgramiv(d->program, GL_LINK_STATUS, &ret);
+	d->islinked = ret == GL_TRUE;
+	return d->islinked;
+}
+
 void GLShaderProgram::bind()
 {
 	DPTR_D(GLShaderProgram);
@@ -5,6 +5,7 @@
 #include "VectorF.h"
 #include "Matrix4x4.h"
 #include "OpenglAide.h"
+#include <vector>
 
 #define BUFFER_OFFSET(offset) ((void*)(offset))
 #define GET_STR(x) #x
@@ -107,6 +108,14 @@ public:
     void bindAttributeLocation(const GLchar* name, GLuint index);
     bool link();
 	bool isLinked() const;
+	/**
+	 * @brief the binary of the linked program, the driver decides the format
+	 */
+	bool programBinary(GLenum *format, std::vector<char> &data) const;
+	/**
+	 * @brief link from a binary instead of shaders, false if the driver rejects it
+	 */
+	bool setProgramBinary(GLenum format, const void *data, int size);
     void bind();
     void unBind();
     GLint attribLocation(const GLchar* name);
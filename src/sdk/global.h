@@ -138,7 +138,52 @@ enum ColorSpace {
     ColorSpace_GBR, // for planar gbr format(e.g. video from x264) used in glsl
     ColorSpace_BT601,
     ColorSpace_BT709,
-    ColorSpace_XYZ
+    ColorSpace_XYZ,
+    ColorSpace_BT2020
+};
+
+/**
+ * @brief The ColorTransfer enum
+ * The transfer characteristic, PQ and HLG are HDR
+ */
+enum ColorTransfer {
+    ColorTransfer_Unknown,
+    ColorTransfer_SDR,
+    ColorTransfer_PQ,   // SMPTE ST 2084
+    ColorTransfer_HLG   // ARIB STD-B67
+};
+
+/**
+ * @brief The ToneMapping enum
+ * The operator to map HDR video to SDR display in the shader
+ */
+enum ToneMapping {
+    ToneMapping_None,       // the HDR signal is shown as SDR
+    ToneMapping_Clip,
+    ToneMapping_Reinhard,
+    ToneMapping_Hable
+};
+
+/**
+ * @brief The DeinterlaceMode enum
+ * Interlaced frames are deinterlaced in the shader, progressive frames are not affected
+ */
+enum DeinterlaceMode {
+    Deinterlace_None,       // the fields are weaved
+    Deinterlace_Bob,        // the lines of the other field are interpolated
+    Deinterlace_Blend,      // the lines are blended with the neighbours, no combing but blurred
+    Deinterlace_Adaptive    // weave where still and bob where moving, by the previous frame
+};
+
+/**
+ * @brief The ScaleFilter enum
+ * The filter of the video scaled in the shader, the kernels are separable
+ */
+enum ScaleFilter {
+    Scale_Bilinear,     // the texture filtering, fastest
+    Scale_Bicubic,      // Catmull-Rom, 4x4 taps
+    Scale_Lanczos2,     // 4x4 taps
+    Scale_Lanczos3      // 6x6 taps, sharpest
 };
 
 /**
@@ -174,6 +219,76 @@ enum ResampleType: uint8_t
     ResampleSoundtouch
 };
 
+/**
+ * @brief The statistics of seek, time is in milliseconds
+ * and measured from the latest request to the first frame shown
+ */
+typedef struct SeekStatistics {
+    int64_t requests;   /* all the seek requests */
+    int64_t coalesced;  /* requests merged into the pending one */
+    int64_t finished;   /* seeks which have shown the first frame */
+    int64_t cached;     /* seeks shown from the frame cache without seeking the demuxer */
+    double last;
+    double average;
+    double max;
+    SeekStatistics() {
+        requests = coalesced = finished = cached = 0;
+        last = average = max = 0.0;
+    }
+} SeekStatistics;
+
+/**
+ * @brief The statistics of uploading video frames to textures, time is in
+ * milliseconds and measured on the render thread
+ */
+typedef struct UploadStatistics {
+    int64_t frames;     /* frames uploaded */
+    int64_t bytes;      /* bytes of the planes uploaded */
+    int64_t direct;     /* planes uploaded without PBO, e.g. the GPU still reads the PBO */
+    int64_t allocations;    /* textures and PBOs created, not reused from the pool */
+    int64_t staged;     /* frames copied to the PBOs in the video thread, only uploaded from them in the GL thread */
+    double last;
+    double average;
+    double max;
+    UploadStatistics() {
+        frames = bytes = direct = allocations = staged = 0;
+        last = average = max = 0.0;
+    }
+} UploadStatistics;
+
+/**
+ * @brief The statistics of media scanning, time is in milliseconds
+ */
+typedef struct ScanStatistics {
+    int64_t files;      /* all the files scanned */
+    int64_t failed;     /* files which can not be opened or probed */
+    int64_t bytes;      /* total size of the files scanned */
+    double elapsed;     /* wall time of the scan */
+    double average;     /* average probe time of a file */
+    double max;
+    double files_per_second;
+    ScanStatistics() {
+        files = failed = bytes = 0;
+        elapsed = average = max = files_per_second = 0.0;
+    }
+} ScanStatistics;
+
+/**
+ * @brief The estimate of the input of a real-time stream, measured over
+ * a sliding window of the latest packets
+ */
+typedef struct BufferEstimate {
+    double arrival_rate;    /* packets per second */
+    double byte_rate;       /* bytes per second */
+    double jitter;          /* milliseconds, the spread of the arrival delay */
+    int64_t target;         /* milliseconds, the buffer wanted to avoid underrun */
+    int64_t underruns;      /* the buffer run empty while playing */
+    BufferEstimate() {
+        arrival_rate = byte_rate = jitter = 0.0;
+        target = underruns = 0;
+    }
+} BufferEstimate;
+
 typedef struct Color {
     uint8_t r, g, b, a;
     Color(uint8_t _r = 0, uint8_t _g = 0, uint8_t _b = 0, uint8_t _a = 255) {
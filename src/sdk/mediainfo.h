@@ -73,6 +73,17 @@ typedef struct SubtitleStreamInfo_ {
     Rational time_base;
 } SubtitleStreamInfo;
 
+/**
+ * A variant of HLS/DASH, it is a program or a single stream of the media
+ */
+typedef struct VariantInfo_ {
+    int program;        /* -1 if the variant is a single stream */
+    int video_stream;   /* -1 if there is no video */
+    int audio_stream;   /* -1 if there is no audio */
+    int64_t bitrate;    /* bits per second */
+    int width, height;
+} VariantInfo;
+
 typedef struct MediaInfo_ {
     std::string url;
     int64_t start_time;
@@ -85,6 +96,10 @@ typedef struct MediaInfo_ {
     std::list<VideoStreamInfo> videos;
     std::list<SubtitleStreamInfo> subtitles;
 
+    /* sorted by bitrate, empty if the media has only one variant */
+    std::vector<VariantInfo> variants;
+    int variant = -1;
+
     AudioStreamInfo *audio = nullptr;
     VideoStreamInfo *video = nullptr;
     SubtitleStreamInfo *subtitle = nullptr;
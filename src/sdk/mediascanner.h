@@ -0,0 +1,62 @@
+#ifndef MEDIASCANNER_H
+#define MEDIASCANNER_H
+
+#include "global.h"
+#include "DPTR.h"
+#include "mediainfo.h"
+
+/**
+ * Fill the MediaInfo of media files by probing only, no decoder,
+ * thread or renderer of the player is created.
+ */
+NAMESPACE_BEGIN
+
+class MediaScannerPrivate;
+class SMI_EXPORT MediaScanner
+{
+    DPTR_DECLARE_PRIVATE(MediaScanner)
+public:
+    MediaScanner();
+    ~MediaScanner();
+
+    /**
+     * @brief the number of files probed concurrently, 0 means the number of the cpu cores
+     */
+    void setThreads(int threads);
+    /**
+     * @brief limit the bytes read and the milliseconds of media analyzed for
+     * each file, <= 0 means the default value of ffmpeg
+     */
+    void setProbeLimit(int64_t size, int64_t duration);
+    /**
+     * @brief called from the worker threads when a file is scanned.
+     * ret is 0 if success, info is only valid in the callback.
+     */
+    void setScanCallback(std::function<void(const std::string &url, int ret, MediaInfo *info)> f);
+
+    /**
+     * @brief scan one file in the calling thread
+     * @return 0 if success, otherwise a negative value
+     */
+    int scan(const std::string &url, MediaInfo *info);
+    /**
+     * @brief scan the files concurrently and block until all of them are finished
+     * @return the number of the files scanned successfully
+     */
+    int scan(const StringList &urls);
+    /**
+     * @brief abort the scanning from another thread
+     */
+    void abort();
+
+    /**
+     * @brief statistics of the latest scan(urls)
+     */
+    ScanStatistics statistics() const;
+
+private:
+    DPTR_DECLARE(MediaScanner)
+};
+
+NAMESPACE_END
+#endif //MEDIASCANNER_H
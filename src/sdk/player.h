@@ -35,6 +35,30 @@ public:
      */
     void setWantedStreamSpec(MediaType type, const char* spec);
     void setMediaStreamDisable(MediaType type);
+    /**
+     * @brief switch the audio or subtitle track while playing, the track is the
+     * index in the list of MediaInfo. The new track starts at the current
+     * position without seek, the video is not interrupted.
+     * The stream changed callback is called when it's done
+     */
+    bool switchTrack(MediaType type, int track);
+    /**
+     * @brief the latest packets of the tracks not selected are kept in bytes for
+     * each track, so that switchTrack() starts decoding at once. <= 0 disables it,
+     * then the new track is heard after the packets buffered are played
+     */
+    void setTrackSwitchWindow(int64_t bytes);
+    /**
+     * @brief play the audio of another file instead of the audio track of the
+     * media, e.g. a dubbing. It's demuxed by its own thread and follows the
+     * seek of the media. Should be called before "prepare()", empty url removes it
+     * @param offset seconds added to the timestamps of the audio file
+     */
+    void setExternalAudio(const std::string &url, double offset = 0);
+    /**
+     * @brief adjust the offset while playing, the audio is resynchronized at once
+     */
+    void setExternalAudioOffset(double offset);
 
     void prepare();
     /**
@@ -48,10 +72,20 @@ public:
     bool isPaused() const;
     void stop();
     /**
-     * @brief set speed to play, the effective range is 0.5~2
+     * @brief set speed to play, the effective range is 0.5~2.
+     * Trick play is used if speed is 4~32, or -4~-32 for rewind,
+     * then only the key frames are shown and audio is skipped.
      */
     void setSpeed(float speed);
     float speed() const;
+    /**
+     * @brief stop decoding and rendering the video when no renderer is visible,
+     * e.g. the window is minimized, and the audio goes on. When resumed, the
+     * video is decoded from the latest key frame and catches up with the audio.
+     * It can not be suspended in trick play
+     */
+    bool setVideoSuspended(bool suspended);
+    bool isVideoSuspended() const;
     bool isMute() const;
     void setMute(bool m);
     /**
@@ -65,6 +99,34 @@ public:
     //void seek(double pos, double rel);
     void seekForward(int incr = 5);
     void seekBackward(int incr = -5);
+    /**
+     * @brief step one frame forward or backward, the player will be paused.
+     * Recently decoded frames are cached, so stepping backward only seeks
+     * and decodes the gop once.
+     */
+    void stepForward();
+    void stepBackward();
+    /**
+     * @brief the bytes limit of decoded frames cache, 128MB by default, 0 to disable.
+     * The frames are cached while paused, stepping or scrubbing, and released
+     * when playing. A seek to a cached frame while paused is shown without
+     * seeking the demuxer until playback resumes
+     */
+    void setFrameCacheSize(int64_t bytes);
+    /**
+     * @brief interlaced frames are deinterlaced by the renderers in the shader,
+     * adaptive by default, progressive frames are not affected
+     * @param fieldRate every field is shown, at double the frame rate. Ignored by blend
+     */
+    void setDeinterlace(DeinterlaceMode mode, bool fieldRate = false);
+    /**
+     * @brief the filter of the renderers to scale the video in the shader, bilinear by default
+     */
+    void setScaleFilter(ScaleFilter filter);
+    /**
+     * @brief the statistics of seek-to-first-frame time
+     */
+    SeekStatistics seekStatistics() const;
 
     /**
      * @brief set the mode and value for buffer
@@ -72,11 +134,74 @@ public:
      * @paras value for BufferTime is 1000ms, for BufferBytes is 1024 Bytes, for BufferPackets is 24
      */
     void setBufferPara(BufferMode mode, int64_t value);
+    /**
+     * @brief size the buffer value automatically by the arrival rate and
+     * jitter of the input, for real-time stream only. false by default
+     */
+    void setBufferAdaptive(bool adaptive);
+    BufferEstimate bufferEstimate() const;
+    /**
+     * @brief switch the variants of HLS/DASH by the measured throughput, the
+     * variants are in MediaInfo. Should be called before prepare, false by default
+     */
+    void setAdaptiveBitrate(bool enable);
+    /**
+     * @brief switch to the variant at the next segment without flush,
+     * the adaptive bitrate is disabled
+     */
+    void selectVariant(int index);
+    /**
+     * @brief bits per second of the input, 0 if not measured
+     */
+    double throughput() const;
+    /**
+     * @brief record the real-time stream, so that it can be paused and seeked
+     * inside the latest seconds. The older packets are moved to the file if
+     * it's set, which is a ring of file_bytes. Should be called before prepare,
+     * <= 0 seconds disables it
+     */
+    void setTimeShift(double seconds, const std::string &file = std::string(), int64_t file_bytes = 0);
+    /**
+     * @brief the range can be seeked to in timeshift, same as position()
+     */
+    bool timeShiftRange(double &start, double &end) const;
+    /**
+     * @brief play at the speed when it is behind the live edge in timeshift,
+     * until the live is reached. <= 1 means no catch up
+     */
+    void setTimeShiftCatchUpSpeed(float speed);
+    /**
+     * @brief record the playing media to the file without transcoding, it
+     * starts at the next key frame. The container is guessed from the file
+     * name(mp4, mkv, ts...) if format is empty. The packets are dropped
+     * instead of blocking the playback if the file can not be written in time
+     */
+    bool startRecord(const std::string &file, const std::string &format = std::string());
+    /**
+     * @brief stop at the next key frame, it's finished when the media is stopped too
+     */
+    void stopRecord();
+    bool isRecording() const;
+    /**
+     * @brief open the next media in background while playing, the decoders
+     * are opened and the first packets are read. If the streams are same as
+     * the playing ones, it follows the current media without gap at the end,
+     * the status Loaded and Prepared are notified when it starts. Otherwise
+     * call playPreloaded() at End. An empty url cancels the preload
+     */
+    bool preload(const std::string &url);
+    bool isPreloaded() const;
+    /**
+     * @brief switch to the preloaded media at once, waiting for the preload
+     * if not finished. The audio output is reused if the format is same
+     */
+    bool playPreloaded();
 
     MediaInfo* info();
     /**
      * @brief position
-     * @return current pts of master clock, second
+     * @return current pts of master clock, second.
+     * It's the position in the current media if chained by preload
      */
     double position();
     /**
@@ -100,9 +225,28 @@ public:
     void setResampleType(ResampleType t);
 
     void renderVideo();
+    /**
+     * @brief the directory to cache the binaries of shader programs, so they are
+     * not compiled again in the next run. Empty(default) to cache in memory only
+     */
+    static void setShaderCacheDirectory(const std::string &dir);
+    /**
+     * @brief build the shader programs of common formats in the current GL context,
+     * e.g. a background context at startup, to shorten the time to the first frame
+     */
+    static void prewarmShaders();
     void setRenderCallback(std::function<void(void* vo_opaque)> cb);
     VideoRenderer* setVideoRenderer(int w, int h, void* opaque = nullptr);
     void addVideoRenderer(VideoRenderer *renderer);
+    /**
+     * @brief decode another video track besides the main one and show it on the
+     * renderer, e.g. the cameras multiplexed in a surveillance stream. Every view
+     * is decoded in its own threads and follows the clock of the player.
+     * Should be called before "prepare()", and renderVideo() renders the views too
+     * @param track the index in the video list of MediaInfo
+     */
+    bool addVideoView(int track, VideoRenderer *renderer);
+    void clearVideoViews();
     /**
      * @brief remove renderer. If param is null, remove all.
      */
@@ -119,7 +263,7 @@ public:
     bool installFilter(RenderFilter *filter, VideoRenderer* render = nullptr, int index = 0x7FFFFFFF);
 
     /*
-     *\brief Use 'setWantedStreamSpec' to switch the track of internal subtitle,
+     *\brief Use 'switchTrack' to switch the track of internal subtitle,
      * or 'addExternalSubtitle' to load external subtitle
      */
     void setInternalSubtitleEnabled(bool enabled, VideoRenderer* r = nullptr);
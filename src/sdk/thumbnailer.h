@@ -0,0 +1,91 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include "global.h"
+#include "DPTR.h"
+#include <vector>
+
+/**
+ * Extract downscaled frames of a media file without a player,
+ * e.g. the thumbnails of the seek bar.
+ */
+NAMESPACE_BEGIN
+
+class ThumbnailerPrivate;
+class SMI_EXPORT Thumbnailer
+{
+    DPTR_DECLARE_PRIVATE(Thumbnailer)
+public:
+    Thumbnailer();
+    ~Thumbnailer();
+
+    void setMedia(const std::string& url);
+    /**
+     * @brief the size of each thumbnail, the aspect ratio is kept if
+     * width or height is 0. 160x0 by default
+     */
+    void setSize(int width, int height = 0);
+    /**
+     * @brief the timestamps in seconds from the beginning of the media
+     */
+    void setTimestamps(const std::vector<double> &timestamps);
+    /**
+     * @brief extract one thumbnail every "seconds" through the whole media,
+     * it is ignored if the timestamps are set
+     */
+    void setInterval(double seconds);
+    /**
+     * @brief the number of worker threads, each one opens the media
+     * and extracts a segment of the timestamps. 0 means the number of the cpu cores
+     */
+    void setThreads(int threads);
+    /**
+     * @brief decode to the exact timestamp instead of using the nearest
+     * key frame before it, which is much slower. false by default
+     */
+    void setAccurate(bool accurate);
+    /**
+     * @brief called from the worker threads when a thumbnail is written
+     */
+    void setThumbnailCallback(std::function<void(int index, double pts)> f);
+
+    /**
+     * @brief open the media and resolve the size and the timestamps,
+     * then the caller can allocate the buffer
+     * @return 0 if success, otherwise a negative value
+     */
+    int load();
+    int count() const;
+    int width() const;
+    int height() const;
+    /**
+     * @brief the timestamps to extract, sorted. After extract() they are
+     * replaced by the timestamps of the frames really extracted, nan if failed
+     */
+    std::vector<double> timestamps() const;
+
+    /**
+     * @brief extract all the thumbnails as RGBA, thumbnail i is written
+     * at buffer + i * height() * stride
+     * @param stride the bytes of a line, 0 means width() * 4
+     * @return the number of the thumbnails extracted, or a negative value if failed
+     */
+    int extract(uint8_t *buffer, int stride = 0);
+    /**
+     * @brief extract all the thumbnails as RGBA into one image, which has
+     * "columns" thumbnails in a row, the size is spriteWidth() x spriteHeight()
+     */
+    int extractSprite(uint8_t *buffer, int columns);
+    int spriteWidth(int columns) const;
+    int spriteHeight(int columns) const;
+    /**
+     * @brief abort the extracting from another thread
+     */
+    void abort();
+
+private:
+    DPTR_DECLARE(Thumbnailer)
+};
+
+NAMESPACE_END
+#endif //THUMBNAILER_H
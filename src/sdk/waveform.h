@@ -0,0 +1,82 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include "global.h"
+#include "DPTR.h"
+#include <vector>
+
+/**
+ * Overview waveform of an audio track, decoded as fast as possible
+ * without playing it.
+ */
+NAMESPACE_BEGIN
+
+/**
+ * @brief the peak of the downmixed samples, in the range -1.0~1.0
+ */
+typedef struct WaveformPeak {
+    float min;
+    float max;
+    float rms;
+    WaveformPeak() {
+        min = max = rms = 0.0f;
+    }
+} WaveformPeak;
+
+class WaveformPrivate;
+class SMI_EXPORT Waveform
+{
+    DPTR_DECLARE_PRIVATE(Waveform)
+public:
+    Waveform();
+    ~Waveform();
+
+    void setMedia(const std::string& url);
+    /**
+     * @brief the number of segments decoded in parallel, 0 means the number
+     * of the cpu cores. The media is decoded in one pass if it is not seekable
+     */
+    void setThreads(int threads);
+    /**
+     * @brief the samples of a peak in level 0, 256 by default.
+     * Each upper level merges two peaks of the level below, until only one peak left
+     */
+    void setSamplesPerPeak(int samples);
+    /**
+     * @brief called from the worker threads, progress is 0.0~1.0
+     */
+    void setProgressCallback(std::function<void(double progress)> f);
+
+    /**
+     * @brief decode the audio track and build the peak pyramid, block until finished
+     * @return 0 if success, otherwise a negative value
+     */
+    int generate();
+    /**
+     * @brief abort the generating from another thread
+     */
+    void abort();
+
+    int sampleRate() const;
+    int samplesPerPeak(int level = 0) const;
+    int levels() const;
+    /**
+     * @brief the level whose peak covers at least "samples" samples,
+     * e.g. samples per pixel of the view
+     */
+    int levelFor(int64_t samples) const;
+    const std::vector<WaveformPeak>& peaks(int level) const;
+
+    /**
+     * @brief save the peak pyramid to a compact file(16 bits per value) for reuse
+     * @return 0 if success, otherwise a negative value
+     */
+    int save(const std::string& file) const;
+    int load(const std::string& file);
+
+private:
+    DPTR_DECLARE(Waveform)
+};
+
+NAMESPACE_END
+#endif //WAVEFORM_H
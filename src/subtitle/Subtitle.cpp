@@ -82,6 +82,8 @@ void SubtitleReadThread::run()
         return;
     while (!abort) {
         ret = demuxer.readFrame();
+        if (ret == 999)
+            continue;
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
                 break;
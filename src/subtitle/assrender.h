@@ -89,6 +89,20 @@ public:
         return 0;
     }
 
+    /* replace the track with a new one of the header, e.g. another subtitle stream */
+    void setHeader(AVCodecContext* ctx)
+    {
+#ifdef SMI_HAVE_LIBASS
+        if (!library)
+            return;
+        if (assTrack)
+            ass_free_track(assTrack);
+        assTrack = ass_new_track(library);
+        if (assTrack && ctx->subtitle_header)
+            ass_process_codec_private(assTrack, (char *)ctx->subtitle_header, ctx->subtitle_header_size);
+#endif
+    }
+
     int addSubtitleToTrack(AVSubtitle* subtitle)
     {
 #ifdef SMI_HAVE_LIBASS
@@ -0,0 +1,109 @@
+#include "ThreadPool.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+NAMESPACE_BEGIN
+
+class ThreadPoolPrivate
+{
+public:
+    ThreadPoolPrivate():
+        running(0),
+        quit(false)
+    {
+
+    }
+    ~ThreadPoolPrivate()
+    {
+
+    }
+
+    void work()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return quit || !tasks.empty(); });
+                if (quit)
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+                running++;
+            }
+            task();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                running--;
+                if (tasks.empty() && running == 0)
+                    done_cond.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()> > tasks;
+    int running;
+    bool quit;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable done_cond;
+};
+
+ThreadPool::ThreadPool(int threads):
+    d_ptr(new ThreadPoolPrivate)
+{
+    DPTR_D(ThreadPool);
+    if (threads <= 0)
+        threads = FORCE_INT(std::thread::hardware_concurrency());
+    if (threads <= 0)
+        threads = 1;
+    for (int i = 0; i < threads; ++i) {
+        d->threads.push_back(std::thread(&ThreadPoolPrivate::work, d));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    DPTR_D(ThreadPool);
+    {
+        DECL_LOCKGUARD(d->mutex);
+        d->quit = true;
+    }
+    d->cond.notify_all();
+    for (size_t i = 0; i < d->threads.size(); ++i) {
+        if (d->threads[i].joinable())
+            d->threads[i].join();
+    }
+}
+
+int ThreadPool::threadCount() const
+{
+    DPTR_D(const ThreadPool);
+    return FORCE_INT(d->threads.size());
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    DPTR_D(ThreadPool);
+    if (!task)
+        return;
+    {
+        DECL_LOCKGUARD(d->mutex);
+        d->tasks.push(std::move(task));
+    }
+    d->cond.notify_one();
+}
+
+void ThreadPool::waitForDone()
+{
+    DPTR_D(ThreadPool);
+    std::unique_lock<std::mutex> lock(d->mutex);
+    d->done_cond.wait(lock, [d] { return d->tasks.empty() && d->running == 0; });
+}
+
+NAMESPACE_END
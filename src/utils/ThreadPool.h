@@ -0,0 +1,38 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "sdk/DPTR.h"
+#include "sdk/global.h"
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The ThreadPool class
+ * A fixed number of worker threads which run the posted tasks in order.
+ * The tasks left in the queue are dropped when the pool is destroyed.
+ */
+class ThreadPoolPrivate;
+class ThreadPool
+{
+    DISABLE_COPY(ThreadPool)
+    DPTR_DECLARE_PRIVATE(ThreadPool)
+public:
+    /**
+     * @brief threads <= 0 means the number of the cpu cores
+     */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    int threadCount() const;
+    void post(std::function<void()> task);
+    /**
+     * @brief block until all the posted tasks are finished
+     */
+    void waitForDone();
+
+private:
+    DPTR_DECLARE(ThreadPool)
+};
+
+NAMESPACE_END
+#endif //THREADPOOL_H
@@ -0,0 +1,67 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include "sdk/global.h"
+
+NAMESPACE_BEGIN
+
+/**
+ * @brief The TripleBuffer class
+ * A lock-free mailbox of the latest value, for one writer thread and one
+ * reader thread. The writer never waits for the reader, a value not read
+ * yet is replaced by the next one.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer():
+        back(0),
+        middle(1),
+        front(2)
+    {
+
+    }
+
+    /**
+     * @brief called by the writer only
+     * @return true if the last value written was not read and is replaced
+     */
+    bool write(const T &t)
+    {
+        slots[back] = t;
+        const int old = middle.exchange(back | FreshBit, std::memory_order_acq_rel);
+        back = old & IndexMask;
+        /* the reader keeps its slot, the replaced one is released here */
+        slots[back] = T();
+        return (old & FreshBit) != 0;
+    }
+
+    /**
+     * @brief called by the reader only
+     * @return false if nothing is written since the last read
+     */
+    bool read(T &t)
+    {
+        if (!(middle.load(std::memory_order_acquire) & FreshBit))
+            return false;
+        const int old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & IndexMask;
+        t = slots[front];
+        return true;
+    }
+
+private:
+    enum {
+        IndexMask = 0x3,
+        FreshBit = 0x4
+    };
+    T slots[3];
+    int back;   /* owned by the writer */
+    std::atomic<int> middle;
+    int front;  /* owned by the reader */
+};
+
+NAMESPACE_END
+#endif //TRIPLEBUFFER_H
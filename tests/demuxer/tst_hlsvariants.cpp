@@ -0,0 +1,540 @@
+/*
+ * Switches the variants of a HLS stream served by a local HTTP server. The playlists are in
+ * tests/fixtures/hls, the segments are encoded when the test starts. The adaptive bitrate is
+ * tested with the playlists written by the test, and the server throttled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "demuxer/Demuxer.h"
+#include "demuxer/AdaptiveBitrate.h"
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+}
+
+using namespace SMI;
+
+#define SEGMENTS 4
+#define SEGMENT_FRAMES 25
+/* reads before the switch is given up, the media has 200 packets */
+#define MAX_READS 1000
+/* the segments of adaptive bitrate are noise, the throughput is measured in samples of 256KB */
+#define ABR_SEGMENTS 20
+#define ABR_READS (ABR_SEGMENTS*SEGMENT_FRAMES*2)
+#define ABR_ENCODE_BITRATE 4000000
+/* the bandwidth of the playlist, the high one is more than the throttled rate can carry */
+#define ABR_LOW_BANDWIDTH 200000
+#define ABR_HIGH_BANDWIDTH 20000000
+/* bytes per second, 8Mbps */
+#define THROTTLE_RATE (1024*1024)
+#define SEND_CHUNK (16*1024)
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+/* serves the files of the directories, one request for each connection, in its own thread */
+class HttpServer
+{
+public:
+    HttpServer(const std::string &playlists, const std::string &segments):
+        fd(-1),
+        port(0),
+        stopped(false),
+        rate(0)
+    {
+        roots[0] = playlists;
+        roots[1] = segments;
+    }
+    ~HttpServer()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0
+                || getsockname(fd, (sockaddr*)&addr, &len) < 0)
+            return false;
+        port = ntohs(addr.sin_port);
+        thread = std::thread(&HttpServer::run, this);
+        return true;
+    }
+    void stop()
+    {
+        stopped = true;
+        if (thread.joinable())
+            thread.join();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        workers.clear();
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+    std::string url(const std::string &path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port) + "/" + path;
+    }
+    int requests(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counts[path];
+    }
+    /* bytes per second sent for each connection, 0 is not limited */
+    void setRate(int64_t bytes)
+    {
+        rate = bytes;
+    }
+
+private:
+    void run()
+    {
+        while (!stopped) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(fd, &fds);
+            timeval tv = { 0, 100000 };
+            if (select(fd + 1, &fds, nullptr, nullptr, &tv) <= 0)
+                continue;
+            const int client = accept(fd, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            // the segments of two variants are read together when switching
+            workers.push_back(std::thread(&HttpServer::serve, this, client));
+        }
+    }
+    void serve(int client)
+    {
+        respond(client);
+        close(client);
+    }
+    void respond(int client)
+    {
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            const ssize_t n = recv(client, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return;
+            request.append(buf, n);
+        }
+        // GET /path HTTP/1.1
+        const size_t begin = request.find(' ') + 2;
+        const std::string path = request.substr(begin, request.find(' ', begin) - begin);
+        std::string body;
+        bool found = false;
+        for (int i = 0; i < 2 && !found; ++i) {
+            FILE *f = fopen((roots[i] + "/" + path).c_str(), "rb");
+            if (!f)
+                continue;
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+                body.append(buf, n);
+            fclose(f);
+            found = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counts[path]++;
+        }
+        std::string response = found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        response += body;
+        size_t sent = 0;
+        while (sent < response.size() && !stopped) {
+            const size_t chunk = std::min<size_t>(SEND_CHUNK, response.size() - sent);
+            const ssize_t n = send(client, response.data() + sent, chunk, MSG_NOSIGNAL);
+            if (n <= 0)
+                return;
+            sent += n;
+            const int64_t limit = rate;
+            if (limit > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(n*1000000/limit));
+        }
+    }
+
+    std::string roots[2];
+    int fd;
+    int port;
+    std::atomic<bool> stopped;
+    std::atomic<int64_t> rate;
+    std::thread thread;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::map<std::string, int> counts;
+};
+
+static bool writePacket(AVFormatContext **ctx, const std::string &prefix, AVCodecContext *enc, AVPacket *pkt)
+{
+    const int segment = FORCE_INT(pkt->pts / SEGMENT_FRAMES);
+    const std::string file = prefix + "_" + std::to_string(segment) + ".ts";
+    if (!*ctx || strcmp((*ctx)->url, file.c_str())) {
+        if (*ctx) {
+            av_write_trailer(*ctx);
+            avio_closep(&(*ctx)->pb);
+            avformat_free_context(*ctx);
+            *ctx = nullptr;
+        }
+        if (avformat_alloc_output_context2(ctx, nullptr, "mpegts", file.c_str()) < 0)
+            return false;
+        AVStream *st = avformat_new_stream(*ctx, nullptr);
+        avcodec_parameters_from_context(st->codecpar, enc);
+        st->time_base = enc->time_base;
+        if (avio_open(&(*ctx)->pb, file.c_str(), AVIO_FLAG_WRITE) < 0 || avformat_write_header(*ctx, nullptr) < 0)
+            return false;
+    }
+    AVStream *st = (*ctx)->streams[0];
+    av_packet_rescale_ts(pkt, enc->time_base, st->time_base);
+    pkt->stream_index = 0;
+    return av_interleaved_write_frame(*ctx, pkt) >= 0;
+}
+
+/* mpeg2video segments of 1s starting with a key frame, the timestamps continue across them */
+static bool writeSegments(const std::string &prefix, int width, int height, int segments = SEGMENTS,
+                          int64_t bit_rate = 0, bool noise = false)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO);
+    if (!codec)
+        return false;
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    enc->width = width;
+    enc->height = height;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = av_make_q(1, SEGMENT_FRAMES);
+    enc->framerate = av_make_q(SEGMENT_FRAMES, 1);
+    enc->gop_size = SEGMENT_FRAMES;
+    enc->max_b_frames = 0;
+    enc->bit_rate = bit_rate > 0 ? bit_rate : width*height*2;
+    // the sequence header is repeated in each segment
+    enc->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+    bool ok = avcodec_open2(enc, codec, nullptr) >= 0;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    AVFormatContext *ctx = nullptr;
+    frame->format = enc->pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    ok = ok && av_frame_get_buffer(frame, 0) >= 0;
+    uint32_t seed = 1;
+    for (int i = 0; ok && i <= segments*SEGMENT_FRAMES; ++i) {
+        AVFrame *in = nullptr;
+        if (i < segments*SEGMENT_FRAMES) {
+            ok = av_frame_make_writable(frame) >= 0;
+            memset(frame->data[0], 16 + i % 200, frame->linesize[0]*height);
+            // hardly compressed, so the segments are large enough to measure the throughput
+            for (int y = 0; noise && y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    frame->data[0][y*frame->linesize[0] + x] = 16 + seed % 220;
+                }
+            }
+            memset(frame->data[1], 128, frame->linesize[1]*height/2);
+            memset(frame->data[2], 128, frame->linesize[2]*height/2);
+            frame->pts = i;
+            // the first frame of a segment is a key frame
+            frame->pict_type = (i % SEGMENT_FRAMES) ? AV_PICTURE_TYPE_NONE : AV_PICTURE_TYPE_I;
+            in = frame;
+        }
+        ok = ok && avcodec_send_frame(enc, in) >= 0;
+        while (ok && avcodec_receive_packet(enc, pkt) >= 0) {
+            ok = writePacket(&ctx, prefix, enc, pkt);
+            av_packet_unref(pkt);
+        }
+    }
+    if (ctx) {
+        av_write_trailer(ctx);
+        avio_closep(&ctx->pb);
+        avformat_free_context(ctx);
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    return ok;
+}
+
+static bool writeFile(const std::string &file, const std::string &text)
+{
+    FILE *f = fopen(file.c_str(), "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    fclose(f);
+    return ok;
+}
+
+/* the master playlist abr.m3u8 of the variants abr_low and abr_high */
+static bool writeAbrPlaylists(const std::string &dir)
+{
+    const char *names[] = { "abr_low", "abr_high" };
+    for (int i = 0; i < 2; ++i) {
+        std::string text = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:1\n"
+            "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-PLAYLIST-TYPE:VOD\n";
+        for (int j = 0; j < ABR_SEGMENTS; ++j)
+            text += "#EXTINF:1.000,\n" + std::string(names[i]) + "_" + std::to_string(j) + ".ts\n";
+        text += "#EXT-X-ENDLIST\n";
+        if (!writeFile(dir + "/" + names[i] + ".m3u8", text))
+            return false;
+    }
+    return writeFile(dir + "/abr.m3u8", "#EXTM3U\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(ABR_HIGH_BANDWIDTH) + ",RESOLUTION=640x480\n"
+        "abr_high.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(ABR_LOW_BANDWIDTH) + ",RESOLUTION=640x480\n"
+        "abr_low.m3u8\n");
+}
+
+/* read until the throughput crosses the bitrate the high variant needs, false at the end */
+static bool readUntilThroughput(Demuxer &demuxer, bool above)
+{
+    const double bitrate = ABR_HIGH_BANDWIDTH / ABR_SAFETY_FACTOR;
+    for (int i = 0; i < ABR_READS; ++i) {
+        const double bw = demuxer.throughput();
+        if (bw > 0 && (bw >= bitrate) == above)
+            return true;
+        const int ret = demuxer.readFrame();
+        if (ret == AVERROR_EOF)
+            return false;
+    }
+    return false;
+}
+
+/* read until the variant switched to is used, false at the end */
+static bool readUntilSwitched(Demuxer &demuxer, int to)
+{
+    const int stream = demuxer.variants()[to].video_stream;
+    for (int i = 0; i < ABR_READS && demuxer.isSwitchingVariant(); ++i) {
+        const int ret = demuxer.readFrame();
+        if (ret == AVERROR_EOF)
+            return false;
+        if (ret == 0 && !demuxer.isSwitchingVariant() && demuxer.stream() != stream)
+            return false;
+    }
+    return !demuxer.isSwitchingVariant() && demuxer.variant() == to &&
+        demuxer.streamIndex(MediaTypeVideo) == stream;
+}
+
+/*
+ * The policy is driven with a time of its own, so the intervals are not waited. The throughput
+ * is measured by reading from the server, it's throttled to drop below the high variant.
+ */
+static int runAbrTests(HttpServer &server)
+{
+    Demuxer demuxer;
+    demuxer.setThroughputMeasure(true);
+    demuxer.setMedia(server.url("abr.m3u8"));
+    CHECK(demuxer.load() == 0);
+    CHECK(demuxer.variants().size() == 2);
+    CHECK(demuxer.variants()[1].bitrate == ABR_HIGH_BANDWIDTH);
+
+    AdaptiveBitrate abr;
+    int64_t now = ABR_CHECK_INTERVAL;
+    // start from the lowest one
+    abr.start(&demuxer, now);
+    CHECK(demuxer.variant() == 0);
+    CHECK(readUntilSwitched(demuxer, 0));
+    CHECK(readUntilThroughput(demuxer, true));
+
+    // up only after ABR_UP_INTERVAL since the last switch, and with the buffer enough
+    now += ABR_CHECK_INTERVAL;
+    CHECK(!abr.update(&demuxer, true, now));
+    now += ABR_UP_INTERVAL;
+    CHECK(!abr.update(&demuxer, false, now));
+    // checked once in ABR_CHECK_INTERVAL
+    CHECK(!abr.update(&demuxer, true, now + ABR_CHECK_INTERVAL/2));
+    now += ABR_CHECK_INTERVAL;
+    CHECK(abr.update(&demuxer, true, now));
+    CHECK(demuxer.isSwitchingVariant());
+    CHECK(demuxer.variant() == 1);
+    // no other switch is started until it's done
+    CHECK(!abr.update(&demuxer, true, now + ABR_UP_INTERVAL*2));
+    CHECK(readUntilSwitched(demuxer, 1));
+    const int64_t up_time = now;
+
+    // the fast average sees the drop in a few samples, and it's switched down at once, even
+    // in ABR_UP_INTERVAL after the last switch and without the buffer enough
+    const double fast_bw = demuxer.throughput();
+    server.setRate(THROTTLE_RATE);
+    CHECK(readUntilThroughput(demuxer, false));
+    CHECK(demuxer.throughput() < fast_bw);
+    now = up_time + ABR_CHECK_INTERVAL;
+    CHECK(abr.update(&demuxer, false, now));
+    CHECK(demuxer.variant() == 0);
+    CHECK(readUntilSwitched(demuxer, 0));
+    const int64_t down_time = now;
+
+    // recovered, up again after the interval
+    server.setRate(0);
+    CHECK(readUntilThroughput(demuxer, true));
+    now = down_time + ABR_CHECK_INTERVAL;
+    CHECK(!abr.update(&demuxer, true, now));
+    now = down_time + ABR_UP_INTERVAL;
+    CHECK(abr.update(&demuxer, true, now));
+    CHECK(demuxer.variant() == 1);
+    CHECK(readUntilSwitched(demuxer, 1));
+    demuxer.unload();
+    return 0;
+}
+
+static int runTests(HttpServer &server)
+{
+    Demuxer demuxer;
+    demuxer.setMedia(server.url("master.m3u8"));
+    CHECK(demuxer.load() == 0);
+
+    // sorted by the bandwidth of the master playlist, not by the order in it
+    const std::vector<VariantInfo> &variants = demuxer.variants();
+    CHECK(variants.size() == 2);
+    CHECK(variants[0].bitrate == 200000);
+    CHECK(variants[1].bitrate == 800000);
+    CHECK(variants[0].width == 320 && variants[0].height == 240);
+    CHECK(variants[1].width == 640 && variants[1].height == 480);
+    CHECK(variants[0].video_stream >= 0 && variants[1].video_stream >= 0);
+    CHECK(variants[0].video_stream != variants[1].video_stream);
+
+    const int from = demuxer.variant();
+    CHECK(from == 0 || from == 1);
+    const int to = 1 - from;
+    const int from_stream = variants[from].video_stream;
+    const int to_stream = variants[to].video_stream;
+    AVFormatContext *ctx = demuxer.formatCtx();
+    CHECK(demuxer.streamIndex(MediaTypeVideo) == from_stream);
+    // the other variant is not downloaded
+    CHECK(ctx->streams[to_stream]->discard == AVDISCARD_ALL);
+    CHECK(ctx->streams[from_stream]->discard != AVDISCARD_ALL);
+
+    CHECK(!demuxer.selectVariant(2));
+    CHECK(!demuxer.selectVariant(-1));
+
+    // play a part of the first segment before the switch
+    double last_pts = NAN;
+    for (int i = 0; i < SEGMENT_FRAMES/2; ++i) {
+        const int ret = demuxer.readFrame();
+        CHECK(ret >= -1);
+        if (ret == 0) {
+            CHECK(demuxer.stream() == from_stream);
+            last_pts = demuxer.packet().pts;
+        }
+    }
+    CHECK(!isnan(last_pts));
+
+    CHECK(demuxer.selectVariant(to));
+    CHECK(demuxer.isSwitchingVariant());
+    CHECK(demuxer.variant() == to);
+    CHECK(ctx->streams[to_stream]->discard != AVDISCARD_ALL);
+
+    // the old stream is used until a key frame of the new one after it
+    bool switched = false;
+    for (int i = 0; i < MAX_READS && !switched; ++i) {
+        const int ret = demuxer.readFrame();
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret != 0)
+            continue;
+        const Packet &pkt = demuxer.packet();
+        if (demuxer.stream() == from_stream) {
+            CHECK(demuxer.isSwitchingVariant());
+            CHECK(pkt.pts > last_pts);
+            last_pts = pkt.pts;
+            continue;
+        }
+        CHECK(demuxer.stream() == to_stream);
+        CHECK(pkt.containKeyFrame);
+        CHECK(pkt.pts > last_pts);
+        switched = true;
+    }
+    CHECK(switched);
+    CHECK(!demuxer.isSwitchingVariant());
+    CHECK(demuxer.variant() == to);
+    CHECK(demuxer.streamIndex(MediaTypeVideo) == to_stream);
+    CHECK(ctx->streams[from_stream]->discard == AVDISCARD_ALL);
+
+    // no packet of the old variant after the switch, and its last segment is never requested
+    int packets = 0;
+    for (int i = 0; i < MAX_READS; ++i) {
+        const int ret = demuxer.readFrame();
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret != 0)
+            continue;
+        CHECK(demuxer.stream() == to_stream);
+        CHECK(demuxer.packet().pts > last_pts);
+        last_pts = demuxer.packet().pts;
+        packets++;
+    }
+    CHECK(packets > 0);
+    const std::string old_prefix = from == 0 ? "low_" : "high_";
+    CHECK(server.requests(old_prefix + std::to_string(SEGMENTS - 1) + ".ts") == 0);
+    demuxer.unload();
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <directory of the playlists>\n", argv[0]);
+        return 1;
+    }
+    char dir[] = "/tmp/tst_hlsvariantsXXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "can not create the directory of the segments\n");
+        return 1;
+    }
+    const std::string segments(dir);
+    if (!writeSegments(segments + "/low", 320, 240) || !writeSegments(segments + "/high", 640, 480) ||
+            !writeSegments(segments + "/abr_low", 640, 480, ABR_SEGMENTS, ABR_ENCODE_BITRATE, true) ||
+            !writeSegments(segments + "/abr_high", 640, 480, ABR_SEGMENTS, ABR_ENCODE_BITRATE, true) ||
+            !writeAbrPlaylists(segments)) {
+        fprintf(stderr, "can not encode the segments\n");
+        return 1;
+    }
+    avformat_network_init();
+    HttpServer server(argv[1], segments);
+    if (!server.start()) {
+        fprintf(stderr, "can not start the http server\n");
+        return 1;
+    }
+    const int ret = runTests(server) || runAbrTests(server);
+    server.stop();
+    avformat_network_deinit();
+    for (int i = 0; i < ABR_SEGMENTS; ++i) {
+        remove((segments + "/low_" + std::to_string(i) + ".ts").c_str());
+        remove((segments + "/high_" + std::to_string(i) + ".ts").c_str());
+        remove((segments + "/abr_low_" + std::to_string(i) + ".ts").c_str());
+        remove((segments + "/abr_high_" + std::to_string(i) + ".ts").c_str());
+    }
+    const char *playlists[] = { "abr", "abr_low", "abr_high" };
+    for (int i = 0; i < 3; ++i)
+        remove((segments + "/" + playlists[i] + ".m3u8").c_str());
+    rmdir(dir);
+    return ret;
+}
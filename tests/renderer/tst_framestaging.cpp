@@ -0,0 +1,135 @@
+/*
+ * Uploads frames through the PBOs filled in the thread of the frames, in an offscreen GL context.
+ * Run with LIBGL_ALWAYS_SOFTWARE=1 to use llvmpipe without a GPU.
+ */
+#include <stdio.h>
+#include <thread>
+#include "glad/glad.h"
+#include "renderer/OpenglAide.h"
+#include "renderer/VideoRenderer.h"
+#include "sdk/mediainfo.h"
+#include "SDL.h"
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+using namespace SMI;
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 64
+/* ctest treats it as skipped, e.g. no GL context in the environment */
+#define TEST_SKIPPED 77
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+static VideoFrame createFrame(int luma, double pts)
+{
+    AVFrame *f = av_frame_alloc();
+    f->format = AV_PIX_FMT_YUV420P;
+    f->width = TEST_WIDTH;
+    f->height = TEST_HEIGHT;
+    av_frame_get_buffer(f, 0);
+    memset(f->data[0], luma, f->linesize[0]*TEST_HEIGHT);
+    memset(f->data[1], 128, f->linesize[1]*TEST_HEIGHT/2);
+    memset(f->data[2], 128, f->linesize[2]*TEST_HEIGHT/2);
+    VideoFrame frame(TEST_WIDTH, TEST_HEIGHT, VideoFormat(VideoFormat::Format_YUV420P));
+    frame.setTimestamp(pts);
+    frame.setData(f);
+    av_frame_free(&f);
+    return frame;
+}
+
+static int centerLuma()
+{
+    GLubyte rgba[4] = {0};
+    glReadPixels(TEST_WIDTH/2, TEST_HEIGHT/2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    return rgba[1];
+}
+
+static int runTests(VideoRenderer *renderer)
+{
+    GLint alignment = 0;
+    // the PBOs are created by the first frame, it is copied in the GL thread
+    renderer->receive(createFrame(235, 0.0));
+    renderer->renderVideo();
+    CHECK(centerLuma() > 200);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    CHECK(alignment == 4);
+    UploadStatistics st = renderer->uploadStatistics();
+    CHECK(st.frames == 1);
+    CHECK(st.staged == 0);
+
+    // staged in another thread, like the video thread
+    std::thread video([renderer]() {
+        renderer->receive(createFrame(16, 0.04));
+    });
+    video.join();
+    renderer->renderVideo();
+    CHECK(centerLuma() < 50);
+    st = renderer->uploadStatistics();
+    CHECK(st.frames == 2);
+    CHECK(st.staged == 1);
+    CHECK(st.direct == 0);
+
+    // the frame replaced before rendering is not uploaded, its slot is reused
+    for (int i = 0; i < 8; ++i) {
+        renderer->receive(createFrame(16, 0.08 + i*0.04));
+        renderer->receive(createFrame(235, 0.1 + i*0.04));
+        renderer->renderVideo();
+        CHECK(centerLuma() > 200);
+    }
+    st = renderer->uploadStatistics();
+    CHECK(st.frames == 10);
+    CHECK(st.staged == 9);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    CHECK(alignment == 4);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "SDL_Init: %s\n", SDL_GetError());
+        return TEST_SKIPPED;
+    }
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_Window *window = SDL_CreateWindow("tst_framestaging", 0, 0, TEST_WIDTH, TEST_HEIGHT,
+        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : nullptr;
+    if (!context || !gladLoadGL()) {
+        fprintf(stderr, "no GL context: %s\n", SDL_GetError());
+        if (window)
+            SDL_DestroyWindow(window);
+        SDL_Quit();
+        return TEST_SKIPPED;
+    }
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+    if (!OpenglAide::isPBOSupported() || !OpenglAide::isSyncSupported() || !OpenglAide::isBufferStorageSupported()) {
+        fprintf(stderr, "persistently mapped PBOs are not supported\n");
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return TEST_SKIPPED;
+    }
+    MediaInfo info;
+    VideoRenderer *renderer = new VideoRenderer();
+    renderer->setMediaInfo(&info);
+    renderer->initVideoRender();
+    renderer->resizeWindow(TEST_WIDTH, TEST_HEIGHT);
+    const int ret = runTests(renderer);
+    delete renderer;
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return ret;
+}
@@ -0,0 +1,173 @@
+/*
+ * Appends packets past the memory and file limits of the time shift buffer, then seeks and reads them back.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "TimeShiftBuffer.h"
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+using namespace SMI;
+
+#define PACKET_SIZE 1000
+/* in ms, the time base is 0.001 */
+#define PACKET_DURATION 100
+#define KEY_INTERVAL 5
+#define MEMORY_PACKETS 4
+/* the file has room for 7 packets and a half, the tail is skipped when the ring wraps */
+#define FILE_PACKETS 7
+#define FILE_BYTES (PACKET_SIZE*FILE_PACKETS + PACKET_SIZE/2)
+#define FILE_PATH "tst_timeshiftbuffer.dat"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+static double ptsOf(int index)
+{
+    return index * PACKET_DURATION * 0.001;
+}
+
+/* the bytes depend on the index and the offset, so a packet read from a wrong place is found */
+static Packet createPacket(int index)
+{
+    AVPacket *avpkt = av_packet_alloc();
+    av_new_packet(avpkt, PACKET_SIZE);
+    for (int i = 0; i < PACKET_SIZE; ++i)
+        avpkt->data[i] = (uint8_t)(index*31 + i);
+    avpkt->pts = avpkt->dts = index * PACKET_DURATION;
+    avpkt->duration = PACKET_DURATION;
+    avpkt->pos = index * PACKET_SIZE;
+    avpkt->flags = index % KEY_INTERVAL == 0 ? AV_PKT_FLAG_KEY : 0;
+    Packet pkt = Packet::fromAVPacket(avpkt, 0.001);
+    av_packet_free(&avpkt);
+    return pkt;
+}
+
+static void appendPackets(TimeShiftBuffer &buffer, int first, int last)
+{
+    for (int i = first; i <= last; ++i)
+        buffer.append(createPacket(i), 0);
+}
+
+/* read the packets [first, last] from the cursor */
+static int readPackets(TimeShiftBuffer &buffer, int first, int last)
+{
+    for (int i = first; i <= last; ++i) {
+        Packet pkt;
+        int stream = -1;
+        CHECK(!buffer.isLive());
+        CHECK(buffer.read(pkt, stream));
+        CHECK(stream == 0);
+        CHECK(pkt.pts == ptsOf(i));
+        CHECK(pkt.pos == i * PACKET_SIZE);
+        CHECK(pkt.containKeyFrame == (i % KEY_INTERVAL == 0));
+        const AVPacket *avpkt = pkt.asAVPacket();
+        CHECK(avpkt && avpkt->size == PACKET_SIZE);
+        CHECK(avpkt->pts == i * PACKET_DURATION);
+        for (int j = 0; j < PACKET_SIZE; ++j)
+            CHECK(avpkt->data[j] == (uint8_t)(i*31 + j));
+    }
+    return 0;
+}
+
+static int testFile()
+{
+    TimeShiftBuffer buffer;
+    buffer.setKeyStream(0);
+    buffer.setMemoryBytes(PACKET_SIZE*MEMORY_PACKETS);
+    CHECK(buffer.setFile(FILE_PATH, FILE_BYTES));
+    appendPackets(buffer, 0, 29);
+    // 26..29 are in memory, 19..25 in the file, the older ones are overwritten
+    CHECK(buffer.memoryBytes() == PACKET_SIZE*MEMORY_PACKETS);
+    CHECK(buffer.fileBytes() == PACKET_SIZE*FILE_PACKETS);
+    CHECK(buffer.startTime() == ptsOf(20));
+    CHECK(buffer.endTime() == ptsOf(29));
+
+    // the key frame not later than pts, through the file into the memory
+    CHECK(buffer.seek(ptsOf(23)));
+    CHECK(buffer.position() == ptsOf(20));
+    if (readPackets(buffer, 20, 29))
+        return 1;
+    Packet pkt;
+    int stream = -1;
+    CHECK(!buffer.read(pkt, stream));
+    CHECK(buffer.isLive());
+    // the last key frame in the file, followed by the memory
+    CHECK(buffer.seek(ptsOf(25)));
+    if (readPackets(buffer, 25, 27))
+        return 1;
+    CHECK(buffer.seek(ptsOf(100)));
+    CHECK(buffer.position() == ptsOf(25));
+    // an overwritten key frame is not reachable, the oldest one left is used
+    CHECK(buffer.seek(ptsOf(10)));
+    CHECK(buffer.position() == ptsOf(20));
+    if (readPackets(buffer, 20, 20))
+        return 1;
+    CHECK(!buffer.seek(NAN));
+
+    // the cursor at 22 is overwritten while reading, it continues from the next key frame
+    CHECK(buffer.seek(ptsOf(20)));
+    if (readPackets(buffer, 20, 21))
+        return 1;
+    appendPackets(buffer, 30, 34);
+    CHECK(buffer.startTime() == ptsOf(25));
+    CHECK(buffer.position() == ptsOf(25));
+    if (readPackets(buffer, 25, 34))
+        return 1;
+    CHECK(buffer.isLive());
+    CHECK(buffer.memoryBytes() == PACKET_SIZE*MEMORY_PACKETS);
+    CHECK(buffer.fileBytes() == PACKET_SIZE*FILE_PACKETS);
+
+    // the packets in the file are lost when it's closed, no key frame is left in memory
+    CHECK(buffer.setFile(std::string(), 0));
+    CHECK(buffer.fileBytes() == 0);
+    CHECK(buffer.memoryBytes() == PACKET_SIZE*MEMORY_PACKETS);
+    CHECK(isnan(buffer.startTime()));
+    CHECK(buffer.endTime() == ptsOf(34));
+    CHECK(!buffer.seek(ptsOf(30)));
+    CHECK(buffer.isLive());
+    return 0;
+}
+
+static int testMemory()
+{
+    TimeShiftBuffer buffer;
+    buffer.setKeyStream(0);
+    buffer.setMemoryBytes(PACKET_SIZE*MEMORY_PACKETS);
+    appendPackets(buffer, 0, 11);
+    // without the file the packets beyond the memory are dropped
+    CHECK(buffer.memoryBytes() == PACKET_SIZE*MEMORY_PACKETS);
+    CHECK(buffer.fileBytes() == 0);
+    CHECK(buffer.startTime() == ptsOf(10));
+    CHECK(buffer.seek(ptsOf(9)));
+    CHECK(buffer.position() == ptsOf(10));
+    if (readPackets(buffer, 10, 11))
+        return 1;
+    CHECK(buffer.isLive());
+
+    // the key frames of the other streams are not seek points
+    buffer.clear();
+    buffer.setKeyStream(1);
+    appendPackets(buffer, 0, 3);
+    CHECK(isnan(buffer.startTime()));
+    CHECK(!buffer.seek(ptsOf(0)));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    const int ret = testFile() || testMemory();
+    remove(FILE_PATH);
+    if (ret)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Inserts decoded frames into the cache, walks the links between them and evicts them by bytes.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "VideoFrameCache.h"
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+using namespace SMI;
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 64
+#define FRAME_DURATION 0.04
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1; \
+        } \
+    } while (0)
+
+static VideoFrame createFrame(int index)
+{
+    AVFrame *f = av_frame_alloc();
+    f->format = AV_PIX_FMT_YUV420P;
+    f->width = TEST_WIDTH;
+    f->height = TEST_HEIGHT;
+    av_frame_get_buffer(f, 0);
+    VideoFrame frame(TEST_WIDTH, TEST_HEIGHT, VideoFormat(VideoFormat::Format_YUV420P));
+    frame.setData(f);
+    av_frame_free(&f);
+    frame.setTimestamp(index * FRAME_DURATION);
+    frame.setDuration(FRAME_DURATION);
+    frame.setPos(1000 + index);
+    return frame;
+}
+
+/* insert the frames [first, last] in decoding order, the first one follows a flush */
+static void insertFrames(VideoFrameCache &cache, VideoFrame *frames, int first, int last)
+{
+    for (int i = first; i <= last; ++i) {
+        if (i == first)
+            cache.insert(frames[i], NAN, -1);
+        else
+            cache.insert(frames[i], frames[i - 1].timestamp(), frames[i - 1].pos());
+    }
+}
+
+static bool same(const VideoFrame &a, const VideoFrame &b)
+{
+    return a.isValid() && b.isValid() && a.timestamp() == b.timestamp() && a.pos() == b.pos();
+}
+
+static int testLinks(VideoFrame *frames)
+{
+    VideoFrameCache cache;
+    insertFrames(cache, frames, 0, 4);
+    CHECK(cache.size() == 5);
+    for (int i = 0; i < 5; ++i)
+        CHECK(cache.contains(frames[i].timestamp(), frames[i].pos()));
+    // the same timestamp of another media is not mixed
+    CHECK(!cache.contains(frames[2].timestamp(), 1));
+    CHECK(same(cache.frame(frames[3].timestamp(), frames[3].pos()), frames[3]));
+    CHECK(same(cache.next(frames[1].timestamp(), frames[1].pos()), frames[2]));
+    CHECK(same(cache.previous(frames[1].timestamp(), frames[1].pos()), frames[0]));
+    CHECK(!cache.previous(frames[0].timestamp(), frames[0].pos()).isValid());
+    CHECK(!cache.next(frames[4].timestamp(), frames[4].pos()).isValid());
+    // inserted again, the links are kept
+    cache.insert(frames[2], frames[1].timestamp(), frames[1].pos());
+    CHECK(cache.size() == 5);
+    CHECK(same(cache.next(frames[2].timestamp(), frames[2].pos()), frames[3]));
+
+    // a frame covers its duration, the gap after the last one is not cached
+    CHECK(same(cache.at(frames[2].timestamp()), frames[2]));
+    CHECK(same(cache.at(frames[2].timestamp() + FRAME_DURATION/2), frames[2]));
+    CHECK(same(cache.at(frames[4].timestamp() + FRAME_DURATION*0.99), frames[4]));
+    CHECK(!cache.at(frames[4].timestamp() + FRAME_DURATION*2).isValid());
+    CHECK(!cache.at(-FRAME_DURATION).isValid());
+    CHECK(!cache.at(NAN).isValid());
+
+    // not continuous after seek
+    VideoFrameCache seeked;
+    insertFrames(seeked, frames, 0, 1);
+    insertFrames(seeked, frames, 3, 4);
+    CHECK(!seeked.next(frames[1].timestamp(), frames[1].pos()).isValid());
+    CHECK(!seeked.previous(frames[3].timestamp(), frames[3].pos()).isValid());
+    CHECK(!seeked.at(frames[2].timestamp()).isValid());
+    return 0;
+}
+
+static int testEviction(VideoFrame *frames)
+{
+    VideoFrameCache cache;
+    cache.insert(frames[0], NAN, -1);
+    const int64_t frame_bytes = cache.bytes();
+    CHECK(frame_bytes >= TEST_WIDTH*TEST_HEIGHT*3/2);
+
+    cache.clear();
+    CHECK(cache.size() == 0 && cache.bytes() == 0);
+    cache.setMaxBytes(frame_bytes*3);
+    insertFrames(cache, frames, 0, 4);
+    // the least recently used ones are evicted
+    CHECK(cache.size() == 3);
+    CHECK(cache.bytes() == frame_bytes*3);
+    CHECK(!cache.contains(frames[0].timestamp(), frames[0].pos()));
+    CHECK(!cache.contains(frames[1].timestamp(), frames[1].pos()));
+    // the link to an evicted frame is not followed
+    CHECK(!cache.previous(frames[2].timestamp(), frames[2].pos()).isValid());
+    CHECK(same(cache.previous(frames[3].timestamp(), frames[3].pos()), frames[2]));
+
+    // frames[2] is used, then frames[3] is the oldest one
+    cache.frame(frames[2].timestamp(), frames[2].pos());
+    cache.insert(frames[5], frames[4].timestamp(), frames[4].pos());
+    CHECK(cache.size() == 3);
+    CHECK(cache.contains(frames[2].timestamp(), frames[2].pos()));
+    CHECK(!cache.contains(frames[3].timestamp(), frames[3].pos()));
+    CHECK(same(cache.next(frames[4].timestamp(), frames[4].pos()), frames[5]));
+
+    // shrink to one frame, the most recent one is kept
+    cache.setMaxBytes(frame_bytes);
+    CHECK(cache.size() == 1);
+    CHECK(cache.contains(frames[5].timestamp(), frames[5].pos()));
+
+    // a frame larger than the limit is not cached
+    cache.setMaxBytes(frame_bytes - 1);
+    cache.clear();
+    cache.insert(frames[0], NAN, -1);
+    CHECK(cache.size() == 0);
+
+    // disabled
+    cache.setMaxBytes(0);
+    insertFrames(cache, frames, 0, 2);
+    CHECK(cache.size() == 0 && cache.bytes() == 0);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    VideoFrame frames[6];
+    for (int i = 0; i < 6; ++i)
+        frames[i] = createFrame(i);
+    if (testLinks(frames) || testEviction(frames))
+        return 1;
+    printf("PASS\n");
+    return 0;
+}